@@ -4,10 +4,14 @@ Builds this project from the ground up, run unit tests and deploys it to Azure o
 """
 import os
 import re
+import bz2
 import sys
 import glob
 import json
+import math
 import base64
+import struct
+import hashlib
 import shutil
 import zipfile
 import tarfile
@@ -15,6 +19,7 @@ import argparse
 import threading
 import subprocess
 import multiprocessing
+import xml.etree.ElementTree as ElementTree
 
 try:  # For Python 3.0 and later
     from urllib.request import urlopen
@@ -26,6 +31,9 @@ EMSDK_VERSION = 'sdk-1.38.24-64bit'
 OPENCV_SRC_URL = 'https://github.com/opencv/opencv/archive/4.0.1.zip'
 DLIB_SRC_URL = 'http://dlib.net/files/dlib-19.6.zip'
 GMOCK_SRC_URL = 'https://github.com/google/googletest/archive/release-1.8.1.zip'
+CNN_FACE_MODEL_URL = 'https://dlib.net/files/mmod_human_face_detector.dat.bz2'
+# SHA-256 of the package at CNN_FACE_MODEL_URL, the model is not installed until it is pinned here
+CNN_FACE_MODEL_SHA256 = ''
 
 IS_WINDOWS = sys.platform == 'win32'
 if sys.platform == 'win32':
@@ -640,9 +648,220 @@ class Builder(object):
         extract(research_dir, 'mugshot_frontal_original_all_3.zip')
         print('Extracting validation data completed!')
 
+    def compile_haar_cascades(self):
+        """
+        Compiles the Haar cascade XML files into the binary format loaded by HaarCascade, which needs no text parsing.
+        The binary is a header followed by the arrays of features, nodes, leaves, trees and stages of the cascade,
+        all made of little-endian 32 bit fields laid out as the structures of HaarCascade
+        """
+        cascades_dir = os.path.join(self._root_dir, 'libppp/share/haarcascades')
+
+        def numbers(element):
+            return [float(value) for value in element.text.split()]
+
+        def read_feature(feature_element):
+            rects = []
+            for rect_element in feature_element.find('rects'):
+                rect = numbers(rect_element)
+                if len(rect) != 5 or len(rects) == 3:
+                    raise ValueError('Invalid Haar feature rectangles')
+                rects.append(rect)
+            rects += [[0, 0, 0, 0, 0.0]] * (3 - len(rects))
+            tilted_element = feature_element.find('tilted')
+            tilted = tilted_element is not None and int(tilted_element.text) != 0
+            return ([int(round(value)) for rect in rects for value in rect[:4]],
+                    [rect[4] for rect in rects], int(tilted))
+
+        def read_cascade(cascade):
+            window_size = (int(cascade.find('width').text), int(cascade.find('height').text))
+            features = [read_feature(element) for element in cascade.find('features')]
+            nodes, leaves, trees, stages = [], [], [], []
+            for stage_element in cascade.find('stages'):
+                first_tree = len(trees)
+                for classifier_element in stage_element.find('weakClassifiers'):
+                    internal_nodes = numbers(classifier_element.find('internalNodes'))
+                    trees.append((len(nodes), len(leaves)))
+                    for i in range(0, len(internal_nodes), 4):
+                        left, right, feature_index, threshold = internal_nodes[i:i + 4]
+                        nodes.append((int(feature_index), threshold, int(left), int(right)))
+                    leaves += numbers(classifier_element.find('leafValues'))
+                stages.append((first_tree, len(trees) - first_tree,
+                               float(stage_element.find('stageThreshold').text)))
+            return window_size, features, nodes, leaves, trees, stages
+
+        def read_old_cascade(cascade):
+            window_size = tuple(int(value) for value in cascade.find('size').text.split())
+            features, nodes, leaves, trees, stages = [], [], [], [], []
+            for stage_element in cascade.find('stages'):
+                first_tree = len(trees)
+                for tree_element in stage_element.find('trees'):
+                    trees.append((len(nodes), len(leaves)))
+                    first_leaf = len(leaves)
+                    for node_element in tree_element:
+                        # Features are stored within the nodes that use them
+                        children = []
+                        for node_name, value_name in (('left_node', 'left_val'), ('right_node', 'right_val')):
+                            value_element = node_element.find(value_name)
+                            if value_element is not None:
+                                children.append(first_leaf - len(leaves))
+                                leaves.append(float(value_element.text))
+                            else:
+                                children.append(int(node_element.find(node_name).text))
+                        nodes.append((len(features), float(node_element.find('threshold').text)) + tuple(children))
+                        features.append(read_feature(node_element.find('feature')))
+                stages.append((first_tree, len(trees) - first_tree,
+                               float(stage_element.find('stage_threshold').text)))
+            return window_size, features, nodes, leaves, trees, stages
+
+        for xml_file in sorted(glob.glob(os.path.join(cascades_dir, '*.xml'))):
+            bin_file = os.path.splitext(xml_file)[0] + '.bin'
+            if os.path.exists(bin_file) and os.path.getmtime(bin_file) >= os.path.getmtime(xml_file):
+                continue  # Already compiled
+            with open(xml_file, 'r') as fp:
+                # Comments are dropped, some of the old cascades have comments that are not valid XML
+                content = re.sub(r'<!--.*?-->', '', fp.read(), flags=re.DOTALL)
+            if not content.lstrip().startswith('<'):
+                print('Skipping "%s", it is not an XML file' % (os.path.basename(xml_file)))
+                continue
+            cascade = list(ElementTree.fromstring(content))[0]
+            if cascade.find('stageType') is not None:
+                if cascade.find('stageType').text.strip() != 'BOOST' \
+                        or cascade.find('featureType').text.strip() != 'HAAR':
+                    raise ValueError('Only boosted cascades of Haar features are supported: ' + xml_file)
+                window_size, features, nodes, leaves, trees, stages = read_cascade(cascade)
+            else:
+                window_size, features, nodes, leaves, trees, stages = read_old_cascade(cascade)
+
+            data = struct.pack('<4sI2i5I', b'PPHC', 1, window_size[0], window_size[1],
+                               len(features), len(nodes), len(leaves), len(trees), len(stages))
+            for rects, weights, tilted in features:
+                data += struct.pack('<12i3fi', *(rects + weights + [tilted]))
+            for node in nodes:
+                data += struct.pack('<ifii', *node)
+            data += struct.pack('<%df' % len(leaves), *leaves)
+            for tree in trees:
+                data += struct.pack('<2i', *tree)
+            for stage in stages:
+                data += struct.pack('<2if', *stage)
+            with open(bin_file, 'wb') as fp:
+                fp.write(data)
+            print('Compiled Haar cascade "%s" (%d bytes)' % (os.path.basename(bin_file), len(data)))
+
+    def download_cnn_face_model(self):
+        """
+        Downloads the dlib CNN (MMOD) face detection model into libppp/share when the CNN face detector is enabled.
+        The package is checked against CNN_FACE_MODEL_SHA256 before it is extracted
+        """
+        lippp_share_dir = os.path.join(self._root_dir, 'libppp/share')
+        with open(os.path.join(lippp_share_dir, 'config.json')) as fp:
+            cnn_face_detector_cfg = json.load(fp)['cnnFaceDetector']
+        if not cnn_face_detector_cfg['enabled']:
+            return  # Nothing to do, the model is neither used nor bundled
+        model_file = os.path.join(lippp_share_dir, cnn_face_detector_cfg['file'])
+        if os.path.exists(model_file):
+            return  # Nothing to do, the model was already downloaded
+        model_pkg = self.download_third_party_lib(CNN_FACE_MODEL_URL)
+        with open(model_pkg, 'rb') as fp:
+            model_pkg_sha256 = hashlib.sha256(fp.read()).hexdigest()
+        if model_pkg_sha256 != CNN_FACE_MODEL_SHA256:
+            raise ValueError('Unexpected SHA-256 %s of "%s", expected "%s"'
+                             % (model_pkg_sha256, model_pkg, CNN_FACE_MODEL_SHA256))
+        with bz2.BZ2File(model_pkg) as src, open(model_file, 'wb') as dst:
+            shutil.copyfileobj(src, dst)
+
+    def quantize_shape_predictor(self):
+        """
+        Converts the dlib shape predictor model into the quantized format loaded by ShapePredictor, about 4 times
+        smaller. The model is a header followed by the initial shape and the cascade levels, each level made of:
+        - the anchor points (uint16) and offsets (int16 scaled by a float of the level) of the feature pixels
+        - the feature pixels (uint16) and thresholds (int16) of the splits of all the trees, which must be complete
+          and of the same depth. Pixel differences are integers, so rounding the thresholds down changes no split
+        - the scale (float) and the leaf values (int8) of each tree
+        All the fields are little-endian
+        """
+        lippp_share_dir = os.path.join(self._root_dir, 'libppp/share')
+        model_file = os.path.join(lippp_share_dir, 'sp_model.dat')
+        quantized_file = os.path.join(lippp_share_dir, 'sp_model.q8.bin')
+        if not os.path.exists(model_file):
+            print('Skipping the quantization of the shape predictor, "%s" not found' % model_file)
+            return
+        if os.path.exists(quantized_file) and os.path.getmtime(quantized_file) >= os.path.getmtime(model_file):
+            return  # Already quantized
+
+        with open(model_file, 'rb') as fp:
+            data = fp.read()
+        position = [0]
+
+        def read_int():
+            # Same format as dlib::serialize of integers: a byte with the size and sign, then the bytes of the value
+            control = data[position[0]]
+            size = control & 0x0F
+            value = int.from_bytes(data[position[0] + 1:position[0] + 1 + size], 'little')
+            position[0] += 1 + size
+            return -value if control & 0x80 else value
+
+        def read_float():
+            # Same format as dlib::serialize of floating point numbers: mantissa and exponent (dlib::float_details)
+            if data[position[0]] & 0x70:
+                raise ValueError('Floating point numbers in the old text format of dlib are not supported')
+            mantissa = read_int()
+            exponent = read_int()
+            if exponent >= 32000:
+                raise ValueError('Infinite or NaN values in the shape predictor model')
+            return float(mantissa) * 2.0 ** exponent
+
+        def read_vector(read_item):
+            return [read_item() for _ in range(read_int())]
+
+        def read_column():
+            rows, columns = abs(read_int()), abs(read_int())
+            if columns != 1:
+                raise ValueError('Invalid column vector in the shape predictor model')
+            return [read_float() for _ in range(rows)]
+
+        def read_tree():
+            splits = read_vector(lambda: (read_int(), read_int(), read_float()))
+            leaf_values = read_vector(read_column)
+            return splits, leaf_values
+
+        if read_int() != 1:
+            raise ValueError('Unexpected version of the shape predictor model')
+        initial_shape = read_column()
+        forests = read_vector(lambda: read_vector(read_tree))
+        anchors = read_vector(lambda: read_vector(read_int))
+        deltas = read_vector(lambda: read_vector(lambda: (read_float(), read_float())))
+
+        num_splits = len(forests[0][0][0]) if forests and forests[0] else 0
+        output = struct.pack('<4s4I', b'PPSP', 1, len(initial_shape) // 2, len(forests), num_splits)
+        output += struct.pack('<%df' % len(initial_shape), *initial_shape)
+        for forest, level_anchors, level_deltas in zip(forests, anchors, deltas):
+            delta_scale = max([abs(value) for delta in level_deltas for value in delta] + [1e-6]) / 32767
+            output += struct.pack('<2If', len(forest), len(level_anchors), delta_scale)
+            output += struct.pack('<%dH' % len(level_anchors), *level_anchors)
+            output += struct.pack('<%dh' % (2 * len(level_deltas)),
+                                  *[int(round(value / delta_scale)) for delta in level_deltas for value in delta])
+            splits = [split for splits, _ in forest for split in splits]
+            if any(len(splits) != num_splits or len(leaf_values) != num_splits + 1 for splits, leaf_values in forest):
+                raise ValueError('Unsupported shape predictor model, all the trees must have the same depth')
+            output += struct.pack('<%dH' % len(splits), *[split[0] for split in splits])
+            output += struct.pack('<%dH' % len(splits), *[split[1] for split in splits])
+            output += struct.pack('<%dh' % len(splits),
+                                  *[min(max(int(math.floor(split[2])), -256), 255) for split in splits])
+            leaf_scales = [max([abs(value) for leaf in leaf_values for value in leaf] + [1e-6]) / 127
+                           for _, leaf_values in forest]
+            output += struct.pack('<%df' % len(forest), *leaf_scales)
+            for (_, leaf_values), leaf_scale in zip(forest, leaf_scales):
+                output += struct.pack('<%db' % (len(leaf_values) * len(initial_shape)),
+                                      *[int(round(value / leaf_scale)) for leaf in leaf_values for value in leaf])
+        with open(quantized_file, 'wb') as fp:
+            fp.write(output)
+        print('Quantized shape predictor "%s" (%d bytes, %d bytes before quantization)'
+              % (os.path.basename(quantized_file), len(output), len(data)))
+
     def bundle_config(self):
         """
-        Bundles all configuration files into a config.bundle.json encoding referred files as Base64
+        Bundles all configuration files into a config.bundle.json encoding referred files as Base64.
+        Files of disabled nodes are not bundled, nor the files of nodes replaced by their enabled quantized variant
         """
         lippp_share_dir = os.path.join(self._root_dir, 'libppp/share')
 
@@ -650,7 +869,8 @@ class Builder(object):
             if not isinstance(node, dict):
                 return
             for key in node:
-                if key == 'file' and not node.get('data', ''):
+                is_replaced = node.get('quantized', {}).get('enabled', False)
+                if key == 'file' and not node.get('data', '') and node.get('enabled', True) and not is_replaced:
                     file_name = node['file']
                     file_path = os.path.join(lippp_share_dir, file_name)
                     with open(file_path, 'rb') as fp:
@@ -800,6 +1020,9 @@ class Builder(object):
 
         # Extract testing dataset
         self.extract_validation_data()
+        self.compile_haar_cascades()
+        self.download_cnn_face_model()
+        self.quantize_shape_predictor()
         self.bundle_config()
 
         # Build Third Party Libs
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "IDetector.h"
+#include "ObjectPool.h"
+
+#include <dlib/image_processing/full_object_detection.h>
+
+FWD_DECL(CnnFaceDetector)
+
+/*!@brief Face detector based on the dlib CNN trained with the max-margin object detection loss (MMOD). The network is
+ * small enough to run on the CPU and, unlike the Haar and HOG detectors, it processes several images in a single
+ * batched inference. The four orientations of the image are searched at once in this way !*/
+class CnnFaceDetector : public IDetector
+{
+public:
+    CnnFaceDetector();
+
+    void configure(rapidjson::Value & config) override;
+
+    bool detectLandMarks(const cv::Mat & inputImage, LandMarks & landmarks) override;
+
+    std::vector<LandMarks> detectAllLandMarks(const cv::Mat & inputImage) override;
+
+    /*!@brief Detects the faces in several images with batched inferences, images of the same size are batched
+     *  together
+     *  @param[in] images Gray scale or BGR images
+     *  @returns The faces detected in each image
+     !*/
+    std::vector<std::vector<dlib::mmod_rect>> detect(const std::vector<cv::Mat> & images) const;
+
+private:
+    struct Network;
+
+    ///<- Networks are not thread safe, every concurrent inference uses its own instance
+    std::shared_ptr<ObjectPool<Network>> m_pNetworks;
+
+    int m_workingSize; ///<- Size of the longest side of the images searched in pixels
+    size_t m_batchSize;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <opencv2/core/core.hpp>
+
+FWD_DECL(EyeCenterKernel)
+
+/*!@brief Votes for the eye center with the means of gradients method (Timm and Barth). Every gradient votes for all
+ * the candidate centers c with the squared dot product of the gradient and the unit displacement from c to the
+ * gradient position. Unit displacements only depend on the offset between both positions, so they are precomputed
+ * in tables indexed by offset and the votes of a gradient to a row of centers are accumulated with float SIMD
+ * instructions, without any square root or division.
+ * The kernel is immutable once created, so it can be used from several threads at once !*/
+class EyeCenterKernel : noncopyable
+{
+public:
+    /*!@brief Creates the displacement tables
+     *  @param[in] maxSize Size of the largest gradient images the kernel can process
+     !*/
+    explicit EyeCenterKernel(const cv::Size & maxSize);
+
+    /*!@brief Gets the size of the largest gradient images the kernel can process !*/
+    cv::Size maxSize() const;
+
+    /*!@brief Accumulates the votes of all the gradients for every candidate center
+     *  @param[in] gradientX Normalized horizontal gradient (CV_64F), zero where the gradient is below the threshold
+     *  @param[in] gradientY Normalized vertical gradient (CV_64F), zero where the gradient is below the threshold
+     *  @param[in] weight Weight of each gradient (CV_8U) divided by weightDivisor, all gradients weigh one if empty
+     *  @param[in] weightDivisor Divisor of the weights
+     *  @param[out] outSum Sum of the votes for each center (CV_32F)
+     !*/
+    void accumulate(const cv::Mat & gradientX,
+                    const cv::Mat & gradientY,
+                    const cv::Mat & weight,
+                    float weightDivisor,
+                    cv::Mat & outSum) const;
+
+    /*!@brief Accumulates the votes of all the gradients as above, only for the centers within a window
+     *  @param[in] centers Window of the candidate centers in the gradient images
+     *  @param[out] outSum Sum of the votes for each center of the window (CV_32F)
+     !*/
+    void accumulate(const cv::Mat & gradientX,
+                    const cv::Mat & gradientY,
+                    const cv::Mat & weight,
+                    float weightDivisor,
+                    const cv::Rect & centers,
+                    cv::Mat & outSum) const;
+
+private:
+    cv::Size m_maxSize;
+
+    ///<- Unit displacements (CV_32F), the one for the offset (dx, dy) is at (dx + maxWidth - 1, dy + maxHeight - 1)
+    cv::Mat m_displacementX;
+    cv::Mat m_displacementY;
+};
@@ -6,26 +6,46 @@
 #include <type_traits>
 
 FWD_DECL(EyeDetector)
+FWD_DECL(EyeCenterKernel)
+FWD_DECL(HaarCascade)
+FWD_DECL(HaarFeatureCache)
+FWD_DECL(HaarFeatures)
+FWD_DECL(ThreadPool)
 
 class EyeDetector : public IDetector
 {
 public:
+    /*!@brief Creates the detector
+     *  @param[in] pHaarFeatureCache Haar features shared with other detectors, a new cache is created if not provided
+     *  @param[in] pThreadPool Pool where the left and right eyes are searched concurrently, the eyes are searched
+     *  sequentially if not provided
+     !*/
+    explicit EyeDetector(HaarFeatureCacheSPtr pHaarFeatureCache = nullptr, ThreadPoolSPtr pThreadPool = nullptr);
 
     void configure(rapidjson::Value &cfg) override;
 
     bool detectLandMarks(const cv::Mat& inputImage, LandMarks &landmarks) override;
 
+    /*!@brief Detects the eyes with the given features of the gray image, taken from the cache if null !*/
+    bool detectLandMarksWithFeatures(const cv::Mat& inputImage,
+                                     const HaarFeaturesSPtr& pFeatures,
+                                     LandMarks &landmarks) override;
+
 private:
     cv::Mat m_leftCornerKernel;
     cv::Mat m_rightCornerKernel;
     cv::Mat m_xGradKernel;
     cv::Mat m_yGradKernel;
+    EyeCenterKernelSPtr m_pEyeCenterKernel;
 
 private:  // Configuration
 
     bool m_useHaarCascades = false;
-    cv::CascadeClassifierSPtr m_leftEyeCascadeClassifier;
-    cv::CascadeClassifierSPtr m_rightEyeCascadeClassifier;
+    HaarCascadeSPtr m_leftEyeCascadeClassifier;
+    HaarCascadeSPtr m_rightEyeCascadeClassifier;
+    HaarFeatureCacheSPtr m_pHaarFeatureCache;
+    ThreadPoolSPtr m_pThreadPool;
+    bool m_parallelEyeSearch = true; ///<- Search the left and right eyes as concurrent stages
 
     // Definition of the search areas to locate pupils expressed as the ratios of the face rectangle
     const double m_topFaceRatio = 0.28;  ///<- Distance from the top of the face 
@@ -48,18 +68,50 @@ private:  // Configuration
     const bool m_enablePostProcess = true;
     const float m_postProcessThreshold = 0.97f;
 
+    // Coarse to fine search
+    bool m_coarseToFine = false; ///<- Locate the pupil in a smaller region first, then refine it around the candidate
+    int m_coarseEyeWidth = 20;   ///<- Width of the smaller region
+    int m_refineRadius = 3;      ///<- Radius of the window evaluated at the fast size around the candidate
+
 private:
     static void validateAndApplyFallbackIfRequired(const cv::Size &eyeRoiSize, cv::Point &eyeCenter);
 
-    static cv::Rect detectWithHaarCascadeClassifier(const cv::Mat &img, cv::CascadeClassifier *cc);
+    /*!@brief Detects the eye in a region of the image
+     *  @returns The eye rectangle relative to the region or an empty rectangle if no eye or several ones were found
+     !*/
+    static cv::Rect detectWithHaarCascadeClassifier(const HaarFeatures & features,
+                                                    const cv::Rect & roi,
+                                                    const HaarCascade & cascade);
+
+    /*!@brief Locates the pupil of one eye
+     *  @param[in] faceImage Region of the face in the gray image
+     *  @param[in] faceRect Rectangle of the face in the image
+     *  @param[in] eyeRegion Region of the face where the eye is searched
+     *  @param[in] pFeatures Features of the gray image, only used with the Haar cascades
+     *  @param[in] pCascade Cascade of the eye, the whole eye region is searched for the pupil if null
+     *  @param[out] eyeRect Eye found by the cascade, empty if none
+     *  @returns The pupil in image coordinates
+     !*/
+    cv::Point locateEye(const cv::Mat & faceImage,
+                        const cv::Rect & faceRect,
+                        cv::Rect eyeRegion,
+                        const HaarFeatures * pFeatures,
+                        const HaarCascade * pCascade,
+                        cv::Rect & eyeRect) const;
 
     cv::Point findEyeCenter(const cv::Mat& image) const;
 
-    void createCornerKernels();
+    /*!@brief Locates the eye center in a region scaled to the fast size
+     *  @param[in] eyeRoi Eye region
+     *  @param[in] centers Window of the region where the center is searched
+     *  @param[in] postProcess Whether to discard the maxima connected to the window border
+     !*/
+    cv::Point locateEyeCenter(const cv::Mat& eyeRoi, const cv::Rect& centers, bool postProcess) const;
 
-    void testPossibleCentersFormula(int x, int y, unsigned char weight, double gx, double gy, cv::Mat& out) const;
+    void createCornerKernels();
 
-    cv::Mat floodKillEdges(cv::Mat& mat) const;
+    /*!@brief Gets the mask of the pixels that are not connected to the image border through non zero pixels !*/
+    cv::Mat floodKillEdges(const cv::Mat& mat) const;
 
     cv::Mat matrixMagnitude(const cv::Mat& matX, const cv::Mat& matY) const;
 
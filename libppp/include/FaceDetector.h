@@ -1,31 +1,130 @@
 #pragma once
 
 #include "IDetector.h"
+#include "ObjectPool.h"
+#include <functional>
 #include <memory>
 
 #include <dlib/image_processing/frontal_face_detector.h>
 
 struct LandMarks;
 
+FWD_DECL(CnnFaceDetector)
 FWD_DECL(FaceDetector)
+FWD_DECL(HaarCascade)
+FWD_DECL(HaarFeatureCache)
+FWD_DECL(HogPyramidDetector)
+FWD_DECL(ThreadPool)
 
 class FaceDetector : public IDetector
 {
 public:
+    /*!@brief Creates the detector
+     *  @param[in] pThreadPool Pool where the image orientations are searched, a new one is created if not provided
+     *  @param[in] pHaarFeatureCache Haar features shared with other detectors, a new cache is created if not provided
+     !*/
+    explicit FaceDetector(ThreadPoolSPtr pThreadPool = nullptr, HaarFeatureCacheSPtr pHaarFeatureCache = nullptr);
+
     void configure(rapidjson::Value & config) override;
 
     bool detectLandMarks(const cv::Mat & inputImage, LandMarks & landmarks) override;
 
+    /*!@brief Detects all the faces found in the orientation of the image with highest priority where there is one.
+     *  Smaller faces than in the single face search are accepted, as in group photos !*/
+    std::vector<LandMarks> detectAllLandMarks(const cv::Mat & inputImage) override;
+
+    /*!@brief Builds a detector evaluating only a subset of the HOG filters of the given one.
+     *  The dlib frontal face detector has 5 filters: front looking, left looking, right looking, front looking
+     *  rotated left and front looking rotated right. Photos for official documents are frontal, so the first filter
+     *  alone finds them at a fifth of the convolution cost
+     *  @param[in] filterIndices Indices of the filters to keep
+     !*/
+    static dlib::frontal_face_detector selectHogFilters(const dlib::frontal_face_detector & detector,
+                                                        const std::vector<unsigned long> & filterIndices);
+
 private:
-    cv::CascadeClassifierSPtr m_pFaceCascadeClassifier;
+    struct Face
+    {
+        cv::Rect rect;
+        double confidence; ///<- Detector specific, see LandMarks::faceConfidence
+    };
+
+    ///<- Searches the faces within the given minimum and maximum sizes in an image returning them biggest first. The
+    ///<- search can stop early once the cancellation function (if any) returns true, its result is then ignored
+    typedef std::function<bool(const cv::Mat &,
+                               const cv::Size &,
+                               const cv::Size &,
+                               std::vector<Face> &,
+                               const std::function<bool()> & isCancelled)>
+        FaceSearch;
+
+    ///<- Only the detector holds the pool, the tasks it submits never own it so none of them can destroy it
+    ThreadPoolSPtr m_pThreadPool;
+    HaarFeatureCacheSPtr m_pHaarFeatureCache;
+
+    ///<- Whether the image orientations are searched concurrently or one after another
+    bool m_parallelRotationSearch;
+
+    HaarCascadeSPtr m_pFaceCascade;
+
+    // Detectors are not thread safe, every concurrent search uses its own instance
+    std::shared_ptr<ObjectPool<dlib::frontal_face_detector>> m_pFrontalFaceDetectors;
+
+    ///<- Scans the HOG pyramid levels in parallel, only used if enabled in the configuration
+    HogPyramidDetectorSPtr m_pHogPyramidDetector;
 
     bool m_useDlibFaceDetection;
 
+    ///<- Searches all the image orientations at once, used instead of the other detectors if enabled
+    CnnFaceDetectorSPtr m_pCnnFaceDetector;
+
+    // Tiered detection: faces are searched with the Haar cascade first and only searched again with the HOG detector
+    // when the Haar cascade misses them or finds them with a confidence below the threshold
+    bool m_escalateToHog;
+    double m_minHaarFaceConfidence; ///<- Minimum number of windows grouped into a Haar face to accept it
+
+    double m_multiFaceMinFaceRatio; ///<- Minimum size of the faces when all are searched (ratio of the image size)
+
+    FaceSearch haarFaceSearch() const;
+
+    FaceSearch hogFaceSearch() const;
+
+    static void sortBiggestFirst(std::vector<Face> & faces);
+
+    /*!@brief Searches the faces with the configured detectors, only the biggest one unless all faces are requested
+     *  @param[out] imageRotation Rotation of the image where the faces were found
+     *  @param[out] faces Faces found in the rotated image, biggest first
+     !*/
+    bool findFaces(const cv::Mat & grayImage, bool allFaces, int & imageRotation, std::vector<Face> & faces) const;
+
+    /*!@brief Searches the faces in all orientations, coarse to fine if enabled !*/
+    bool searchFaces(const cv::Mat & grayImage,
+                     const FaceSearch & faceSearch,
+                     bool allFaces,
+                     int & imageRotation,
+                     std::vector<Face> & faces) const;
+
+    // Coarse to fine search: the face is searched on a downscaled copy of the image and refined around its location
+    bool m_useCoarseSearch;
+    int m_coarseSearchWorkingSize;     ///<- Size of the longest side of the downscaled image in pixels
+    double m_coarseSearchRefineMargin; ///<- Margin around the coarse face rectangle for the refinement (ratio)
+
     void calculateScaleSearch(const cv::Size & inputImageSize,
                               double minFaceRatio,
                               double maxFaceRatio,
                               cv::Size & minFaceSize,
                               cv::Size & maxFaceSize) const;
 
-    std::shared_ptr<dlib::frontal_face_detector> m_frontalFaceDetector;
+    /*!@brief Searches the faces in the image rotated by 0, 90, -90 and 180 degrees, in this order of priority.
+     *  When searching in parallel a hit cancels the orientations of lower priority, the ones that already started stop
+     *  scanning if their search supports it !*/
+    bool rotationSearch(const cv::Mat & grayImage,
+                        const FaceSearch & faceSearch,
+                        bool allFaces,
+                        int & imageRotation,
+                        std::vector<Face> & faces) const;
+
+    /*!@brief Maps the face found in the downscaled image back to the rotated input image and searches it again at
+     *  full resolution within a region around it. The coarse rectangle is kept if the refinement fails !*/
+    void refineFace(const cv::Mat & rotatedGrayImage, double scale, const FaceSearch & faceSearch, Face & face) const;
 };
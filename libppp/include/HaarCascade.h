@@ -0,0 +1,124 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <opencv2/core/core.hpp>
+
+FWD_DECL(HaarCascade)
+FWD_DECL(HaarFeatures)
+
+/*!@brief Boosted cascade of Haar features (Viola-Jones) evaluated on precomputed HaarFeatures, so several cascades
+ * searching the same image share its pyramid and integral images. Both the current OpenCV cascade format
+ * (e.g. haarcascade_frontalface_alt2.xml) and the old one (e.g. ojoI.xml) are supported. The features are evaluated
+ * like OpenCV does, but the pyramid levels are resampled differently, so the detections are close to the ones of
+ * cv::CascadeClassifier::detectMultiScale (within a few pixels) rather than identical. Cascades can also
+ * be loaded from the binary format compiled by build.py, which is much faster than parsing the XML.
+ * The cascade is immutable once loaded, so it can be used from several threads at once !*/
+class HaarCascade : noncopyable
+{
+public:
+    /*!@brief Loads the cascade from the top level node of an OpenCV cascade file !*/
+    explicit HaarCascade(const cv::FileNode & cascadeNode);
+
+    /*!@brief Loads the cascade from its binary format. The binary holds the arrays of the cascade as they are laid out
+     * in memory, so they are copied without any parsing, e.g. straight from a memory mapped file
+     *  @param[in] data Binary cascade, no alignment is required
+     *  @param[in] size Size of the binary cascade in bytes
+     !*/
+    HaarCascade(const void * data, size_t size);
+
+    /*!@brief Checks whether a buffer holds a cascade in binary format !*/
+    static bool isBinary(const void * data, size_t size);
+
+    /*!@brief Gets the size of the detection window, i.e. the smallest object that can be detected !*/
+    cv::Size windowSize() const;
+
+    /*!@brief Detects the objects in a region of the image
+     *  @param[in] features Features of the image
+     *  @param[in] roi Region of the image to search
+     *  @param[in] minNeighbors Minimum number of overlapping detections needed to keep an object
+     *  @param[in] minSize Minimum size of the objects
+     *  @param[in] maxSize Maximum size of the objects, unlimited if empty
+     *  @returns The objects found in image coordinates
+     !*/
+    std::vector<cv::Rect> detect(const HaarFeatures & features,
+                                 const cv::Rect & roi,
+                                 int minNeighbors,
+                                 const cv::Size & minSize = cv::Size(),
+                                 const cv::Size & maxSize = cv::Size()) const;
+
+    /*!@brief Detects the objects in a region of the image as above, also returning the confidence of each object
+     *  @param[out] numNeighbors Number of windows grouped into each object, the more the more confident the detection
+     !*/
+    std::vector<cv::Rect> detect(const HaarFeatures & features,
+                                 const cv::Rect & roi,
+                                 int minNeighbors,
+                                 std::vector<int> & numNeighbors,
+                                 const cv::Size & minSize = cv::Size(),
+                                 const cv::Size & maxSize = cv::Size()) const;
+
+private:
+    struct Feature
+    {
+        cv::Rect rects[3];
+        float weights[3]; ///<- Zero for the rectangles not used
+        int tilted;
+    };
+
+    ///<- Decision tree node, a child index lower or equal to zero refers to the leaf with the opposite index
+    struct Node
+    {
+        int featureIndex;
+        float threshold;
+        int left;
+        int right;
+    };
+
+    struct Tree
+    {
+        int firstNode;
+        int firstLeaf;
+    };
+
+    struct Stage
+    {
+        int firstTree;
+        int numTrees;
+        float threshold;
+    };
+
+    ///<- Feature rectangle corners as offsets in the integral images of a tile
+    struct FeatureOffsets
+    {
+        int corners[3][4];
+        float weights[3];
+        bool tilted;
+    };
+
+    cv::Size m_windowSize;
+    std::vector<Feature> m_features;
+    std::vector<Node> m_nodes;
+    std::vector<float> m_leaves;
+    std::vector<Tree> m_trees;
+    std::vector<Stage> m_stages;
+
+    void readCascade(const cv::FileNode & cascadeNode);
+
+    void readOldCascade(const cv::FileNode & cascadeNode);
+
+    static Feature readFeature(const cv::FileNode & featureNode);
+
+    /*!@brief Checks that all the indices of the cascade are within its arrays !*/
+    void validate() const;
+
+    std::vector<FeatureOffsets> featureOffsets(int integralStep) const;
+
+    /*!@brief Runs the cascade on the window at the given position of the tile integral images
+     *  @returns true if all the stages accepted the window, false otherwise
+     !*/
+    bool evaluate(const std::vector<FeatureOffsets> & offsets,
+                  const int * pSum,
+                  const double * pSqSum,
+                  const int * pTiltedSum,
+                  int integralStep) const;
+};
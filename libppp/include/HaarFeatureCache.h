@@ -0,0 +1,49 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <list>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+FWD_DECL(HaarFeatureCache)
+FWD_DECL(HaarFeatures)
+
+/*!@brief Keeps the Haar features of the images processed recently, so all the cascades running on an image (face,
+ * eyes and mouth) share them. Images are identified by their pixel buffer: the features of a region of an image
+ * are those of the whole image, and a BGR image shares its features with the gray image they are computed from.
+ * Cached entries keep a reference to the images, so a buffer can't be reused by another image while cached !*/
+class HaarFeatureCache : noncopyable
+{
+public:
+    /*!@brief Creates the cache
+     *  @param[in] capacity Maximum number of images whose features are kept
+     *  @param[in] scaleFactor Scale between consecutive pyramid levels of the features
+     !*/
+    explicit HaarFeatureCache(size_t capacity = 2, double scaleFactor = 1.05);
+
+    /*!@brief Gets the features of an image, creating them if they are not cached
+     *  @param[in] image Gray scale or BGR image, or a region of one
+     *  @param[in] cacheNewFeatures Whether new features are added to the cache, temporary images (e.g. rotated
+     *  copies) are not worth evicting the features of other images
+     !*/
+    HaarFeaturesSPtr features(const cv::Mat & image, bool cacheNewFeatures = true);
+
+    /*!@brief Gets the number of images whose features are cached !*/
+    size_t size() const;
+
+private:
+    struct Entry
+    {
+        std::vector<cv::Mat> images; ///<- Whole images sharing the features (the input image and its gray version)
+        HaarFeaturesSPtr pFeatures;
+    };
+
+    ///<- Most recently used entries first
+    std::list<Entry> m_entries;
+
+    const size_t m_capacity;
+    const double m_scaleFactor;
+
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <atomic>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+FWD_DECL(HaarFeatures)
+
+/*!@brief Integral images of a gray image at the scales of a detection pyramid, shared by all the Haar cascades that
+ * run on the image. Pyramid level k is the image downscaled by scaleFactor^k. Levels are split into square tiles
+ * whose integral, squared integral and tilted integral images are computed the first time a cascade scans them, so
+ * cascades searching small regions (e.g. the eyes) only pay for the tiles they touch and overlapping searches compute
+ * every tile once. Each tile covers the windows whose origin lies in it, so it extends maxWindowSize pixels further
+ * right and down !*/
+class HaarFeatures : noncopyable
+{
+public:
+    struct Tile
+    {
+        cv::Point origin;  ///<- Position of the tile in the level
+        cv::Mat sum;       ///<- Integral image (CV_32S)
+        cv::Mat sqSum;     ///<- Squared integral image (CV_64F)
+        cv::Mat tiltedSum; ///<- Integral image rotated 45 degrees (CV_32S)
+    };
+
+    /*!@brief Creates the features of an image, no level is computed until needed
+     *  @param[in] image Gray scale or BGR image
+     *  @param[in] scaleFactor Scale between consecutive pyramid levels
+     *  @param[in] tileSize Size of the tiles the levels are split into
+     *  @param[in] maxWindowSize Largest size of the detection windows of the cascades using the features
+     !*/
+    explicit HaarFeatures(const cv::Mat & image, double scaleFactor = 1.05, int tileSize = 128, int maxWindowSize = 32);
+
+    /*!@brief Gets the gray scale image the features are computed from !*/
+    const cv::Mat & grayImage() const;
+
+    size_t numLevels() const;
+
+    /*!@brief Gets how many times smaller than the image a level is !*/
+    double levelScale(size_t level) const;
+
+    cv::Size levelSize(size_t level) const;
+
+    int tileSize() const;
+
+    int maxWindowSize() const;
+
+    /*!@brief Gets the number of elements in a row of the tile integral images, the same for all tiles !*/
+    int integralStep() const;
+
+    /*!@brief Gets the tile of the level containing a point, computing its integral images on first use
+     *  @param[in] level Index of the pyramid level
+     *  @param[in] levelPoint Point in the level coordinates
+     !*/
+    const Tile & tile(size_t level, const cv::Point & levelPoint) const;
+
+    /*!@brief Gets the number of tiles computed so far in all the levels !*/
+    size_t numComputedTiles() const;
+
+private:
+    struct LazyTile : Tile
+    {
+        std::once_flag computed;
+    };
+
+    struct Level
+    {
+        double scale;
+        cv::Size size;
+        cv::Size numTiles;
+
+        std::once_flag allocated;
+        std::unique_ptr<LazyTile[]> tiles;
+    };
+
+    cv::Mat m_grayImage;
+
+    const int m_tileSize;
+    const int m_maxWindowSize;
+
+    std::vector<std::unique_ptr<Level>> m_levels;
+
+    mutable std::atomic<size_t> m_numComputedTiles;
+
+    void computeTile(const Level & level, LazyTile & tile) const;
+};
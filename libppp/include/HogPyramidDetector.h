@@ -0,0 +1,59 @@
+#pragma once
+
+#include "CommonHelpers.h"
+#include "ObjectPool.h"
+
+#include <functional>
+
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <opencv2/core/core.hpp>
+
+FWD_DECL(HogPyramidDetector)
+FWD_DECL(ThreadPool)
+
+/*!@brief Runs a dlib HOG detector scanning the image pyramid levels (and tiles of the large levels) in parallel.
+ * Every level is scanned on its own by a copy of the detector restricted to a single pyramid level, the detections
+ * are then mapped back to the input image and merged with the usual non-max suppression. Only the levels where
+ * objects of the expected sizes can be found are scanned !*/
+class HogPyramidDetector : noncopyable
+{
+public:
+    typedef dlib::frontal_face_detector DetectorType;
+
+    /*!@brief Creates the detector
+     *  @param[in] detector Detector scanning all the pyramid levels, copied
+     *  @param[in] threadPool Pool where the levels are scanned, not owned. It must outlive the detector and the
+     *  searches running in it
+     !*/
+    HogPyramidDetector(const DetectorType & detector, ThreadPool & threadPool);
+
+    /*!@brief Sets the size of the square tiles large levels are split into, zero or negative to disable tiling !*/
+    void setTileSize(int tileSize);
+
+    /*!@brief Detects the objects in the image
+     *  @param[in] grayImage Input image
+     *  @param[in] minObjectSize Expected minimum size of the objects in pixels, levels with smaller objects are skipped
+     *  @param[in] maxObjectSize Expected maximum size of the objects in pixels, levels with larger objects are skipped
+     *  @param[in] isCancelled Checked before scanning each level and tile, once it returns true the remaining ones are
+     *  skipped and their detections are missing from the result
+     *  @returns The detections sorted by decreasing confidence
+     !*/
+    std::vector<dlib::rect_detection> detect(const cv::Mat & grayImage,
+                                             double minObjectSize,
+                                             double maxObjectSize,
+                                             const std::function<bool()> & isCancelled = nullptr) const;
+
+    /*!@brief Computes the range of pyramid levels where objects of the given sizes are found !*/
+    void pyramidLevelRange(double minObjectSize, double maxObjectSize, size_t & minLevel, size_t & maxLevel) const;
+
+private:
+    DetectorType m_detector;
+
+    ///<- Not owned, so that a search still running in one of its workers never destroys the pool
+    ThreadPool & m_threadPool;
+
+    ///<- Copies of the detector scanning a single pyramid level, not thread safe so each task uses its own
+    std::shared_ptr<ObjectPool<DetectorType>> m_pLevelDetectors;
+
+    int m_tileSize;
+};
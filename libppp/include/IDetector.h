@@ -3,15 +3,12 @@
 #include <opencv2/core/core.hpp>
 #include <rapidjson/document.h>
 #include "CommonHelpers.h"
+#include "LandMarks.h"
 
-namespace cv
-{
-    FWD_DECL(CascadeClassifier)
-}
-
-struct LandMarks;
+#include <vector>
 
 FWD_DECL(IDetector)
+FWD_DECL(HaarFeatures)
 
 class IDetector : noncopyable
 {
@@ -23,5 +20,28 @@ public:
     *  @returns true if the intended landmarks were detected and can be used as input for subsequent detection, false otherwise !*/
     virtual bool detectLandMarks(const cv::Mat& inputImage, LandMarks &landmarks) = 0;
 
+    /*!@brief Detects the landmarks as detectLandMarks, with the Haar features of the input image given instead of
+    *  taken from the cache, e.g. for temporary images whose features are not cached. Detectors that don't use Haar
+    *  features ignore them !*/
+    virtual bool detectLandMarksWithFeatures(const cv::Mat& inputImage,
+                                             const HaarFeaturesSPtr& pFeatures,
+                                             LandMarks &landmarks)
+    {
+        return detectLandMarks(inputImage, landmarks);
+    }
+
+    /*!@brief Detects the landmarks of all the faces in the image, for the detectors that can find several.
+    *  The others find a single one
+    *  @returns The landmarks of each face, the most prominent one first !*/
+    virtual std::vector<LandMarks> detectAllLandMarks(const cv::Mat& inputImage)
+    {
+        LandMarks landmarks;
+        if (!detectLandMarks(inputImage, landmarks))
+        {
+            return {};
+        }
+        return { landmarks };
+    }
+
     virtual ~IDetector() = default;
 };
\ No newline at end of file
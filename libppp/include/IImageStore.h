@@ -5,6 +5,7 @@
 #include "CommonHelpers.h"
 
 FWD_DECL(IImageStore)
+FWD_DECL(ImagePyramid)
 
 /*!@brief Caches input images that are going to be processed.
  * Only a certain amount of images are kept at any point in time. */
@@ -17,6 +18,9 @@ public:
     /*!@brief Gets a copy the image from the store !*/
     virtual cv::Mat getImage(const std::string &imageKey) = 0;
 
+    /*!@brief Gets the mipmap pyramid of the image, its levels are built on demand and kept with the image !*/
+    virtual ImagePyramidSPtr getImagePyramid(const std::string &imageKey) = 0;
+
     /*!@brief Returns wheter an image with the specified key is in the store !*/
     virtual bool containsImage(const std::string &imageKey) = 0;
 
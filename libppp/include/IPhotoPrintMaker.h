@@ -22,6 +22,12 @@ public:
                                 const PhotoStandard & ps)
         = 0;
 
+    /*!@brief Computes the region of the original image that cropPicture extracts, without touching any pixel !*/
+    virtual cv::RotatedRect cropGeometry(const cv::Point & crownPoint,
+                                         const cv::Point & chinPoint,
+                                         const PhotoStandard & ps) const
+        = 0;
+
     virtual cv::Mat tileCroppedPhoto(const CanvasDefinition & canvas,
                                      const PhotoStandard & ps,
                                      const cv::Mat & croppedImage)
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+FWD_DECL(ImagePyramid)
+
+/*!@brief Mipmap pyramid of an image that is built lazily, one level at a time as they are requested.
+ * Level 0 is the image itself and each level is half the size of the previous one (Gaussian pyramid), so
+ * a point (x, y) in the full resolution image is located at (x, y) / 2^k in level k !*/
+class ImagePyramid : noncopyable
+{
+public:
+    explicit ImagePyramid(const cv::Mat & image);
+
+    /*!@brief Gets the image at the specified level, building any missing level up to it !*/
+    cv::Mat level(size_t index);
+
+    /*!@brief Gets the smallest level whose scale is still at or above the requested scale
+     *  @param[in] scale Scale needed relative to the full resolution image (e.g. 0.1 for ten times smaller)
+     *  @param[out] levelScale Scale of the returned level relative to the full resolution image
+     *  @returns The image of the selected level
+     !*/
+    cv::Mat levelForScale(double scale, double & levelScale);
+
+private:
+    std::vector<cv::Mat> m_levels;
+
+    ///<- Levels are not reduced further once the shortest side is below this size
+    const int m_minLevelSize = 32;
+
+    std::mutex m_mutex;
+
+    ///<- Builds the levels up to the one requested (if possible) and returns the index of the last level available
+    size_t buildLevels(size_t index);
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IImageStore.h"
+#include "ImagePyramid.h"
 
 #include <unordered_map>
 #include <list>
@@ -8,7 +9,7 @@
 
 #include <utility>
 
-typedef std::pair<cv::Mat, std::list<std::string>::iterator> ImageOrderPair;
+typedef std::pair<ImagePyramidSPtr, std::list<std::string>::iterator> ImageOrderPair;
 
 FWD_DECL(ImageStore)
 
@@ -23,9 +24,11 @@ public:
 
     cv::Mat getImage(const std::string &imageKey) override;
 
+    ImagePyramidSPtr getImagePyramid(const std::string &imageKey) override;
+
     void setStoreSize(size_t storeSize) override;
 private:
-    ///<- Stores the images currently being processing
+    ///<- Stores the images currently being processing (as level 0 of their pyramid)
     std::unordered_map<std::string, ImageOrderPair> m_imageCollection;
 
     ///<- Store the image keys in the order they were added to the store
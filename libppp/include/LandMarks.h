@@ -2,6 +2,7 @@
 
 #include <sstream>
 #include <opencv2/core/core.hpp>
+#include <rapidjson/document.h>
 
 //template <class T>
 inline std::ostream & operator<<(std::ostream &stream, const cv::Point &p)
@@ -23,7 +24,7 @@ struct LandMarks
     cv::Rect  vjLeftEyeRect;  ///<- Rectangle where the left eye was detected using Viola Jones algorithm
     cv::Rect  vjRightEyeRect; ///<- Rectangle where the left eye was detected using Viola Jones algorithm
 
-    int imageRotation;  ///<- Possible values are 0, 90, -90, 180
+    int imageRotation = 0;  ///<- Possible values are 0, 90, -90, 180
 
     // Mouth marks
     cv::Point lipUpperCenter;
@@ -33,14 +34,34 @@ struct LandMarks
     cv::Rect vjMouthRect;
 
     cv::Rect  vjFaceRect;
+    double faceConfidence = 0; ///<- Windows grouped into the face for Haar cascades, detection score for HOG
     cv::Point crownPoint;
     cv::Point chinPoint;
     std::vector<cv::Point> lipContour1st;
     std::vector<cv::Point> lipContour2nd;
 
     std::vector<cv::Point> allLandmarks;
+    int shapePredictorLevels = 0; ///<- Cascade levels the shape predictor ran to find the landmarks, 0 if not used
+
+    /*!@brief Returns a copy of the landmarks with all coordinates scaled by the given horizontal and vertical
+     *  factors !*/
+    LandMarks scaled(double sx, double sy) const;
+
+    /*!@brief Returns a copy of the landmarks with all coordinates mapped to the image rotated by the given angle
+     *  @param[in] rotAngleDegrees Rotation angle, a multiple of 90 degrees (see Utilities::rotateImage)
+     *  @param[in] imageSize Size of the image the landmarks currently refer to
+     !*/
+    LandMarks rotated(int rotAngleDegrees, const cv::Size & imageSize) const;
+
+    /*!@brief Scores how well the eye pupils and lip corners fit the proportions of an upright frontal face within
+     *  the face rectangle, from 0 (implausible) to 1 (plausible) !*/
+    double geometryPlausibility() const;
 
     std::string toString() const;
 
     std::string toJson() const;
+
+    /*!@brief Reads the landmarks from Json in the format written by toJson. Missing members are left unset and
+     *  fractional coordinates are rounded. Throws std::runtime_error if a given landmark is not valid !*/
+    static LandMarks fromJson(rapidjson::Value & v);
 };
\ No newline at end of file
@@ -3,19 +3,59 @@
 #include <memory>
 #include "IDetector.h"
 
+FWD_DECL(HaarCascade)
+FWD_DECL(HaarFeatureCache)
+FWD_DECL(HaarFeatures)
+FWD_DECL(ThreadPool)
+
 class LipsDetector : public IDetector
 {
 public:
+    /*!@brief Creates the detector
+     *  @param[in] pHaarFeatureCache Haar features shared with other detectors, a new cache is created if not provided
+     *  @param[in] pThreadPool Pool where the mouth cascade and the lips segmentation run concurrently, they run
+     *  sequentially if not provided
+     !*/
+    explicit LipsDetector(HaarFeatureCacheSPtr pHaarFeatureCache = nullptr, ThreadPoolSPtr pThreadPool = nullptr);
 
     void configure(rapidjson::Value &config) override;
 
     bool detectLandMarks(const cv::Mat& inputImage, LandMarks &landmarks) override;
 
+    /*!@brief Detects the mouth with the given features of the color image, taken from the cache if null !*/
+    bool detectLandMarksWithFeatures(const cv::Mat& inputImage,
+                                     const HaarFeaturesSPtr& pFeatures,
+                                     LandMarks &landmarks) override;
+
+    /*!@brief Computes the likelihood of each pixel to be part of the lips from its chromaticity, (R / (R + G))^4
+     * scaled to 255. It only depends on the red and green components, so it is looked up in a table
+     *  @param[in] bgrImage Color image (CV_8UC3)
+     *  @returns The likelihood image (CV_8UC1)
+     !*/
+    static cv::Mat lipsLikelihood(const cv::Mat & bgrImage);
+
 private:
 
     bool getBeardMask(cv::Mat &mouthAreaImage) const;
 
-    cv::CascadeClassifierSPtr m_pMouthCascadeClassifier;
+    /*!@brief Finds the lip corners from the colors of the mouth region
+     *  @param[in] mouthRoiImage Color image of the mouth region
+     *  @param[in] mouthRoiRect Rectangle of the mouth region in the image
+     *  @param[in] eyeCentrePoint Middle of the pupils
+     *  @param[in] mouthCenterPoint Estimated center of the mouth
+     *  @returns false if no lips were found in the region
+     !*/
+    bool segmentLips(const cv::Mat & mouthRoiImage,
+                     const cv::Rect & mouthRoiRect,
+                     const cv::Point2d & eyeCentrePoint,
+                     const cv::Point2d & mouthCenterPoint,
+                     LandMarks & landmarks) const;
+
+    HaarCascadeSPtr m_pMouthCascadeClassifier;
+    HaarFeatureCacheSPtr m_pHaarFeatureCache;
+    ThreadPoolSPtr m_pThreadPool;
+    bool m_parallelMouthSearch = true; ///<- Run the mouth cascade and the lips segmentation as concurrent stages
+    cv::Mat m_closeKernel; ///<- Structuring element closing the gaps of the lips segmentation
 
     bool m_useHaarCascades = true;
     bool m_useColorSegmentationAlgorithm;
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "CommonHelpers.h"
+#include "LandMarks.h"
+
+#include <deque>
+#include <mutex>
+
+FWD_DECL(NearDuplicateIndex)
+
+/*!@brief Keeps the landmarks detected in the most recent images indexed by their perceptual hash.
+ * The same photo often comes back re-encoded, resized or with different metadata, which changes its image key
+ * but not its perceptual hash. Looking up the nearest hash lets us reuse (and rescale) the previous landmarks
+ * instead of running the detectors again !*/
+class NearDuplicateIndex : noncopyable
+{
+public:
+    struct ImageSignature
+    {
+        uint64_t hash = 0; ///<- Perceptual hash used for the nearest neighbour search
+        cv::Size imageSize; ///<- Size of the original image
+        cv::Mat thumbnail; ///<- Small gray thumbnail used to confirm a candidate match
+    };
+
+    /*!@brief Computes the signature of a gray image !*/
+    static ImageSignature computeSignature(const cv::Mat & grayImage);
+
+    /*!@brief Sets the maximum number of entries kept, oldest entries are dropped first !*/
+    void setCapacity(size_t capacity);
+
+    /*!@brief Sets the maximum number of different hash bits for two images to be considered the same photo !*/
+    void setMaxHashDistance(int maxHashDistance);
+
+    /*!@brief Sets the maximum mean absolute difference between thumbnails for two images to be the same photo !*/
+    void setMaxThumbnailDifference(double maxThumbnailDifference);
+
+    /*!@brief Remembers the landmarks detected on an image with the given signature !*/
+    void add(const ImageSignature & signature, const LandMarks & landMarks);
+
+    /*!@brief Looks for the nearest previous image within the maximum hash distance and same aspect ratio
+     *  @param[in] signature Signature of the image being processed
+     *  @param[out] landMarks Landmarks of the near duplicate rescaled to the size of the image being processed
+     *  @returns true if a near duplicate was found, false otherwise
+     !*/
+    bool find(const ImageSignature & signature, LandMarks & landMarks) const;
+
+private:
+    struct Entry
+    {
+        ImageSignature signature;
+        LandMarks landMarks;
+    };
+
+    ///<- Entries in the order they were added, most recent at the back
+    std::deque<Entry> m_entries;
+
+    size_t m_capacity = 32;
+
+    int m_maxHashDistance = 3;
+
+    double m_maxThumbnailDifference = 3.0;
+
+    ///<- Maximum relative difference of aspect ratios for two images to be considered the same photo
+    const double m_maxAspectRatioDifference = 0.01;
+
+    mutable std::mutex m_mutex;
+};
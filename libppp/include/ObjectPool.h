@@ -0,0 +1,68 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/*!@brief Pool of interchangeable objects that must not be used by more than one thread at a time (e.g. detectors
+ * keeping internal state). An acquired object is used exclusively by its holder and goes back to the pool once the
+ * last reference to it is released. New objects are created on demand, so the pool grows up to the number of
+ * concurrent users !*/
+template <typename T>
+class ObjectPool : noncopyable
+{
+public:
+    explicit ObjectPool(const std::function<std::shared_ptr<T>()> & create)
+    : m_create(create)
+    , m_pState(std::make_shared<State>())
+    {
+    }
+
+    /*!@brief Returns an object for exclusive use, the object can outlive the pool !*/
+    std::shared_ptr<T> acquire()
+    {
+        std::shared_ptr<T> pObject;
+        {
+            std::lock_guard<std::mutex> lg(m_pState->mutex);
+            if (!m_pState->available.empty())
+            {
+                pObject = m_pState->available.back();
+                m_pState->available.pop_back();
+            }
+        }
+        if (!pObject)
+        {
+            pObject = m_create();
+        }
+
+        std::weak_ptr<State> pWeakState(m_pState);
+        return std::shared_ptr<T>(pObject.get(), [pWeakState, pObject](T *) {
+            if (auto pState = pWeakState.lock())
+            {
+                std::lock_guard<std::mutex> lg(pState->mutex);
+                pState->available.push_back(pObject);
+            }
+        });
+    }
+
+    /*!@brief Returns the number of idle objects in the pool !*/
+    size_t numAvailable() const
+    {
+        std::lock_guard<std::mutex> lg(m_pState->mutex);
+        return m_pState->available.size();
+    }
+
+private:
+    struct State
+    {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<T>> available;
+    };
+
+    std::function<std::shared_ptr<T>()> m_create;
+
+    ///<- Shared with the acquired objects so they can be returned to the pool while it exists
+    std::shared_ptr<State> m_pState;
+};
@@ -18,12 +18,28 @@ public:
                         const cv::Point & chinPoint,
                         const PhotoStandard & ps) override;
 
+    cv::RotatedRect cropGeometry(const cv::Point & crownPoint,
+                                 const cv::Point & chinPoint,
+                                 const PhotoStandard & ps) const override;
+
     // Creates a tiled photo from the cropped photo
     cv::Mat tileCroppedPhoto(const CanvasDefinition & canvas,
                              const PhotoStandard & ps,
                              const cv::Mat & croppedImage) override;
 
 private:
+    /*!@brief Computes the crop shared by cropPicture and cropGeometry
+     *  @param[out] centerCrop Center of the crop in the original image
+     *  @param[out] chinCrownVec Vector from the chin point to the crown point, the vertical axis of the crop
+     *  @param[out] cropSize Size of the crop in pixels of the original image
+     !*/
+    void cropFrame(const PhotoStandard & ps,
+                   const cv::Point & crownPoint,
+                   const cv::Point & chinPoint,
+                   cv::Point2d & centerCrop,
+                   cv::Point & chinCrownVec,
+                   cv::Size2d & cropSize) const;
+
     cv::Point2d centerCropEstimation(const PhotoStandard & ps,
                                      const cv::Point & crownPoint,
                                      const cv::Point & chinPoint) const;
@@ -5,24 +5,24 @@
 #include <rapidjson/document.h>
 
 #include "CommonHelpers.h"
+#include "LandMarks.h"
+#include "SingleFlight.h"
 
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <unordered_map>
 
-struct LandMarks;
+FWD_DECL(HaarFeatureCache)
 FWD_DECL(IDetector)
 FWD_DECL(ICrownChinEstimator)
 FWD_DECL(IImageStore)
 FWD_DECL(IPhotoPrintMaker)
+FWD_DECL(NearDuplicateIndex)
+FWD_DECL(ShapePredictor)
+FWD_DECL(ThreadPool)
 
 class CanvasDefinition;
 class PhotoStandard;
 
-namespace dlib
-{
-class shape_predictor;
-}
-
 FWD_DECL(PppEngine)
 
 enum class LandMarkType
@@ -46,33 +46,82 @@ struct EnumClassHash
 class PppEngine : noncopyable
 {
 public:
+    // Largest preview, bigger maximum sizes are clamped to it. A raw RGBA preview of this size takes less than 8 MB
+    static const int kMaxPreviewWidth = 1600;
+    static const int kMaxPreviewHeight = 1200;
+
     explicit PppEngine(IDetectorSPtr pFaceDetector = nullptr,
                        IDetectorSPtr pEyeDetector = nullptr,
                        IDetectorSPtr pLipsDetector = nullptr,
                        ICrownChinEstimatorSPtr pCrownChinEstimator = nullptr,
                        IPhotoPrintMakerSPtr pPhotoPrintMaker = nullptr,
-                       IImageStoreSPtr pImageStore = nullptr);
+                       IImageStoreSPtr pImageStore = nullptr,
+                       HaarFeatureCacheSPtr pHaarFeatureCache = nullptr);
 
     // Native interface
     bool configure(const std::string & configString);
 
     std::string setInputImage(const cv::Mat & inputImage) const;
 
+    /*!@brief Detects the landmarks in the image referred by the key.
+     *  Concurrent calls for the same image are coalesced so only one detection runs !*/
     bool detectLandMarks(const std::string & imageKey, LandMarks & landMarks) const;
+
+    /*!@brief Detects the landmarks of all the faces in the image referred by the key, e.g. in group photos.
+     *  The landmarks of the faces are detected in parallel
+     *  @param[out] facesLandMarks Landmarks of the faces where all of them were found, biggest face first
+     *  @returns true if the landmarks of at least one face were found
+     !*/
+    bool detectAllLandMarks(const std::string & imageKey, std::vector<LandMarks> & facesLandMarks) const;
+
     cv::Point getLandMark(const dlib::full_object_detection & shape, LandMarkType type) const;
+
+    /*!@brief Estimates the crown and chin points from already known landmarks (e.g. edited by the user).
+     *  Only the crown/chin estimator runs, no image is needed !*/
+    bool estimateCrownChin(LandMarks & landMarks) const;
+
+    /*!@brief Computes the region of the input image that would be cropped for the given crown and chin marks !*/
+    cv::RotatedRect cropGeometry(const PhotoStandard & ps,
+                                 const cv::Point & crownMark,
+                                 const cv::Point & chinMark) const;
+
+    /*!@brief Crops the image to the photo standard at (at least) the resolution needed to print it in the canvas.
+     *  The crop is taken from the image pyramid level closest above that resolution !*/
     cv::Mat cropPicture(const std::string & imageKey,
                         PhotoStandard & ps,
                         CanvasDefinition & canvas,
                         cv::Point & crownMark,
                         cv::Point & chinMark) const;
 
+    /*!@brief Creates a tiled print of the image referred by the key.
+     *  Concurrent calls with the same key and parameters are coalesced and share the output image !*/
     cv::Mat createTiledPrint(const std::string & imageKey,
                              PhotoStandard & ps,
                              CanvasDefinition & canvas,
                              cv::Point & crownMark,
                              cv::Point & chinMark) const;
 
+    /*!@brief Renders a low resolution preview of the crop (or of the tiled print) for interactive editing.
+     *  The preview is rendered from the cached image pyramid at the resolution that fits the maximum size, so it is
+     *  cheap enough to be refreshed while the crown and chin marks are being dragged
+     *  @param[in] maxSize Maximum size of the preview in pixels, clamped to kMaxPreviewWidth x kMaxPreviewHeight
+     *  @param[in] tiled Whether to render the whole tiled print or only the cropped photo
+     !*/
+    cv::Mat createPreview(const std::string & imageKey,
+                          PhotoStandard & ps,
+                          CanvasDefinition & canvas,
+                          cv::Point & crownMark,
+                          cv::Point & chinMark,
+                          const cv::Size & maxSize,
+                          bool tiled) const;
+
 private:
+    ///<- Workers shared by the stages that run concurrently
+    ThreadPoolSPtr m_pThreadPool;
+
+    ///<- Pyramid and integral images of the recent images, shared by all the Haar cascades
+    HaarFeatureCacheSPtr m_pHaarFeatureCache;
+
     IDetectorSPtr m_pFaceDetector;
     IDetectorSPtr m_pEyesDetector;
     IDetectorSPtr m_pLipsDetector;
@@ -81,10 +130,39 @@ private:
     IPhotoPrintMakerSPtr m_pPhotoPrintMaker;
     IImageStoreSPtr m_pImageStore;
 
-    std::shared_ptr<dlib::shape_predictor> m_shapePredictor;
+    ShapePredictorSPtr m_pShapePredictor;
     bool m_useDlibLandmarkDetection;
+    float m_minShapeUpdate; ///<- Smallest move of the parts worth another level of the shape predictor, 0 to run all
+
+    // Tiered detection: the eyes and lips detectors run first and the shape predictor only runs when the geometry
+    // of the landmarks they find is not plausible enough
+    bool m_escalateToShapePredictor;
+    double m_minLandMarksPlausibility; ///<- See LandMarks::geometryPlausibility
+
+    ///<- Landmarks of recent images, reused when the same photo comes back re-encoded or resized. Opt-in, as nearly
+    ///<- identical shots of the same person would reuse the landmarks of another photo
+    NearDuplicateIndexSPtr m_pNearDuplicateIndex;
+    bool m_reuseNearDuplicateLandMarks;
 
     std::unordered_map<LandMarkType, std::vector<int>, EnumClassHash> m_landmarkIndexMapping;
 
+    ///<- Coalesce concurrent identical requests (e.g. retries) so the pipeline runs only once
+    mutable SingleFlight<std::pair<bool, LandMarks>> m_landMarksFlights;
+    mutable SingleFlight<cv::Mat> m_tiledPrintFlights;
+
     void verifyImageExists(const std::string & imageKey) const;
+
+    bool detectLandMarksImpl(const std::string & imageKey, LandMarks & landMarks) const;
+
+    /*!@brief Detects the landmarks of a face already found by the face detector
+     *  @param[in] inputImage Image where the face was found
+     *  @param[in,out] landMarks Face rectangle and orientation on input, all the landmarks of the face on output
+     !*/
+    bool detectFaceLandMarks(const cv::Mat & inputImage, LandMarks & landMarks) const;
+
+    cv::Mat createTiledPrintImpl(const std::string & imageKey,
+                                 PhotoStandard & ps,
+                                 CanvasDefinition & canvas,
+                                 cv::Point & crownMark,
+                                 cv::Point & chinMark) const;
 };
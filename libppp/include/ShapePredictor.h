@@ -0,0 +1,123 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <dlib/image_processing/full_object_detection.h>
+#include <dlib/matrix.h>
+#include <opencv2/core/core.hpp>
+
+#include <cstdint>
+#include <istream>
+
+FWD_DECL(ShapePredictor)
+
+/*!@brief Evaluates a dlib::shape_predictor model (cascade of regression forests) from a flattened layout. The split
+ * nodes of all the trees are stored as contiguous arrays of pixel indices and thresholds, and the leaf values in a
+ * single packed table, instead of the trees and matrices of the dlib model that are scattered in memory. Trees are
+ * traversed without branches and the leaf values are added to the shape with SIMD instructions. Several faces are
+ * evaluated together level by level, so each level of the model is read from memory once for all of them.
+ * The results are the same as the ones of the dlib model. Models quantized by build.py can be loaded too, their leaf
+ * values are kept as 8 bit integers and scaled while added to the shape, so they take 4 times less memory.
+ * The predictor is immutable once created, so it can be used from several threads at once !*/
+class ShapePredictor : noncopyable
+{
+public:
+    /*!@brief Loads and flattens a model serialized by dlib (e.g. shape_predictor_68_face_landmarks.dat) or quantized by
+     * build.py, the format is detected from the content. The model is read straight into the flattened layout without
+     * creating the dlib::shape_predictor
+     *  @param[in] stream Stream of the serialized model
+     !*/
+    explicit ShapePredictor(std::istream & stream);
+
+    size_t numParts() const;
+
+    size_t numLevels() const;
+
+    /*!@brief Checks whether the model was loaded from the quantized format !*/
+    bool isQuantized() const;
+
+    /*!@brief Predicts the shape of a face
+     *  @param[in] image Gray scale (CV_8UC1) or BGR (CV_8UC3) image
+     *  @param[in] faceRect Rectangle of the face in the image
+     !*/
+    dlib::full_object_detection operator()(const cv::Mat & image, const dlib::rectangle & faceRect) const;
+
+    /*!@brief Predicts the shapes of several faces of the same image together
+     *  @param[in] image Gray scale (CV_8UC1) or BGR (CV_8UC3) image
+     *  @param[in] faceRects Rectangles of the faces in the image
+     !*/
+    std::vector<dlib::full_object_detection> operator()(const cv::Mat & image,
+                                                        const std::vector<dlib::rectangle> & faceRects) const;
+
+    /*!@brief Predicts the shape of a face, stopping before the last cascade levels once they barely move the parts
+     *  @param[in] image Gray scale (CV_8UC1) or BGR (CV_8UC3) image
+     *  @param[in] faceRect Rectangle of the face in the image
+     *  @param[in] minShapeUpdate Largest move of the parts in a level, relative to the size of the face, below which
+     *  the next levels are skipped. All the levels run when 0
+     *  @param[out] numLevelsRun Number of cascade levels run
+     !*/
+    dlib::full_object_detection operator()(const cv::Mat & image,
+                                           const dlib::rectangle & faceRect,
+                                           float minShapeUpdate,
+                                           size_t & numLevelsRun) const;
+
+    /*!@brief Predicts the shapes of several faces of the same image together, stopping early for each face as above
+     *  @param[out] numLevelsRun Number of cascade levels run for each face
+     !*/
+    std::vector<dlib::full_object_detection> operator()(const cv::Mat & image,
+                                                        const std::vector<dlib::rectangle> & faceRects,
+                                                        float minShapeUpdate,
+                                                        std::vector<size_t> & numLevelsRun) const;
+
+private:
+    struct Level
+    {
+        size_t firstTree;
+        size_t numTrees;
+        size_t firstPixel; ///<- Feature pixels of the level in m_anchorIndices and m_deltas
+        size_t numPixels;
+    };
+
+    dlib::matrix<float, 0, 1> m_initialShape;
+    std::vector<Level> m_levels;
+
+    // Feature pixels, relative to a point of the initial shape
+    std::vector<unsigned long> m_anchorIndices;
+    std::vector<dlib::vector<float, 2>> m_deltas;
+
+    // Split nodes of tree t are at [t * m_numSplits, (t + 1) * m_numSplits) in breadth first order
+    size_t m_numSplits = 0;
+    std::vector<uint16_t> m_splitPixels1; ///<- Indices of the pixels in the feature pixels of the level
+    std::vector<uint16_t> m_splitPixels2;
+    ///<- Thresholds rounded down, which gives the same splits as the pixel differences are integers
+    std::vector<int16_t> m_splitThresholds;
+
+    ///<- Shape increments of the leaves, the one of leaf l of tree t at ((t * (m_numSplits + 1)) + l) * shape size
+    std::vector<float> m_leafValues;
+    // Same for the quantized models, the increments are the values times the scale of their tree
+    bool m_isQuantized = false;
+    std::vector<int8_t> m_quantizedLeafValues;
+    std::vector<float> m_leafScales;
+
+    void loadDlibModel(std::istream & stream);
+
+    void loadQuantizedModel(std::istream & stream);
+
+    template <typename ImageType>
+    std::vector<dlib::full_object_detection> predict(const ImageType & image,
+                                                     const std::vector<dlib::rectangle> & faceRects,
+                                                     float minShapeUpdate,
+                                                     std::vector<size_t> & numLevelsRun) const;
+
+    template <typename ImageType>
+    void extractPixelValues(const ImageType & image,
+                            const dlib::rectangle & faceRect,
+                            const Level & level,
+                            const dlib::matrix<float, 0, 1> & currentShape,
+                            std::vector<float> & pixelValues) const;
+
+    /*!@brief Adds the increments of the leaves the pixel values lead to in all the trees of a level !*/
+    void evaluateTrees(const Level & level, const std::vector<float> & pixelValues, float * pShape) const;
+
+    void addQuantizedLeafValues(const int8_t * pLeafValues, float scale, float * pShape) const;
+};
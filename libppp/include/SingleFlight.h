@@ -0,0 +1,80 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*!@brief Coalesces concurrent calls that share the same key.
+ * The first caller for a given key runs the computation while any other caller arriving
+ * before it completes waits for and receives the very same result (or exception).
+ * Nothing is cached: once the computation finishes the next caller starts a new one !*/
+template <typename TResult>
+class SingleFlight : noncopyable
+{
+public:
+    /*!@brief Runs the computation for the key unless one is already in flight, in which case its result is shared
+     *  @param[in] key Identifies the computation, callers with equal keys expect equal results
+     *  @param[in] compute Function producing the result, only called by the first caller
+     *  @returns The result of the computation
+     !*/
+    TResult run(const std::string & key, const std::function<TResult()> & compute)
+    {
+        std::shared_future<TResult> result;
+        std::promise<TResult> promise;
+        auto isLeader = false;
+        {
+            std::lock_guard<std::mutex> lg(m_mutex);
+            auto it = m_inFlight.find(key);
+            if (it == m_inFlight.end())
+            {
+                result = promise.get_future().share();
+                m_inFlight.emplace(key, Flight { result, 1 });
+                isLeader = true;
+            }
+            else
+            {
+                result = it->second.result;
+                ++it->second.numCallers;
+            }
+        }
+
+        if (isLeader)
+        {
+            try
+            {
+                promise.set_value(compute());
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+            }
+            std::lock_guard<std::mutex> lg(m_mutex);
+            m_inFlight.erase(key);
+        }
+        return result.get();
+    }
+
+    /*!@brief Returns the number of callers currently waiting on the computation for the key (leader included) !*/
+    size_t numCallers(const std::string & key) const
+    {
+        std::lock_guard<std::mutex> lg(m_mutex);
+        const auto it = m_inFlight.find(key);
+        return it == m_inFlight.end() ? 0 : it->second.numCallers;
+    }
+
+private:
+    struct Flight
+    {
+        std::shared_future<TResult> result;
+        size_t numCallers;
+    };
+
+    ///<- Computations currently running indexed by their key
+    std::unordered_map<std::string, Flight> m_inFlight;
+
+    mutable std::mutex m_mutex;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+FWD_DECL(StageGraph)
+FWD_DECL(ThreadPool)
+
+/*!@brief Dependency graph of the stages processing an image, e.g. the searches of the left and right eyes. Each stage
+ * is submitted to the thread pool as soon as all the stages it depends on succeeded, so independent stages run
+ * concurrently. Stages depending on a stage that failed are skipped. Stages are run from the thread completing their
+ * last dependency, the graph never blocks a worker of the pool !*/
+class StageGraph : noncopyable
+{
+public:
+    /*!@brief Function of a stage, returning whether it succeeded !*/
+    typedef std::function<bool()> Stage;
+
+    /*!@brief Creates an empty graph
+     *  @param[in] pThreadPool Pool running the stages. Without pool the stages run sequentially in the calling thread,
+     *  in the order they were added
+     !*/
+    explicit StageGraph(ThreadPoolSPtr pThreadPool = nullptr);
+
+    /*!@brief Adds a stage to the graph
+     *  @param[in] stage Function of the stage
+     *  @param[in] dependencies Stages that must succeed before this one runs, they must have been added before
+     *  @returns The index of the stage in the graph
+     !*/
+    size_t addStage(Stage stage, const std::vector<size_t> & dependencies = {});
+
+    /*!@brief Runs all the stages and waits for them to complete. The graph can be run again once this returns.
+     * The first exception thrown by a stage is rethrown once all the stages completed
+     *  @returns true if all the stages succeeded
+     !*/
+    bool run();
+
+    /*!@brief Checks whether a stage succeeded in the last run !*/
+    bool succeeded(size_t stage) const;
+
+private:
+    enum class StageState
+    {
+        PENDING,
+        SUCCEEDED,
+        FAILED ///<- The stage returned false or threw, or was skipped after a failed dependency
+    };
+
+    struct Node
+    {
+        Stage stage;
+        std::vector<size_t> dependents;
+        size_t numDependencies;
+
+        // State of the current run
+        size_t numPendingDependencies;
+        bool dependencyFailed;
+        StageState state;
+    };
+
+    ThreadPoolSPtr m_pThreadPool;
+
+    std::vector<Node> m_nodes;
+
+    size_t m_numUnfinishedStages;
+    std::exception_ptr m_pException; ///<- First exception thrown by a stage in the current run
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_allFinished;
+
+    /*!@brief Runs a stage whose dependencies all completed, or skips it if one of them failed !*/
+    void runStage(size_t index);
+
+    /*!@brief Records the result of a stage and starts the dependents it was the last dependency of !*/
+    void finishStage(size_t index, bool success);
+
+    void scheduleStage(size_t index);
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "CommonHelpers.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+FWD_DECL(ThreadPool)
+
+/*!@brief Fixed size pool of worker threads running submitted tasks in FIFO order.
+ * Tasks submitted from one of the pool's own workers run inline in the calling thread, so a task can safely wait for
+ * work it submits itself. A pool without workers (e.g. in builds without thread support) runs every task inline !*/
+class ThreadPool : noncopyable
+{
+public:
+    /*!@brief Starts the workers
+     *  @param[in] numThreads Number of worker threads, the number of hardware threads by default
+     !*/
+    explicit ThreadPool(size_t numThreads = std::thread::hardware_concurrency());
+
+    /*!@brief Drops the tasks that did not start yet and waits for the running ones to complete !*/
+    ~ThreadPool();
+
+    size_t numThreads() const;
+
+    /*!@brief Returns true if the calling thread is one of the workers of this pool !*/
+    bool isWorkerThread() const;
+
+    /*!@brief Queues the function for execution in a worker thread
+     *  @returns A future holding the result of the function (or the exception it threw)
+     !*/
+    template <typename TFunc>
+    auto submit(TFunc && func) -> std::future<decltype(func())>
+    {
+        typedef decltype(func()) TResult;
+        auto pTask = std::make_shared<std::packaged_task<TResult()>>(std::forward<TFunc>(func));
+        auto result = pTask->get_future();
+        if (m_workers.empty() || isWorkerThread())
+        {
+            (*pTask)();
+            return result;
+        }
+        {
+            std::lock_guard<std::mutex> lg(m_mutex);
+            m_tasks.emplace_back([pTask]() { (*pTask)(); });
+        }
+        m_condition.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> m_workers;
+
+    ///<- Tasks waiting for a worker
+    std::deque<std::function<void()>> m_tasks;
+
+    bool m_stopping;
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+
+    void workerLoop();
+};
@@ -14,6 +14,8 @@ typedef vector<long, 2> point;
 
 } // namespace dlib
 
+FWD_DECL(HaarCascade)
+
 template <typename TNumber>
 int ROUND_INT(TNumber x)
 {
@@ -30,16 +32,27 @@ class Utilities
 {
 public:
     /*!@brief Loads a cascade classifier from file
-    *  @param[in] haarCascadeBase64Data Haar cascade XML data encoded as a base64 string
+    *  @param[in] haarCascadeBase64Data Haar cascade binary (see HaarCascade) or XML data encoded as a base64 string
     *  @returns The classifier loaded into memory
     !*/
     // static std::shared_ptr<cv::CascadeClassifier> loadClassifierFromFile(const std::string &haarCascadeDir, const
     // std::string &haarCascadeFile);
-    static std::shared_ptr<cv::CascadeClassifier> loadClassifierFromBase64(const char * haarCascadeBase64Data);
+    static HaarCascadeSPtr loadClassifierFromBase64(const char * haarCascadeBase64Data);
 
     /*!@brief Calculates CRC value for a buffer of specified length !*/
     static uint32_t crc32(uint32_t crc, const uint8_t * begin, const uint8_t * end);
 
+    /*!@brief Calculates a 64 bit perceptual (difference) hash of an image.
+    *  The image is reduced to a 9x8 gray thumbnail and each bit tells whether a pixel is brighter than its right
+    *  neighbour, so re-encoded or resized copies of the same picture have hashes within a few bits of each other
+    *  @param[in] image Gray or BGR image
+    *  @returns The perceptual hash of the image
+    !*/
+    static uint64_t perceptualHash(const cv::Mat & image);
+
+    /*!@brief Counts the number of bits that differ between two hashes !*/
+    static int hammingDistance(uint64_t hash1, uint64_t hash2);
+
     static std::vector<BYTE> base64Decode(const char * base64Str, size_t base64Len);
 
     static std::string base64Encode(const std::vector<BYTE> & rawStr);
@@ -80,7 +93,21 @@ public:
      */
     static int kittlerOptimumThreshold(std::vector<double> P, float mu);
 
-    static cv::Mat rotateImage(const cv::Mat & inputImage, int rotAngelDegrees);
+    /*!@brief Rotates an image by a multiple of 90 degrees (positive angles are counter clockwise).
+    *  The rotation is exact (transpose and flip), no pixel is interpolated
+    !*/
+    static cv::Mat rotateImage(const cv::Mat & inputImage, int rotAngleDegrees);
+
+    /*!@brief Calculates where a point of an image ends up when the image is rotated with rotateImage
+    *  @param[in] point Point in the image before the rotation
+    *  @param[in] imageSize Size of the image before the rotation
+    *  @param[in] rotAngleDegrees Rotation angle, a multiple of 90 degrees
+    *  @returns The point in the rotated image
+    !*/
+    static cv::Point rotatePoint(const cv::Point & point, const cv::Size & imageSize, int rotAngleDegrees);
+
+    /*!@brief Calculates where a rectangle of an image ends up when the image is rotated with rotateImage !*/
+    static cv::Rect rotateRect(const cv::Rect & rect, const cv::Size & imageSize, int rotAngleDegrees);
 
     static cv::Mat selfCoefficientImage(const cv::Mat & inputImage, int kernelSize);
 
@@ -39,6 +39,28 @@ public:
 
     std::string detectLandmarks(const std::string &imageId) const;
 
+    /*!@brief Detects the landmarks of all the faces in the image
+    *  returns JSON array of the landmarks of each face, in the format returned by detectLandmarks, biggest face first
+    !*/
+    std::string detectAllLandmarks(const std::string &imageId) const;
+
+    /*!@brief Estimates the crown and chin points from landmarks edited by the user without processing the image
+    *  The request has the following format, where the landmarks follow the format returned by detectLandmarks
+    *  (the pupils and lip corners are required, the chin point is kept if given):
+    .{
+    .    "landmarks": {
+    .       "eyeLeftPupil": { "x": 400, "y": 300 },
+    .       "eyeRightPupil": { "x": 600, "y": 300 },
+    .       "lipLeftCorner": { "x": 420, "y": 550 },
+    .       "lipRightCorner": { "x": 580, "y": 550 }
+    .    },
+    .    "standard": { ... }
+    .}
+    *  returns The updated landmarks. If the photo standard is given the crop region in the input image is returned
+    *  as well in member "cropRect": { "center": { "x", "y" }, "width", "height", "angle" }
+    !*/
+    std::string estimateCrownChin(const std::string &request) const;
+
     /*!@brief Creates a tiled print from input image, crown/chin points and passport/canvas definition
     *  Output definition is passed as a JSON string with the following format:
     .{
@@ -70,6 +92,24 @@ public:
     !*/
     std::string createTiledPrint(const std::string& imageId, const std::string &request) const;
 
+    /*!@brief Creates a low resolution preview for interactive editing of the crown/chin points
+    *  The request has the same format as for createTiledPrint plus the preview options (all optional):
+    .{
+    .    ...
+    .    "preview": {
+    .       "maxWidth": 640,  (clamped to 1600)
+    .       "maxHeight": 480, (clamped to 1200)
+    .       "tiled": false,
+    .       "format": "jpeg"|"rgba",
+    .       "quality": 75
+    .    }
+    .}
+    *  With "tiled" the whole print is previewed, otherwise only the cropped photo. The "jpeg" format returns a JPEG
+    *  file encoded with the given quality, "rgba" returns the width and height of the image (as 32 bit big endian
+    *  unsigned integers) followed by its raw RGBA pixels
+    !*/
+    std::string createPreview(const std::string& imageId, const std::string &request) const;
+
 private:
     PppEngine* m_pPppEngine;
 
@@ -85,5 +125,17 @@ extern "C"
 
     bool detect_landmarks(const char *img_id, char *landmarks);
 
+    /*!@brief Detects the landmarks of all the faces into the landmarks buffer, whose capacity is landmarks_size bytes
+    *  returns false on error (e.g. when the landmarks with their terminating null do not fit the buffer)
+    !*/
+    bool detect_all_landmarks(const char *img_id, char *landmarks, int landmarks_size);
+
+    bool estimate_crown_chin(const char *request, char *landmarks);
+
     int  create_tiled_print(const char *img_id, const char *request, char *out_buf);
+
+    /*!@brief Creates the preview into out_buf, whose capacity is out_buf_size bytes
+    *  returns The size of the preview, 0 on error (e.g. when the preview does not fit the buffer)
+    !*/
+    int  create_preview(const char *img_id, const char *request, char *out_buf, int out_buf_size);
 }
\ No newline at end of file
@@ -38,9 +38,18 @@ libppp.set_image.argtypes = [c_char_p, c_int, c_char_p]
 libppp.detect_landmarks.restype = bool
 libppp.detect_landmarks.argtypes = [c_char_p, c_char_p]
 
+libppp.detect_all_landmarks.restype = bool
+libppp.detect_all_landmarks.argtypes = [c_char_p, c_char_p, c_int]
+
+libppp.estimate_crown_chin.restype = bool
+libppp.estimate_crown_chin.argtypes = [c_char_p, c_char_p]
+
 libppp.create_tiled_print.restype = int
 libppp.create_tiled_print.argtypes = [c_char_p, c_char_p, c_char_p]
 
+libppp.create_preview.restype = int
+libppp.create_preview.argtypes = [c_char_p, c_char_p, c_char_p, c_int]
+
 def str2bytes(string):
     return bytes(string, 'ascii')
 
@@ -82,6 +91,33 @@ def detect_landmarks(img_key):
     return None
 
 
+def detect_all_landmarks(img_key):
+    """
+    Detects the landmarks of all the faces in the image, returns a JSON array with the ones of each face
+    """
+    assert img_key and isinstance(img_key, str), 'Invalid image key'
+
+    landmarks = create_string_buffer(1048576)
+    success = libppp.detect_all_landmarks(str2bytes(img_key), landmarks, len(landmarks))
+    if success:
+        return landmarks.value
+    return None
+
+
+def estimate_crown_chin(request):
+    """
+    """
+    assert request, 'Request is empty'
+    if not isinstance(request, str):
+        request = json.dumps(request)
+
+    landmarks = create_string_buffer(65535)
+    success = libppp.estimate_crown_chin(str2bytes(request), landmarks)
+    if success:
+        return landmarks.value
+    return None
+
+
 def create_tiled_print(img_key, request):
     """
     """
@@ -95,6 +131,18 @@ def create_tiled_print(img_key, request):
     return png_d
 
 
+def create_preview(img_key, request):
+    """
+    """
+    assert request, 'Request is empty'
+    if not isinstance(request, str):
+        request = json.dumps(request)
+
+    preview_content = create_string_buffer(8*1024*1024)
+    num_bytes = libppp.create_preview(str2bytes(img_key), str2bytes(request), preview_content, len(preview_content))
+    return preview_content.raw[0:num_bytes]
+
+
 def main():
     # Let's check that it works
     lib_cfg = resolve_filepath('config.json')
@@ -0,0 +1,172 @@
+#include "CnnFaceDetector.h"
+#include "LandMarks.h"
+#include "Utilities.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include <dlib/dnn.h>
+#include <dlib/opencv/cv_image.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace std;
+
+namespace
+{
+// Network of the dlib MMOD face detector (see dnn_mmod_face_detection_ex.cpp), the model file holds its weights
+template <long numFilters, typename SUBNET>
+using con5d = dlib::con<numFilters, 5, 5, 2, 2, SUBNET>;
+template <long numFilters, typename SUBNET>
+using con5 = dlib::con<numFilters, 5, 5, 1, 1, SUBNET>;
+
+template <typename SUBNET>
+using downsampler = dlib::relu<dlib::affine<
+    con5d<32, dlib::relu<dlib::affine<con5d<32, dlib::relu<dlib::affine<con5d<16, SUBNET>>>>>>>>>;
+template <typename SUBNET>
+using rcon5 = dlib::relu<dlib::affine<con5<45, SUBNET>>>;
+
+using MmodNetwork = dlib::loss_mmod<dlib::con<
+    1, 9, 9, 1, 1, rcon5<rcon5<rcon5<downsampler<dlib::input_rgb_image_pyramid<dlib::pyramid_down<6>>>>>>>>;
+} // namespace
+
+struct CnnFaceDetector::Network
+{
+    MmodNetwork net;
+};
+
+CnnFaceDetector::CnnFaceDetector()
+: m_workingSize(480)
+, m_batchSize(4)
+{
+}
+
+void CnnFaceDetector::configure(rapidjson::Value & config)
+{
+    auto & cnnFaceDetectorCfg = config["cnnFaceDetector"];
+    m_workingSize = cnnFaceDetectorCfg["workingSize"].GetInt();
+    m_batchSize = cnnFaceDetectorCfg["batchSize"].GetUint();
+
+    const auto pNetwork = make_shared<Network>();
+    const auto modelFile = cnnFaceDetectorCfg["file"].GetString();
+    if (ifstream(modelFile).good())
+    {
+        dlib::deserialize(modelFile) >> pNetwork->net;
+    }
+    else
+    {
+        const auto modelFileContent = cnnFaceDetectorCfg["data"].GetString();
+        if (strlen(modelFileContent) == 0)
+        {
+            throw runtime_error("CNN face detector model not found");
+        }
+        const auto modelData = Utilities::base64Decode(modelFileContent, strlen(modelFileContent));
+        istringstream stream(string(modelData.begin(), modelData.end()));
+        dlib::deserialize(pNetwork->net, stream);
+    }
+
+    m_pNetworks = make_shared<ObjectPool<Network>>([pNetwork]() { return make_shared<Network>(*pNetwork); });
+}
+
+vector<vector<dlib::mmod_rect>> CnnFaceDetector::detect(const vector<cv::Mat> & images) const
+{
+    if (!m_pNetworks)
+    {
+        throw logic_error("The CNN face detector is not configured");
+    }
+
+    // The network takes batches of images of the same size only
+    map<pair<int, int>, vector<size_t>> imagesBySize;
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        imagesBySize[make_pair(images[i].rows, images[i].cols)].push_back(i);
+    }
+
+    vector<vector<dlib::mmod_rect>> detections(images.size());
+    const auto pNetwork = m_pNetworks->acquire();
+    for (const auto & sizeImages : imagesBySize)
+    {
+        const auto & imageIndices = sizeImages.second;
+        vector<dlib::matrix<dlib::rgb_pixel>> batch(imageIndices.size());
+        for (size_t k = 0; k < imageIndices.size(); ++k)
+        {
+            const auto & image = images[imageIndices[k]];
+            if (image.channels() == 1)
+            {
+                dlib::assign_image(batch[k], dlib::cv_image<uint8_t>(image));
+            }
+            else
+            {
+                dlib::assign_image(batch[k], dlib::cv_image<dlib::bgr_pixel>(image));
+            }
+        }
+
+        const auto batchDetections = pNetwork->net(batch, m_batchSize);
+        for (size_t k = 0; k < imageIndices.size(); ++k)
+        {
+            detections[imageIndices[k]] = batchDetections[k];
+        }
+    }
+    return detections;
+}
+
+bool CnnFaceDetector::detectLandMarks(const cv::Mat & inputImage, LandMarks & landmarks)
+{
+    const auto facesLandmarks = detectAllLandMarks(inputImage);
+    if (facesLandmarks.empty())
+    {
+        return false;
+    }
+    const auto & face = facesLandmarks.front();
+    landmarks.vjFaceRect = face.vjFaceRect;
+    landmarks.faceConfidence = face.faceConfidence;
+    landmarks.imageRotation = face.imageRotation;
+    return true;
+}
+
+vector<LandMarks> CnnFaceDetector::detectAllLandMarks(const cv::Mat & inputImage)
+{
+    static const vector<int> angles = { 0, 90, -90, 180 };
+
+    // Faces in photos for documents are large, so they are searched in a downscaled image
+    const auto imageLongSide = std::max(inputImage.cols, inputImage.rows);
+    const auto scale = std::min(1.0, static_cast<double>(m_workingSize) / imageLongSide);
+    cv::Mat workingImage = inputImage;
+    if (scale < 1.0)
+    {
+        cv::resize(inputImage, workingImage, cv::Size(), scale, scale, cv::INTER_AREA);
+    }
+
+    // All the orientations are searched in the same inference, the first one in this order with a face wins
+    vector<cv::Mat> rotatedImages;
+    for (const auto angle : angles)
+    {
+        rotatedImages.push_back(Utilities::rotateImage(workingImage, angle));
+    }
+    auto detections = detect(rotatedImages);
+
+    vector<LandMarks> facesLandmarks;
+    for (size_t i = 0; i < angles.size() && facesLandmarks.empty(); ++i)
+    {
+        // Biggest face first, faces of the same size keep the order of the detector
+        stable_sort(
+            detections[i].begin(), detections[i].end(), [](const dlib::mmod_rect & d1, const dlib::mmod_rect & d2) {
+                return d1.rect.area() > d2.rect.area();
+            });
+        for (const auto & face : detections[i])
+        {
+            const auto faceRect = Utilities::convert(face.rect);
+            LandMarks landmarks;
+            landmarks.vjFaceRect = cv::Rect(ROUND_INT(faceRect.x / scale),
+                                            ROUND_INT(faceRect.y / scale),
+                                            ROUND_INT(faceRect.width / scale),
+                                            ROUND_INT(faceRect.height / scale));
+            landmarks.faceConfidence = face.detection_confidence;
+            landmarks.imageRotation = angles[i];
+            facesLandmarks.push_back(landmarks);
+        }
+    }
+    return facesLandmarks;
+}
@@ -0,0 +1,119 @@
+#include "EyeCenterKernel.h"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+EyeCenterKernel::EyeCenterKernel(const cv::Size & maxSize)
+: m_maxSize(maxSize)
+{
+    if (maxSize.width <= 0 || maxSize.height <= 0)
+    {
+        throw std::logic_error("Invalid size of the eye center kernel");
+    }
+
+    const auto tableSize = cv::Size(2 * maxSize.width - 1, 2 * maxSize.height - 1);
+    m_displacementX.create(tableSize, CV_32F);
+    m_displacementY.create(tableSize, CV_32F);
+    for (auto row = 0; row < tableSize.height; ++row)
+    {
+        auto pDx = m_displacementX.ptr<float>(row);
+        auto pDy = m_displacementY.ptr<float>(row);
+        const double dy = row - (maxSize.height - 1);
+        for (auto col = 0; col < tableSize.width; ++col)
+        {
+            const double dx = col - (maxSize.width - 1);
+            const auto magnitude = sqrt(dx * dx + dy * dy);
+            // A gradient doesn't vote for its own position
+            pDx[col] = magnitude > 0 ? static_cast<float>(dx / magnitude) : 0.0f;
+            pDy[col] = magnitude > 0 ? static_cast<float>(dy / magnitude) : 0.0f;
+        }
+    }
+}
+
+cv::Size EyeCenterKernel::maxSize() const
+{
+    return m_maxSize;
+}
+
+void EyeCenterKernel::accumulate(const cv::Mat & gradientX,
+                                 const cv::Mat & gradientY,
+                                 const cv::Mat & weight,
+                                 float weightDivisor,
+                                 cv::Mat & outSum) const
+{
+    accumulate(gradientX, gradientY, weight, weightDivisor, cv::Rect(0, 0, gradientX.cols, gradientX.rows), outSum);
+}
+
+void EyeCenterKernel::accumulate(const cv::Mat & gradientX,
+                                 const cv::Mat & gradientY,
+                                 const cv::Mat & weight,
+                                 float weightDivisor,
+                                 const cv::Rect & centers,
+                                 cv::Mat & outSum) const
+{
+    const auto rows = gradientX.rows;
+    const auto cols = gradientX.cols;
+    if (rows > m_maxSize.height || cols > m_maxSize.width)
+    {
+        throw std::logic_error("Gradient images are larger than the eye center kernel");
+    }
+    if ((centers & cv::Rect(0, 0, cols, rows)) != centers)
+    {
+        throw std::logic_error("Window of the eye centers is outside the gradient images");
+    }
+
+    outSum = cv::Mat::zeros(centers.size(), CV_32F);
+
+    for (auto y = 0; y < rows; ++y)
+    {
+        const auto Xr = gradientX.ptr<double>(y);
+        const auto Yr = gradientY.ptr<double>(y);
+        const auto Wr = weight.empty() ? nullptr : weight.ptr<unsigned char>(y);
+        for (auto x = 0; x < cols; ++x)
+        {
+            if (Xr[x] == 0.0 && Yr[x] == 0.0)
+            {
+                continue;
+            }
+            // The tables hold the displacements from the gradient to the center, the opposite of the formula, so the
+            // gradient is negated instead
+            const auto gx = static_cast<float>(-Xr[x]);
+            const auto gy = static_cast<float>(-Yr[x]);
+            const auto w = Wr ? Wr[x] / weightDivisor : 1.0f;
+
+            for (auto cy = centers.y; cy < centers.y + centers.height; ++cy)
+            {
+                // Displacements to the centers of the row, from (centers.x - x, cy - y) onwards
+                const auto tableRow = cy - y + m_maxSize.height - 1;
+                const auto tableCol = centers.x - x + m_maxSize.width - 1;
+                const auto pDx = m_displacementX.ptr<float>(tableRow) + tableCol;
+                const auto pDy = m_displacementY.ptr<float>(tableRow) + tableCol;
+                auto Or = outSum.ptr<float>(cy - centers.y);
+
+                auto cx = 0;
+#if CV_SIMD
+                const auto vgx = cv::vx_setall_f32(gx);
+                const auto vgy = cv::vx_setall_f32(gy);
+                const auto vw = cv::vx_setall_f32(w);
+                const auto vzero = cv::vx_setzero_f32();
+                for (; cx <= centers.width - cv::v_float32::nlanes; cx += cv::v_float32::nlanes)
+                {
+                    auto dotProduct = cv::v_muladd(cv::vx_load(pDx + cx), vgx, cv::vx_load(pDy + cx) * vgy);
+                    dotProduct = cv::v_max(dotProduct, vzero);
+                    cv::v_store(Or + cx, cv::v_muladd(dotProduct * dotProduct, vw, cv::vx_load(Or + cx)));
+                }
+#endif
+                for (; cx < centers.width; ++cx)
+                {
+                    const auto dotProduct = std::max(0.0f, pDx[cx] * gx + pDy[cx] * gy);
+                    Or[cx] += dotProduct * dotProduct * w;
+                }
+            }
+        }
+    }
+}
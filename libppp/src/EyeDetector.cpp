@@ -1,21 +1,46 @@
 #include "EyeDetector.h"
+#include "EyeCenterKernel.h"
+#include "HaarCascade.h"
+#include "HaarFeatureCache.h"
 #include "LandMarks.h"
+#include "StageGraph.h"
+#include <algorithm>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/objdetect/objdetect.hpp>
-#include <queue>
 
 #include "Utilities.h"
 
 using namespace std;
 
+EyeDetector::EyeDetector(HaarFeatureCacheSPtr pHaarFeatureCache, ThreadPoolSPtr pThreadPool)
+: m_pHaarFeatureCache(pHaarFeatureCache ? pHaarFeatureCache : make_shared<HaarFeatureCache>())
+, m_pThreadPool(pThreadPool)
+{
+}
+
 void EyeDetector::configure(rapidjson::Value & cfg)
 {
     auto & edCfg = cfg["eyesDetector"];
 
     createCornerKernels();
 
+    // Eye regions are scaled to kFastEyeWidth, and are seldom taller than wide
+    m_pEyeCenterKernel = make_shared<EyeCenterKernel>(cv::Size(kFastEyeWidth, kFastEyeWidth));
+
     m_useHaarCascades = edCfg["useHaarCascade"].GetBool();
 
+    if (edCfg.HasMember("parallelEyeSearch"))
+    {
+        m_parallelEyeSearch = edCfg["parallelEyeSearch"].GetBool();
+    }
+
+    if (edCfg.HasMember("coarseToFine"))
+    {
+        auto & coarseToFineCfg = edCfg["coarseToFine"];
+        m_coarseToFine = coarseToFineCfg["enabled"].GetBool();
+        m_coarseEyeWidth = coarseToFineCfg["coarseEyeWidth"].GetInt();
+        m_refineRadius = coarseToFineCfg["refineRadius"].GetInt();
+    }
+
     if (m_useHaarCascades)
     {
         const auto loadCascade = [&edCfg](const string & eyeName) {
@@ -29,6 +54,13 @@ void EyeDetector::configure(rapidjson::Value & cfg)
 }
 
 bool EyeDetector::detectLandMarks(const cv::Mat & grayImage, LandMarks & landMarks)
+{
+    return detectLandMarksWithFeatures(grayImage, nullptr, landMarks);
+}
+
+bool EyeDetector::detectLandMarksWithFeatures(const cv::Mat & grayImage,
+                                              const HaarFeaturesSPtr & pImageFeatures,
+                                              LandMarks & landMarks)
 {
     const auto & faceRect = landMarks.vjFaceRect;
 
@@ -56,55 +88,34 @@ bool EyeDetector::detectLandMarks(const cv::Mat & grayImage, LandMarks & landMar
                             eyeRegionWidth,
                             eyeRegionHeight);
 
-    const auto leftEyeImage = faceImage(leftEyeRegion);
-    const auto rightEyeImage = faceImage(rightEyeRegion);
+    // Both eyes (and the mouth) are searched on the same shared features
+    HaarFeaturesSPtr pFeatures;
     if (m_useHaarCascades)
     {
-        const auto leftEyeHaarRect = detectWithHaarCascadeClassifier(leftEyeImage, m_leftEyeCascadeClassifier.get());
-        const auto rightEyeHaarRect = detectWithHaarCascadeClassifier(rightEyeImage, m_rightEyeCascadeClassifier.get());
-
-        landMarks.vjLeftEyeRect = leftEyeHaarRect;
-        landMarks.vjRightEyeRect = rightEyeHaarRect;
-
-        landMarks.vjLeftEyeRect.x += faceRect.x + leftEyeRegion.x;
-        landMarks.vjLeftEyeRect.y += faceRect.y + leftEyeRegion.y;
-
-        landMarks.vjRightEyeRect.x += faceRect.x + rightEyeRegion.x;
-        landMarks.vjRightEyeRect.y += faceRect.y + rightEyeRegion.y;
-
-        if (leftEyeHaarRect.width > 0 && leftEyeHaarRect.height > 0)
-        {
-            // Reduce the search area for the pupils
-            leftEyeRegion.x += leftEyeHaarRect.x;
-            leftEyeRegion.y += leftEyeHaarRect.y;
-            leftEyeRegion.width = leftEyeHaarRect.width;
-            leftEyeRegion.height = leftEyeHaarRect.height;
-        }
-        if (rightEyeHaarRect.width > 0 && rightEyeHaarRect.height > 0)
-        {
-            rightEyeRegion.x += rightEyeHaarRect.x;
-            rightEyeRegion.y += rightEyeHaarRect.y;
-            rightEyeRegion.width = rightEyeHaarRect.width;
-            rightEyeRegion.height = rightEyeHaarRect.height;
-        }
+        pFeatures = pImageFeatures ? pImageFeatures : m_pHaarFeatureCache->features(grayImage);
     }
 
-    //-- Find Eye Centers
-    auto leftEyeCenter = findEyeCenter(faceImage(leftEyeRegion));
-    auto rightEyeCenter = findEyeCenter(faceImage(rightEyeRegion));
-
-    //-- If eye center touches or is very close to the eye ROI apply fallback method
-    validateAndApplyFallbackIfRequired(leftEyeRegion.size(), leftEyeCenter);
-    validateAndApplyFallbackIfRequired(rightEyeRegion.size(), rightEyeCenter);
-
-    // Change eye centers to face coordinates
-    rightEyeCenter.x += rightEyeRegion.x + faceRect.x;
-    rightEyeCenter.y += rightEyeRegion.y + faceRect.y;
-    leftEyeCenter.x += leftEyeRegion.x + faceRect.x;
-    leftEyeCenter.y += leftEyeRegion.y + faceRect.y;
-
-    landMarks.eyeLeftPupil = leftEyeCenter;
-    landMarks.eyeRightPupil = rightEyeCenter;
+    // The eyes don't depend on each other, they are searched in independent stages
+    StageGraph stageGraph(m_parallelEyeSearch ? m_pThreadPool : nullptr);
+    stageGraph.addStage([&]() {
+        landMarks.eyeLeftPupil = locateEye(faceImage,
+                                           faceRect,
+                                           leftEyeRegion,
+                                           pFeatures.get(),
+                                           m_leftEyeCascadeClassifier.get(),
+                                           landMarks.vjLeftEyeRect);
+        return true;
+    });
+    stageGraph.addStage([&]() {
+        landMarks.eyeRightPupil = locateEye(faceImage,
+                                            faceRect,
+                                            rightEyeRegion,
+                                            pFeatures.get(),
+                                            m_rightEyeCascadeClassifier.get(),
+                                            landMarks.vjRightEyeRect);
+        return true;
+    });
+    stageGraph.run();
 
     return true;
 }
@@ -125,15 +136,45 @@ void EyeDetector::validateAndApplyFallbackIfRequired(const cv::Size & eyeRoiSize
     }
 }
 
-cv::Rect EyeDetector::detectWithHaarCascadeClassifier(const cv::Mat & image, cv::CascadeClassifier * cc)
+cv::Point EyeDetector::locateEye(const cv::Mat & faceImage,
+                                 const cv::Rect & faceRect,
+                                 cv::Rect eyeRegion,
+                                 const HaarFeatures * pFeatures,
+                                 const HaarCascade * pCascade,
+                                 cv::Rect & eyeRect) const
+{
+    if (pFeatures && pCascade)
+    {
+        const auto eyeHaarRect = detectWithHaarCascadeClassifier(*pFeatures, eyeRegion + faceRect.tl(), *pCascade);
+        eyeRect = eyeHaarRect + faceRect.tl() + eyeRegion.tl();
+
+        if (eyeHaarRect.width > 0 && eyeHaarRect.height > 0)
+        {
+            // Reduce the search area for the pupil
+            eyeRegion = eyeHaarRect + eyeRegion.tl();
+        }
+    }
+
+    auto eyeCenter = findEyeCenter(faceImage(eyeRegion));
+
+    //-- If eye center touches or is very close to the eye ROI apply fallback method
+    validateAndApplyFallbackIfRequired(eyeRegion.size(), eyeCenter);
+
+    // Change eye center to image coordinates
+    return eyeCenter + eyeRegion.tl() + faceRect.tl();
+}
+
+cv::Rect EyeDetector::detectWithHaarCascadeClassifier(const HaarFeatures & features,
+                                                      const cv::Rect & roi,
+                                                      const HaarCascade & cascade)
 {
-    vector<cv::Rect> results;
-    cc->detectMultiScale(image, results, 1.05, 3, cv::CASCADE_SCALE_IMAGE | cv::CASCADE_FIND_BIGGEST_OBJECT);
-    if (results.empty() || results.size() > 1)
+    // Ambiguous results are rejected, the whole eye region is then searched for the pupil
+    const auto results = cascade.detect(features, roi, 3);
+    if (results.size() != 1)
     {
         return cv::Rect();
     }
-    return results.front();
+    return results.front() - roi.tl();
 }
 
 void EyeDetector::createCornerKernels()
@@ -152,7 +193,40 @@ cv::Point EyeDetector::findEyeCenter(const cv::Mat & eyeROIUnscaled) const
 {
     cv::Mat eyeRoi;
     scaleToFastSize(eyeROIUnscaled, eyeRoi);
+    const cv::Rect eyeRoiRect(cv::Point(0, 0), eyeRoi.size());
 
+    cv::Point eyeCenter;
+    if (m_coarseToFine && m_coarseEyeWidth < eyeRoi.cols)
+    {
+        // Locate the pupil in a smaller image first, then only evaluate the centers around it at the fast size
+        cv::Mat coarseEyeRoi;
+        const auto coarseScale = static_cast<double>(m_coarseEyeWidth) / eyeRoi.cols;
+        resize(eyeRoi,
+               coarseEyeRoi,
+               cv::Size(m_coarseEyeWidth, std::max(1, ROUND_INT(eyeRoi.rows * coarseScale))),
+               0,
+               0,
+               cv::INTER_AREA);
+        const auto coarseCenter
+            = locateEyeCenter(coarseEyeRoi, cv::Rect(cv::Point(0, 0), coarseEyeRoi.size()), m_enablePostProcess);
+
+        const cv::Point candidate(ROUND_INT((coarseCenter.x + 0.5) / coarseScale - 0.5),
+                                  ROUND_INT((coarseCenter.y + 0.5) / coarseScale - 0.5));
+        const cv::Rect window(candidate.x - m_refineRadius,
+                              candidate.y - m_refineRadius,
+                              2 * m_refineRadius + 1,
+                              2 * m_refineRadius + 1);
+        eyeCenter = locateEyeCenter(eyeRoi, window & eyeRoiRect, false);
+    }
+    else
+    {
+        eyeCenter = locateEyeCenter(eyeRoi, eyeRoiRect, m_enablePostProcess);
+    }
+    return unscalePoint(eyeCenter, cv::Rect(cv::Point(0, 0), eyeROIUnscaled.size()));
+}
+
+cv::Point EyeDetector::locateEyeCenter(const cv::Mat & eyeRoi, const cv::Rect & centers, bool postProcess) const
+{
     //-- Find the gradient
     cv::Mat gradientX, gradientY;
 
@@ -196,26 +270,14 @@ cv::Point EyeDetector::findEyeCenter(const cv::Mat & eyeROIUnscaled) const
     weight = -weight + 255;
 
     //-- Run the algorithm!
-    cv::Mat outSum = cv::Mat::zeros(eyeRoi.rows, eyeRoi.cols, CV_64F);
-    // for each possible gradient location
-    // Note: these loops are reversed from the way the paper does them
-    // it evaluates every possible center for each gradient location instead of
-    // every possible gradient location for every center.
+    // Taller regions than the ones the kernel was created for get a kernel of their own
+    const auto pEyeCenterKernel = eyeRoi.rows <= m_pEyeCenterKernel->maxSize().height
+        ? m_pEyeCenterKernel
+        : make_shared<EyeCenterKernel>(eyeRoi.size());
+    cv::Mat outSum;
+    pEyeCenterKernel->accumulate(
+        gradientX, gradientY, kEnableWeight ? weight : cv::Mat(), kWeightDivisor, centers, outSum);
 
-    for (int y = 0; y < weight.rows; ++y)
-    {
-        const unsigned char * Wr = weight.ptr<unsigned char>(y);
-        const double *Xr = gradientX.ptr<double>(y), *Yr = gradientY.ptr<double>(y);
-        for (int x = 0; x < weight.cols; ++x)
-        {
-            double gX = Xr[x], gY = Yr[x];
-            if (gX == 0.0 && gY == 0.0)
-            {
-                continue;
-            }
-            testPossibleCentersFormula(x, y, Wr[x], gX, gY, outSum);
-        }
-    }
     // scale all the values down, basically averaging them
     double numGradients = weight.rows * weight.cols;
     cv::Mat out;
@@ -227,7 +289,7 @@ cv::Point EyeDetector::findEyeCenter(const cv::Mat & eyeROIUnscaled) const
     minMaxLoc(out, nullptr, &maxVal, nullptr, &maxP);
 
     //-- Flood fill the edges
-    if (m_enablePostProcess)
+    if (postProcess)
     {
         cv::Mat floodClone;
         // double floodThresh = computeDynamicThreshold(out, 1.5);
@@ -238,7 +300,7 @@ cv::Point EyeDetector::findEyeCenter(const cv::Mat & eyeROIUnscaled) const
         // redo max
         minMaxLoc(out, nullptr, &maxVal, nullptr, &maxP, mask);
     }
-    return unscalePoint(maxP, cv::Rect(cv::Point(0, 0), eyeROIUnscaled.size()));
+    return maxP + centers.tl();
 }
 
 cv::Point EyeDetector::unscalePoint(cv::Point p, cv::Rect origSize) const
@@ -254,82 +316,16 @@ void EyeDetector::scaleToFastSize(const cv::Mat & src, cv::Mat & dst) const
     resize(src, dst, cv::Size(kFastEyeWidth, static_cast<int>(static_cast<float>(kFastEyeWidth) / src.cols * src.rows)));
 }
 
-void EyeDetector::testPossibleCentersFormula(int x, int y, unsigned char weight, double gx, double gy, cv::Mat & out) const
-{
-    // for all possible centers
-    for (auto cy = 0; cy < out.rows; ++cy)
-    {
-        auto Or = out.ptr<double>(cy);
-        for (auto cx = 0; cx < out.cols; ++cx)
-        {
-            if (x == cx && y == cy)
-            {
-                continue;
-            }
-            // create a vector from the possible center to the gradient origin
-            double dx = x - cx;
-            double dy = y - cy;
-            // normalize d
-            const auto magnitude = sqrt((dx * dx) + (dy * dy));
-            dx = dx / magnitude;
-            dy = dy / magnitude;
-            auto dotProduct = dx * gx + dy * gy;
-            dotProduct = std::max(0.0, dotProduct);
-            // square and multiply by the weight
-            if (kEnableWeight)
-            {
-                Or[cx] += dotProduct * dotProduct * (weight / kWeightDivisor);
-            }
-            else
-            {
-                Or[cx] += dotProduct * dotProduct;
-            }
-        }
-    }
-}
-
-bool floodShouldPushPoint(const cv::Point & np, const cv::Mat & mat)
+cv::Mat EyeDetector::floodKillEdges(const cv::Mat & mat) const
 {
-    return np.x >= 0 && np.x < mat.cols && np.y >= 0 && np.y < mat.rows;
-}
-
-cv::Mat EyeDetector::floodKillEdges(cv::Mat & mat) const
-{
-    rectangle(mat, cv::Rect(0, 0, mat.cols, mat.rows), 255);
-
-    cv::Mat mask(mat.rows, mat.cols, CV_8U, 255);
-    std::queue<cv::Point> toDo;
-    toDo.push(cv::Point(0, 0));
-    while (!toDo.empty())
-    {
-        const auto p = toDo.front();
-        toDo.pop();
-        if (mat.at<float>(p) == 0.0f)
-        {
-            continue;
-        }
-
-        // add in every direction
-        cv::Point np(p.x + 1, p.y); // right
-        if (floodShouldPushPoint(np, mat))
-            toDo.push(np);
-        np.x = p.x - 1;
-        np.y = p.y; // left
-        if (floodShouldPushPoint(np, mat))
-            toDo.push(np);
-        np.x = p.x;
-        np.y = p.y + 1; // down
-        if (floodShouldPushPoint(np, mat))
-            toDo.push(np);
-        np.x = p.x;
-        np.y = p.y - 1; // up
-        if (floodShouldPushPoint(np, mat))
-            toDo.push(np);
-        // kill it
-        mat.at<float>(p) = 0.0f;
-        mask.at<uchar>(p) = 0;
-    }
-    return mask;
+    // Non zero pixels, with the image border among them so all the regions touching it are connected
+    cv::Mat regions = mat != 0;
+    rectangle(regions, cv::Rect(0, 0, regions.cols, regions.rows), 255);
+
+    // Scanline flood fill of the region connected to the border (4-connectivity), every other pixel is kept
+    const uchar borderRegion = 128;
+    floodFill(regions, cv::Point(0, 0), borderRegion, nullptr, 0, 0, 4);
+    return regions != borderRegion;
 }
 
 cv::Mat EyeDetector::matrixMagnitude(const cv::Mat & matX, const cv::Mat & matY) const
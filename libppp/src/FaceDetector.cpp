@@ -1,90 +1,327 @@
 #include "FaceDetector.h"
+#include "CnnFaceDetector.h"
+#include "HaarCascade.h"
+#include "HaarFeatureCache.h"
+#include "HaarFeatures.h"
+#include "HogPyramidDetector.h"
 #include "LandMarks.h"
+#include "ThreadPool.h"
 #include "Utilities.h"
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include <dlib/opencv/cv_image.h>
 #include <opencv2/core/mat.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/objdetect/objdetect.hpp>
 
 using namespace std;
 using namespace cv;
 
+FaceDetector::FaceDetector(ThreadPoolSPtr pThreadPool, HaarFeatureCacheSPtr pHaarFeatureCache)
+: m_pThreadPool(pThreadPool ? pThreadPool : make_shared<ThreadPool>())
+, m_pHaarFeatureCache(pHaarFeatureCache ? pHaarFeatureCache : make_shared<HaarFeatureCache>())
+, m_parallelRotationSearch(true)
+, m_useDlibFaceDetection(false)
+, m_escalateToHog(false)
+, m_minHaarFaceConfidence(0)
+, m_useCoarseSearch(false)
+, m_coarseSearchWorkingSize(480)
+, m_coarseSearchRefineMargin(0.25)
+, m_multiFaceMinFaceRatio(0.05)
+{
+}
+
 bool FaceDetector::detectLandMarks(const Mat & inputPicture, LandMarks & landmarks)
 {
-    if (m_useDlibFaceDetection)
+    // The MMOD network was trained on color images
+    if (m_pCnnFaceDetector)
     {
-        using namespace dlib;
-        array2d<uint8_t> dlibImage;
-        assign_image(dlibImage, cv_image<uint8_t>(inputPicture));
+        return m_pCnnFaceDetector->detectLandMarks(inputPicture, landmarks);
+    }
 
-        auto dets = (*m_frontalFaceDetector)(dlibImage);
+    auto grayImage = inputPicture;
+    if (inputPicture.channels() != 1)
+    {
+        cvtColor(inputPicture, grayImage, COLOR_BGR2GRAY);
+    }
 
-        if (dets.empty())
-        {
-            return false; // No face was found
-        }
+    int imageRotation;
+    vector<Face> faces;
+    if (!findFaces(grayImage, false, imageRotation, faces))
+    {
+        return false;
+    }
+    landmarks.vjFaceRect = faces.front().rect;
+    landmarks.faceConfidence = faces.front().confidence;
+    landmarks.imageRotation = imageRotation;
+    return true;
+}
+
+vector<LandMarks> FaceDetector::detectAllLandMarks(const Mat & inputPicture)
+{
+    if (m_pCnnFaceDetector)
+    {
+        return m_pCnnFaceDetector->detectAllLandMarks(inputPicture);
+    }
+
+    auto grayImage = inputPicture;
+    if (inputPicture.channels() != 1)
+    {
+        cvtColor(inputPicture, grayImage, COLOR_BGR2GRAY);
+    }
 
-        auto & faceRect = dets.front();
-        if (dets.size() > 1)
+    int imageRotation;
+    vector<Face> faces;
+    vector<LandMarks> facesLandmarks;
+    if (findFaces(grayImage, true, imageRotation, faces))
+    {
+        for (const auto & face : faces)
         {
-            const auto biggestFacePtr = std::max_element(dets.begin(),
-                                                         dets.end(),
-                                                         [](const dlib::rectangle & r1, const dlib::rectangle & r2) {
-                                                             return r1.area() < r2.area();
-                                                         });
-            faceRect = *biggestFacePtr;
+            LandMarks landmarks;
+            landmarks.vjFaceRect = face.rect;
+            landmarks.faceConfidence = face.confidence;
+            landmarks.imageRotation = imageRotation;
+            facesLandmarks.push_back(landmarks);
         }
-        landmarks.vjFaceRect = Utilities::convert(faceRect);
-        landmarks.imageRotation = 0; // TODO: Add rotation search to this one as well
-        return true;
     }
-    else
+    return facesLandmarks;
+}
+
+bool FaceDetector::findFaces(const Mat & grayImage, bool allFaces, int & imageRotation, vector<Face> & faces) const
+{
+    if (!m_escalateToHog)
     {
+        return searchFaces(
+            grayImage, m_useDlibFaceDetection ? hogFaceSearch() : haarFaceSearch(), allFaces, imageRotation, faces);
+    }
 
-        // Configuration
-        const auto minFaceRatio = 0.15;
-        const auto maxFaceRatio = 0.85;
+    // Clear faces are accepted from the cheap Haar cascade, the rest are searched again with the HOG detector
+    int haarImageRotation;
+    vector<Face> haarFaces;
+    const auto haarFound = searchFaces(grayImage, haarFaceSearch(), allFaces, haarImageRotation, haarFaces);
+    if (haarFound && haarFaces.front().confidence >= m_minHaarFaceConfidence)
+    {
+        imageRotation = haarImageRotation;
+        faces = haarFaces;
+        return true;
+    }
+    if (searchFaces(grayImage, hogFaceSearch(), allFaces, imageRotation, faces))
+    {
+        return true;
+    }
+    if (haarFound)
+    {
+        // A weak face is still better than no face
+        imageRotation = haarImageRotation;
+        faces = haarFaces;
+    }
+    return haarFound;
+}
 
-        // Calculate search domain on the image
-        const auto imgSize = inputPicture.size();
-        const auto h = imgSize.height;
-        const auto w = imgSize.width;
+FaceDetector::FaceSearch FaceDetector::haarFaceSearch() const
+{
+    const auto pCascade = m_pFaceCascade;
+    const auto pFeatureCache = m_pHaarFeatureCache;
+    // The cascade scans the image at once, the search can't be cancelled
+    return [pCascade, pFeatureCache](const Mat & image,
+                                     const Size & minFaceSize,
+                                     const Size & maxFaceSize,
+                                     vector<Face> & faces,
+                                     const function<bool()> &) {
+        // The image can be a region of a larger one (e.g. when refining the face) whose features are reused.
+        // Rotated copies of the image are only searched once, so their features are not cached
+        Size wholeSize;
+        Point offset;
+        image.locateROI(wholeSize, offset);
+        const auto pFeatures = pFeatureCache->features(image, false);
+        vector<int> numNeighbors;
+        const auto facesRects
+            = pCascade->detect(*pFeatures, Rect(offset, image.size()), 4, numNeighbors, minFaceSize, maxFaceSize);
 
-        auto grayImage = inputPicture;
-        if (inputPicture.channels() != 1)
+        faces.clear();
+        for (size_t i = 0; i < facesRects.size(); ++i)
         {
-            cvtColor(inputPicture, grayImage, COLOR_BGR2GRAY);
+            faces.push_back(Face { facesRects[i] - offset, static_cast<double>(numNeighbors[i]) });
         }
+        sortBiggestFirst(faces);
+        return !faces.empty();
+    };
+}
 
-        for (const auto angle : { 0, 90, -90, 180 })
+FaceDetector::FaceSearch FaceDetector::hogFaceSearch() const
+{
+    const auto toFaces = [](const std::vector<dlib::rect_detection> & dets, vector<Face> & faces) {
+        faces.clear();
+        for (const auto & det : dets)
         {
+            faces.push_back(Face { Utilities::convert(det.rect), det.detection_confidence });
+        }
+        sortBiggestFirst(faces);
+        return !faces.empty();
+    };
+
+    if (m_pHogPyramidDetector)
+    {
+        // Only the pyramid levels where faces of the expected sizes are found get scanned
+        const auto pHogPyramidDetector = m_pHogPyramidDetector;
+        return [pHogPyramidDetector, toFaces](const Mat & image,
+                                              const Size & minFaceSize,
+                                              const Size & maxFaceSize,
+                                              vector<Face> & faces,
+                                              const function<bool()> & isCancelled) {
+            return toFaces(pHogPyramidDetector->detect(image, minFaceSize.width, maxFaceSize.width, isCancelled),
+                           faces);
+        };
+    }
+
+    // The HOG detector scans a fixed range of scales, so the face size limits don't apply
+    const auto pDetectors = m_pFrontalFaceDetectors;
+    return [pDetectors, toFaces](
+               const Mat & image, const Size &, const Size &, vector<Face> & faces, const function<bool()> &) {
+        const auto pDetector = pDetectors->acquire();
+        std::vector<dlib::rect_detection> dets;
+        (*pDetector)(dlib::cv_image<uint8_t>(image), dets);
+        return toFaces(dets, faces);
+    };
+}
+
+void FaceDetector::sortBiggestFirst(vector<Face> & faces)
+{
+    // Faces of the same size keep the order of the detector
+    stable_sort(faces.begin(), faces.end(), [](const Face & f1, const Face & f2) {
+        return f1.rect.area() > f2.rect.area();
+    });
+}
+
+bool FaceDetector::searchFaces(const Mat & grayImage,
+                               const FaceSearch & faceSearch,
+                               bool allFaces,
+                               int & imageRotation,
+                               vector<Face> & faces) const
+{
+    const auto imageLongSide = std::max(grayImage.cols, grayImage.rows);
+    if (!m_useCoarseSearch || imageLongSide <= m_coarseSearchWorkingSize)
+    {
+        return rotationSearch(grayImage, faceSearch, allFaces, imageRotation, faces);
+    }
+
+    const auto scale = static_cast<double>(m_coarseSearchWorkingSize) / imageLongSide;
+    Mat workingImage;
+    resize(grayImage, workingImage, Size(), scale, scale, INTER_AREA);
+    if (!rotationSearch(workingImage, faceSearch, allFaces, imageRotation, faces))
+    {
+        return false;
+    }
+
+    // The faces were found in the rotated image, so they are refined in the rotated input image
+    const auto rotatedImage = Utilities::rotateImage(grayImage, imageRotation);
+    for (auto & face : faces)
+    {
+        refineFace(rotatedImage, scale, faceSearch, face);
+    }
+    sortBiggestFirst(faces);
+    return true;
+}
+
+bool FaceDetector::rotationSearch(const Mat & grayImage,
+                                  const FaceSearch & faceSearch,
+                                  bool allFaces,
+                                  int & imageRotation,
+                                  vector<Face> & faces) const
+{
+    static const vector<int> angles = { 0, 90, -90, 180 };
+
+    // Calculate search domain on the image, faces in group photos are smaller
+    const auto minFaceRatio = allFaces ? m_multiFaceMinFaceRatio : 0.15;
+    const auto maxFaceRatio = 0.85;
+    Size minFaceSize, maxFaceSize;
+    calculateScaleSearch(grayImage.size(), minFaceRatio, maxFaceRatio, minFaceSize, maxFaceSize);
+
+    // Index of the orientation with highest priority where a face was found so far
+    const auto pBestIndex = make_shared<atomic<size_t>>(angles.size());
+
+    vector<future<pair<bool, vector<Face>>>> searchResults;
+    for (size_t i = 0; i < angles.size(); ++i)
+    {
+        // The task only captures by value as it might still run after this method returns
+        const auto angle = angles[i];
+        const auto searchAtAngle = [grayImage, angle, i, pBestIndex, faceSearch, minFaceSize, maxFaceSize]() {
+            vector<Face> facesAtAngle;
+            if (*pBestIndex < i)
+            {
+                // A face was already found in an orientation with higher priority
+                return make_pair(false, facesAtAngle);
+            }
+
             // Let's rotate the image to see if we can find a face in it
-            auto rotatedImage = Utilities::rotateImage(grayImage, angle);
-            Size minFaceSize, maxFaceSize;
-            calculateScaleSearch(imgSize, minFaceRatio, maxFaceRatio, minFaceSize, maxFaceSize);
-
-            vector<Rect> facesRects;
-            vector<int> rejectLevels;
-            vector<double> levelWeights;
-            m_pFaceCascadeClassifier->detectMultiScale(rotatedImage,
-                                                       facesRects,
-                                                       1.05,
-                                                       4,
-                                                       CASCADE_SCALE_IMAGE | CASCADE_FIND_BIGGEST_OBJECT,
-                                                       minFaceSize,
-                                                       maxFaceSize);
-
-            if (!facesRects.empty())
+            const auto rotatedImage = Utilities::rotateImage(grayImage, angle);
+
+            // The search stops as soon as a face is found in an orientation with higher priority
+            const auto isCancelled = [pBestIndex, i]() { return *pBestIndex < i; };
+            if (!faceSearch(rotatedImage, minFaceSize, maxFaceSize, facesAtAngle, isCancelled) || isCancelled())
+            {
+                return make_pair(false, facesAtAngle);
+            }
+
+            auto bestIndex = pBestIndex->load();
+            while (i < bestIndex && !pBestIndex->compare_exchange_weak(bestIndex, i))
+            {
+            }
+            return make_pair(true, facesAtAngle);
+        };
+
+        // Sequential searches are deferred, so they only run while no face was found
+        searchResults.push_back(m_parallelRotationSearch ? m_pThreadPool->submit(searchAtAngle)
+                                                         : async(launch::deferred, searchAtAngle));
+    }
+
+    // Results are collected in priority order, the remaining searches are abandoned at the first hit
+    for (size_t i = 0; i < angles.size(); ++i)
+    {
+        auto searchResult = searchResults[i].get();
+        if (searchResult.first)
+        {
+            faces = move(searchResult.second);
+            if (!allFaces)
             {
-                landmarks.vjFaceRect = facesRects.front();
-                landmarks.imageRotation = angle;
-                return true;
+                faces.resize(1);
             }
+            imageRotation = angles[i];
+            return true;
         }
-        return false;
+    }
+    return false;
+}
+
+void FaceDetector::refineFace(const Mat & rotatedGrayImage,
+                              double scale,
+                              const FaceSearch & faceSearch,
+                              Face & face) const
+{
+    const auto & coarseRect = face.rect;
+    const Rect faceRect(ROUND_INT(coarseRect.x / scale),
+                        ROUND_INT(coarseRect.y / scale),
+                        ROUND_INT(coarseRect.width / scale),
+                        ROUND_INT(coarseRect.height / scale));
+    face.rect = faceRect;
+
+    const auto margin = ROUND_INT(std::max(faceRect.width, faceRect.height) * m_coarseSearchRefineMargin);
+    Rect searchRoi(faceRect.tl() - Point(margin, margin), faceRect.br() + Point(margin, margin));
+    searchRoi &= Rect(Point(), rotatedGrayImage.size());
+
+    const auto minFaceSizePix = ROUND_INT(faceRect.width * (1.0 - m_coarseSearchRefineMargin));
+    const auto maxFaceSizePix = ROUND_INT(faceRect.width * (1.0 + m_coarseSearchRefineMargin));
+    vector<Face> refinedFaces;
+    if (faceSearch(rotatedGrayImage(searchRoi),
+                   Size(minFaceSizePix, minFaceSizePix),
+                   Size(maxFaceSizePix, maxFaceSizePix),
+                   refinedFaces,
+                   nullptr))
+    {
+        face.rect = refinedFaces.front().rect + searchRoi.tl();
+        face.confidence = refinedFaces.front().confidence;
     }
 }
 
@@ -101,15 +338,88 @@ void FaceDetector::calculateScaleSearch(const Size & inputImageSize,
     maxFaceSize = Size(maxFaceSizePix, maxFaceSizePix);
 }
 
+dlib::frontal_face_detector FaceDetector::selectHogFilters(const dlib::frontal_face_detector & detector,
+                                                           const vector<unsigned long> & filterIndices)
+{
+    if (filterIndices.empty())
+    {
+        throw std::runtime_error("At least one HOG filter has to be selected for the face detector");
+    }
+
+    vector<dlib::frontal_face_detector::feature_vector_type> weights;
+    for (const auto filterIndex : filterIndices)
+    {
+        if (filterIndex >= detector.num_detectors())
+        {
+            throw std::runtime_error("Invalid HOG filter index " + to_string(filterIndex) + ", the face detector has "
+                                     + to_string(detector.num_detectors()) + " filters");
+        }
+        weights.push_back(detector.get_w(filterIndex));
+    }
+    return dlib::frontal_face_detector(detector.get_scanner(), detector.get_overlap_tester(), weights);
+}
+
 void FaceDetector::configure(rapidjson::Value & config)
 {
-    const auto xmlBase64Data(config["faceDetector"]["haarCascade"]["data"].GetString());
-    m_pFaceCascadeClassifier = Utilities::loadClassifierFromBase64(xmlBase64Data);
+    auto & faceDetectorCfg = config["faceDetector"];
+    m_pFaceCascade = Utilities::loadClassifierFromBase64(faceDetectorCfg["haarCascade"]["data"].GetString());
+
+    if (faceDetectorCfg.HasMember("parallelRotationSearch"))
+    {
+        m_parallelRotationSearch = faceDetectorCfg["parallelRotationSearch"].GetBool();
+    }
+
+    if (faceDetectorCfg.HasMember("coarseSearch"))
+    {
+        auto & coarseSearchCfg = faceDetectorCfg["coarseSearch"];
+        m_useCoarseSearch = coarseSearchCfg["enabled"].GetBool();
+        m_coarseSearchWorkingSize = coarseSearchCfg["workingSize"].GetInt();
+        m_coarseSearchRefineMargin = coarseSearchCfg["refineMargin"].GetDouble();
+    }
+
+    if (faceDetectorCfg.HasMember("multiFace"))
+    {
+        m_multiFaceMinFaceRatio = faceDetectorCfg["multiFace"]["minFaceRatio"].GetDouble();
+    }
 
     m_useDlibFaceDetection = config["useDlibFaceDetection"].GetBool();
 
-    if (m_useDlibFaceDetection)
+    m_pCnnFaceDetector.reset();
+    if (config.HasMember("cnnFaceDetector") && config["cnnFaceDetector"]["enabled"].GetBool())
+    {
+        m_pCnnFaceDetector = make_shared<CnnFaceDetector>();
+        m_pCnnFaceDetector->configure(config);
+    }
+
+    m_escalateToHog = false;
+    if (config.HasMember("detectorEscalation"))
+    {
+        auto & escalationCfg = config["detectorEscalation"];
+        m_escalateToHog = escalationCfg["enabled"].GetBool();
+        m_minHaarFaceConfidence = escalationCfg["minHaarFaceConfidence"].GetDouble();
+    }
+
+    if (m_useDlibFaceDetection || m_escalateToHog)
     {
-        m_frontalFaceDetector = std::make_shared<dlib::frontal_face_detector>(dlib::get_frontal_face_detector());
+        auto pFrontalFaceDetector = make_shared<dlib::frontal_face_detector>(dlib::get_frontal_face_detector());
+        if (faceDetectorCfg.HasMember("hogFilters"))
+        {
+            vector<unsigned long> filterIndices;
+            for (const auto & filterIndex : faceDetectorCfg["hogFilters"].GetArray())
+            {
+                filterIndices.push_back(filterIndex.GetUint());
+            }
+            pFrontalFaceDetector = make_shared<dlib::frontal_face_detector>(
+                selectHogFilters(*pFrontalFaceDetector, filterIndices));
+        }
+        m_pFrontalFaceDetectors = make_shared<ObjectPool<dlib::frontal_face_detector>>(
+            [pFrontalFaceDetector]() { return make_shared<dlib::frontal_face_detector>(*pFrontalFaceDetector); });
+
+        m_pHogPyramidDetector.reset();
+        if (faceDetectorCfg.HasMember("hogPyramid") && faceDetectorCfg["hogPyramid"]["parallel"].GetBool())
+        {
+            m_pHogPyramidDetector = make_shared<HogPyramidDetector>(*pFrontalFaceDetector, *m_pThreadPool);
+            m_pHogPyramidDetector->setTileSize(faceDetectorCfg["hogPyramid"]["tileSize"].GetInt());
+        }
     }
 }
@@ -0,0 +1,485 @@
+#include "HaarCascade.h"
+#include "HaarFeatures.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <opencv2/objdetect/objdetect.hpp>
+
+using namespace std;
+
+namespace
+{
+// Same margin OpenCV applies to the stage thresholds when loading a cascade
+const float kStageThresholdEpsilon = 1e-5f;
+
+const char kBinaryMagic[4] = { 'P', 'P', 'H', 'C' };
+const uint32_t kBinaryVersion = 1;
+
+///<- Header of the binary cascades, followed by the arrays of features, nodes, leaves, trees and stages
+struct BinaryHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t windowWidth;
+    int32_t windowHeight;
+    uint32_t numFeatures;
+    uint32_t numNodes;
+    uint32_t numLeaves;
+    uint32_t numTrees;
+    uint32_t numStages;
+};
+
+template <typename T>
+const uint8_t * readArray(const uint8_t * pData, uint32_t count, vector<T> & array)
+{
+    array.resize(count);
+    if (count > 0)
+    {
+        memcpy(static_cast<void *>(array.data()), pData, count * sizeof(T));
+    }
+    return pData + count * sizeof(T);
+}
+
+inline int rectSum(const int * pIntegral, const int * corners)
+{
+    return pIntegral[corners[0]] - pIntegral[corners[1]] - pIntegral[corners[2]] + pIntegral[corners[3]];
+}
+
+inline double rectSum(const double * pIntegral, const int * corners)
+{
+    return pIntegral[corners[0]] - pIntegral[corners[1]] - pIntegral[corners[2]] + pIntegral[corners[3]];
+}
+
+int alignUp(int value, int origin, int step)
+{
+    return origin + (value - origin + step - 1) / step * step;
+}
+} // namespace
+
+HaarCascade::HaarCascade(const cv::FileNode & cascadeNode)
+{
+    if (!cascadeNode["stageType"].empty())
+    {
+        readCascade(cascadeNode);
+    }
+    else if (!cascadeNode["size"].empty())
+    {
+        readOldCascade(cascadeNode);
+    }
+    else
+    {
+        throw runtime_error("Unknown Haar cascade format");
+    }
+    validate();
+}
+
+HaarCascade::HaarCascade(const void * data, size_t size)
+{
+    // The binary is written by build.py with the layout of these structures in little-endian byte order
+    static_assert(sizeof(Feature) == 64 && sizeof(Node) == 16 && sizeof(Tree) == 8 && sizeof(Stage) == 12,
+                  "Haar cascade structures don't match the binary format");
+    const uint32_t one = 1;
+    if (*reinterpret_cast<const uint8_t *>(&one) != 1)
+    {
+        throw runtime_error("Binary Haar cascades are only supported on little-endian platforms");
+    }
+    if (!isBinary(data, size))
+    {
+        throw runtime_error("Invalid binary Haar cascade");
+    }
+
+    BinaryHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.version != kBinaryVersion)
+    {
+        throw runtime_error("Unsupported binary Haar cascade version");
+    }
+    const auto expectedSize = sizeof(header) + static_cast<uint64_t>(header.numFeatures) * sizeof(Feature)
+        + static_cast<uint64_t>(header.numNodes) * sizeof(Node)
+        + static_cast<uint64_t>(header.numLeaves) * sizeof(float)
+        + static_cast<uint64_t>(header.numTrees) * sizeof(Tree)
+        + static_cast<uint64_t>(header.numStages) * sizeof(Stage);
+    if (size != expectedSize)
+    {
+        throw runtime_error("Invalid binary Haar cascade size");
+    }
+
+    m_windowSize = cv::Size(header.windowWidth, header.windowHeight);
+    auto pData = static_cast<const uint8_t *>(data) + sizeof(header);
+    pData = readArray(pData, header.numFeatures, m_features);
+    pData = readArray(pData, header.numNodes, m_nodes);
+    pData = readArray(pData, header.numLeaves, m_leaves);
+    pData = readArray(pData, header.numTrees, m_trees);
+    readArray(pData, header.numStages, m_stages);
+
+    // Thresholds are stored as in the XML files
+    for (auto & stage : m_stages)
+    {
+        stage.threshold -= kStageThresholdEpsilon;
+    }
+    validate();
+}
+
+bool HaarCascade::isBinary(const void * data, size_t size)
+{
+    return size >= sizeof(BinaryHeader) && memcmp(data, kBinaryMagic, sizeof(kBinaryMagic)) == 0;
+}
+
+cv::Size HaarCascade::windowSize() const
+{
+    return m_windowSize;
+}
+
+void HaarCascade::readCascade(const cv::FileNode & cascadeNode)
+{
+    if (static_cast<string>(cascadeNode["stageType"]) != "BOOST"
+        || static_cast<string>(cascadeNode["featureType"]) != "HAAR")
+    {
+        throw runtime_error("Only boosted cascades of Haar features are supported");
+    }
+
+    m_windowSize = cv::Size(static_cast<int>(cascadeNode["width"]), static_cast<int>(cascadeNode["height"]));
+
+    for (const auto & featureNode : cascadeNode["features"])
+    {
+        m_features.push_back(readFeature(featureNode));
+    }
+
+    for (const auto & stageNode : cascadeNode["stages"])
+    {
+        Stage stage { static_cast<int>(m_trees.size()),
+                      0,
+                      static_cast<float>(stageNode["stageThreshold"]) - kStageThresholdEpsilon };
+        for (const auto & weakClassifierNode : stageNode["weakClassifiers"])
+        {
+            // Every internal node is a sequence of left child, right child, feature index and threshold
+            vector<double> internalNodes;
+            vector<float> leafValues;
+            weakClassifierNode["internalNodes"] >> internalNodes;
+            weakClassifierNode["leafValues"] >> leafValues;
+            if (internalNodes.empty() || internalNodes.size() % 4 != 0)
+            {
+                throw runtime_error("Invalid Haar cascade tree");
+            }
+
+            m_trees.push_back(Tree { static_cast<int>(m_nodes.size()), static_cast<int>(m_leaves.size()) });
+            for (size_t i = 0; i < internalNodes.size(); i += 4)
+            {
+                m_nodes.push_back(Node { static_cast<int>(internalNodes[i + 2]),
+                                         static_cast<float>(internalNodes[i + 3]),
+                                         static_cast<int>(internalNodes[i]),
+                                         static_cast<int>(internalNodes[i + 1]) });
+            }
+            m_leaves.insert(m_leaves.end(), leafValues.begin(), leafValues.end());
+            ++stage.numTrees;
+        }
+        m_stages.push_back(stage);
+    }
+}
+
+void HaarCascade::readOldCascade(const cv::FileNode & cascadeNode)
+{
+    vector<int> windowSize;
+    cascadeNode["size"] >> windowSize;
+    if (windowSize.size() != 2)
+    {
+        throw runtime_error("Invalid Haar cascade window size");
+    }
+    m_windowSize = cv::Size(windowSize[0], windowSize[1]);
+
+    // The stages of the old format could form a tree, the ones used here are all chained one after the other
+    for (const auto & stageNode : cascadeNode["stages"])
+    {
+        Stage stage { static_cast<int>(m_trees.size()),
+                      0,
+                      static_cast<float>(stageNode["stage_threshold"]) - kStageThresholdEpsilon };
+        for (const auto & treeNode : stageNode["trees"])
+        {
+            m_trees.push_back(Tree { static_cast<int>(m_nodes.size()), static_cast<int>(m_leaves.size()) });
+            auto numLeaves = 0;
+            for (const auto & nodeNode : treeNode)
+            {
+                // Features are stored within the nodes that use them
+                Node node { static_cast<int>(m_features.size()), static_cast<float>(nodeNode["threshold"]), 0, 0 };
+                m_features.push_back(readFeature(nodeNode["feature"]));
+
+                const auto readChild = [this, &nodeNode, &numLeaves](const char * nodeName, const char * valueName) {
+                    if (!nodeNode[valueName].empty())
+                    {
+                        m_leaves.push_back(static_cast<float>(nodeNode[valueName]));
+                        return -numLeaves++;
+                    }
+                    return static_cast<int>(nodeNode[nodeName]);
+                };
+                node.left = readChild("left_node", "left_val");
+                node.right = readChild("right_node", "right_val");
+                m_nodes.push_back(node);
+            }
+            ++stage.numTrees;
+        }
+        m_stages.push_back(stage);
+    }
+}
+
+HaarCascade::Feature HaarCascade::readFeature(const cv::FileNode & featureNode)
+{
+    Feature feature {};
+    auto numRects = 0;
+    for (const auto & rectNode : featureNode["rects"])
+    {
+        vector<float> rect;
+        rectNode >> rect;
+        if (rect.size() != 5 || numRects == 3)
+        {
+            throw runtime_error("Invalid Haar feature rectangles");
+        }
+        feature.rects[numRects] = cv::Rect(cvRound(rect[0]), cvRound(rect[1]), cvRound(rect[2]), cvRound(rect[3]));
+        feature.weights[numRects] = rect[4];
+        ++numRects;
+    }
+    feature.tilted = static_cast<int>(featureNode["tilted"]) != 0 ? 1 : 0;
+    return feature;
+}
+
+void HaarCascade::validate() const
+{
+    if (m_stages.empty() || m_windowSize.width < 3 || m_windowSize.height < 3)
+    {
+        throw runtime_error("Invalid Haar cascade, no stages or detection window too small");
+    }
+
+    const cv::Rect window(cv::Point(), m_windowSize);
+    for (const auto & feature : m_features)
+    {
+        for (const auto & r : feature.rects)
+        {
+            // Tilted rectangles extend r.height to the left of their top corner and r.width + r.height down
+            const auto bounds = feature.tilted ? cv::Rect(r.x - r.height, r.y, r.width + r.height, r.width + r.height)
+                                               : r;
+            if (r.width < 0 || r.height < 0 || (bounds & window) != bounds)
+            {
+                throw runtime_error("Haar feature rectangle outside of the detection window");
+            }
+        }
+    }
+
+    const auto numNodes = static_cast<int>(m_nodes.size());
+    const auto numLeaves = static_cast<int>(m_leaves.size());
+    for (size_t t = 0; t < m_trees.size(); ++t)
+    {
+        // The nodes and leaves of a tree go up to the ones of the next tree
+        const auto & tree = m_trees[t];
+        const auto nodesEnd = t + 1 < m_trees.size() ? m_trees[t + 1].firstNode : numNodes;
+        const auto leavesEnd = t + 1 < m_trees.size() ? m_trees[t + 1].firstLeaf : numLeaves;
+        if (tree.firstNode < 0 || tree.firstNode >= nodesEnd || nodesEnd > numNodes || tree.firstLeaf < 0
+            || tree.firstLeaf > leavesEnd || leavesEnd > numLeaves)
+        {
+            throw runtime_error("Invalid Haar cascade tree");
+        }
+        for (auto n = tree.firstNode; n < nodesEnd; ++n)
+        {
+            const auto & node = m_nodes[n];
+            if (node.featureIndex < 0 || node.featureIndex >= static_cast<int>(m_features.size()))
+            {
+                throw runtime_error("Invalid feature index in Haar cascade");
+            }
+            for (const auto child : { node.left, node.right })
+            {
+                // Children always come after their parent, so evaluating a tree can't loop
+                if (child > 0 ? child <= n - tree.firstNode || child >= nodesEnd - tree.firstNode
+                              : child <= tree.firstLeaf - leavesEnd)
+                {
+                    throw runtime_error("Invalid child index in Haar cascade tree");
+                }
+            }
+        }
+    }
+
+    for (const auto & stage : m_stages)
+    {
+        if (stage.firstTree < 0 || stage.numTrees <= 0
+            || stage.firstTree + stage.numTrees > static_cast<int>(m_trees.size()))
+        {
+            throw runtime_error("Invalid Haar cascade stage");
+        }
+    }
+}
+
+vector<HaarCascade::FeatureOffsets> HaarCascade::featureOffsets(int integralStep) const
+{
+    vector<FeatureOffsets> offsets(m_features.size());
+    for (size_t i = 0; i < m_features.size(); ++i)
+    {
+        const auto & feature = m_features[i];
+        auto & featureOffsets = offsets[i];
+        featureOffsets.tilted = feature.tilted != 0;
+        for (auto k = 0; k < 3; ++k)
+        {
+            const auto & r = feature.rects[k];
+            auto & corners = featureOffsets.corners[k];
+            featureOffsets.weights[k] = feature.weights[k];
+            if (feature.tilted)
+            {
+                // Corners of the rectangle rotated 45 degrees around its top corner
+                corners[0] = r.x + integralStep * r.y;
+                corners[1] = r.x - r.height + integralStep * (r.y + r.height);
+                corners[2] = r.x + r.width + integralStep * (r.y + r.width);
+                corners[3] = r.x + r.width - r.height + integralStep * (r.y + r.width + r.height);
+            }
+            else
+            {
+                corners[0] = r.x + integralStep * r.y;
+                corners[1] = r.x + r.width + integralStep * r.y;
+                corners[2] = r.x + integralStep * (r.y + r.height);
+                corners[3] = r.x + r.width + integralStep * (r.y + r.height);
+            }
+        }
+    }
+    return offsets;
+}
+
+bool HaarCascade::evaluate(const vector<FeatureOffsets> & offsets,
+                           const int * pSum,
+                           const double * pSqSum,
+                           const int * pTiltedSum,
+                           int integralStep) const
+{
+    // Features are normalized by the standard deviation of the window (without its border)
+    const cv::Rect normRect(1, 1, m_windowSize.width - 2, m_windowSize.height - 2);
+    const int normCorners[4] = { normRect.x + integralStep * normRect.y,
+                                 normRect.br().x + integralStep * normRect.y,
+                                 normRect.x + integralStep * normRect.br().y,
+                                 normRect.br().x + integralStep * normRect.br().y };
+    const auto area = static_cast<double>(normRect.area());
+    const auto valueSum = static_cast<double>(rectSum(pSum, normCorners));
+    const auto normFactor = area * rectSum(pSqSum, normCorners) - valueSum * valueSum;
+    if (normFactor <= 0)
+    {
+        return false;
+    }
+    const auto varianceNormFactor = 1.0 / sqrt(normFactor);
+    if (area * varianceNormFactor >= 0.1)
+    {
+        // Nearly flat windows are rejected right away, as OpenCV does
+        return false;
+    }
+
+    for (const auto & stage : m_stages)
+    {
+        auto stageSum = 0.0;
+        for (auto t = stage.firstTree; t < stage.firstTree + stage.numTrees; ++t)
+        {
+            const auto & tree = m_trees[t];
+            auto nodeIndex = 0;
+            do
+            {
+                const auto & node = m_nodes[tree.firstNode + nodeIndex];
+                const auto & feature = offsets[node.featureIndex];
+                const auto pIntegral = feature.tilted ? pTiltedSum : pSum;
+                auto value = feature.weights[0] * rectSum(pIntegral, feature.corners[0])
+                    + feature.weights[1] * rectSum(pIntegral, feature.corners[1]);
+                if (feature.weights[2] != 0.0f)
+                {
+                    value += feature.weights[2] * rectSum(pIntegral, feature.corners[2]);
+                }
+                nodeIndex = value * varianceNormFactor < node.threshold ? node.left : node.right;
+            } while (nodeIndex > 0);
+            stageSum += m_leaves[tree.firstLeaf - nodeIndex];
+        }
+        if (stageSum < stage.threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<cv::Rect> HaarCascade::detect(const HaarFeatures & features,
+                                     const cv::Rect & roi,
+                                     int minNeighbors,
+                                     const cv::Size & minSize,
+                                     const cv::Size & maxSize) const
+{
+    vector<int> numNeighbors;
+    return detect(features, roi, minNeighbors, numNeighbors, minSize, maxSize);
+}
+
+vector<cv::Rect> HaarCascade::detect(const HaarFeatures & features,
+                                     const cv::Rect & roi,
+                                     int minNeighbors,
+                                     vector<int> & numNeighbors,
+                                     const cv::Size & minSize,
+                                     const cv::Size & maxSize) const
+{
+    if (m_windowSize.width > features.maxWindowSize() || m_windowSize.height > features.maxWindowSize())
+    {
+        throw logic_error("Haar cascade window is larger than the one supported by the features");
+    }
+
+    const auto searchRoi = roi & cv::Rect(cv::Point(), features.grayImage().size());
+    const auto maxObjectSize = maxSize.area() > 0 ? maxSize : searchRoi.size();
+    const auto integralStep = features.integralStep();
+    const auto tileSize = features.tileSize();
+    const auto offsets = featureOffsets(integralStep);
+
+    vector<cv::Rect> candidates;
+    for (size_t level = 0; level < features.numLevels(); ++level)
+    {
+        const auto scale = features.levelScale(level);
+        const cv::Size objectSize(cvRound(m_windowSize.width * scale), cvRound(m_windowSize.height * scale));
+        if (objectSize.width > maxObjectSize.width || objectSize.height > maxObjectSize.height
+            || objectSize.width > searchRoi.width || objectSize.height > searchRoi.height)
+        {
+            break;
+        }
+        if (objectSize.width < minSize.width || objectSize.height < minSize.height)
+        {
+            continue;
+        }
+
+        // Range of window origins within the search region in level coordinates
+        const auto levelSize = features.levelSize(level);
+        const cv::Point firstOrigin(cvCeil(searchRoi.x / scale), cvCeil(searchRoi.y / scale));
+        const cv::Point lastOrigin(std::min(cvFloor(searchRoi.br().x / scale), levelSize.width) - m_windowSize.width,
+                                   std::min(cvFloor(searchRoi.br().y / scale), levelSize.height) - m_windowSize.height);
+        if (lastOrigin.x < firstOrigin.x || lastOrigin.y < firstOrigin.y)
+        {
+            continue;
+        }
+        const auto windowStep = scale > 2.0 ? 1 : 2;
+
+        // Windows are scanned tile by tile, all the windows with their origin in a tile are within its integrals
+        for (auto tileY = firstOrigin.y / tileSize * tileSize; tileY <= lastOrigin.y; tileY += tileSize)
+        {
+            for (auto tileX = firstOrigin.x / tileSize * tileSize; tileX <= lastOrigin.x; tileX += tileSize)
+            {
+                const auto & tile
+                    = features.tile(level, cv::Point(std::max(tileX, firstOrigin.x), std::max(tileY, firstOrigin.y)));
+                const auto yEnd = std::min(tileY + tileSize - 1, lastOrigin.y);
+                const auto xEnd = std::min(tileX + tileSize - 1, lastOrigin.x);
+                for (auto y = alignUp(std::max(tileY, firstOrigin.y), firstOrigin.y, windowStep); y <= yEnd;
+                     y += windowStep)
+                {
+                    for (auto x = alignUp(std::max(tileX, firstOrigin.x), firstOrigin.x, windowStep); x <= xEnd;
+                         x += windowStep)
+                    {
+                        const auto offset = (y - tile.origin.y) * integralStep + (x - tile.origin.x);
+                        if (evaluate(offsets,
+                                     tile.sum.ptr<int>() + offset,
+                                     tile.sqSum.ptr<double>() + offset,
+                                     tile.tiltedSum.ptr<int>() + offset,
+                                     integralStep))
+                        {
+                            candidates.emplace_back(
+                                cvRound(x * scale), cvRound(y * scale), objectSize.width, objectSize.height);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    cv::groupRectangles(candidates, numNeighbors, minNeighbors, 0.2);
+    return candidates;
+}
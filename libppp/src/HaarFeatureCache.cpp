@@ -0,0 +1,78 @@
+#include "HaarFeatureCache.h"
+#include "HaarFeatures.h"
+
+namespace
+{
+cv::Mat wholeImage(const cv::Mat & image)
+{
+    cv::Size wholeSize;
+    cv::Point offset;
+    image.locateROI(wholeSize, offset);
+    auto whole = image;
+    whole.adjustROI(offset.y,
+                    wholeSize.height - offset.y - image.rows,
+                    offset.x,
+                    wholeSize.width - offset.x - image.cols);
+    return whole;
+}
+
+bool isSameImage(const cv::Mat & image1, const cv::Mat & image2)
+{
+    return image1.datastart == image2.datastart && image1.size() == image2.size() && image1.type() == image2.type();
+}
+} // namespace
+
+HaarFeatureCache::HaarFeatureCache(size_t capacity, double scaleFactor)
+: m_capacity(capacity)
+, m_scaleFactor(scaleFactor)
+{
+    if (capacity < 1)
+    {
+        throw std::logic_error("The Haar feature cache should hold at least one image");
+    }
+}
+
+HaarFeaturesSPtr HaarFeatureCache::features(const cv::Mat & image, bool cacheNewFeatures)
+{
+    if (image.empty())
+    {
+        throw std::logic_error("Can't compute the Haar features of an empty image");
+    }
+
+    const auto whole = wholeImage(image);
+    std::lock_guard<std::mutex> lg(m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        for (const auto & cachedImage : it->images)
+        {
+            if (isSameImage(cachedImage, whole))
+            {
+                m_entries.splice(m_entries.begin(), m_entries, it);
+                return m_entries.front().pFeatures;
+            }
+        }
+    }
+
+    // Levels are computed lazily, so creating the features only costs the gray scale conversion (if any)
+    if (!cacheNewFeatures)
+    {
+        return std::make_shared<HaarFeatures>(whole, m_scaleFactor);
+    }
+    Entry entry { { whole }, std::make_shared<HaarFeatures>(whole, m_scaleFactor) };
+    if (whole.channels() != 1)
+    {
+        entry.images.push_back(entry.pFeatures->grayImage());
+    }
+    m_entries.push_front(entry);
+    if (m_entries.size() > m_capacity)
+    {
+        m_entries.pop_back();
+    }
+    return m_entries.front().pFeatures;
+}
+
+size_t HaarFeatureCache::size() const
+{
+    std::lock_guard<std::mutex> lg(m_mutex);
+    return m_entries.size();
+}
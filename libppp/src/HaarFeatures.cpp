@@ -0,0 +1,118 @@
+#include "HaarFeatures.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+HaarFeatures::HaarFeatures(const cv::Mat & image, double scaleFactor, int tileSize, int maxWindowSize)
+: m_tileSize(tileSize)
+, m_maxWindowSize(maxWindowSize)
+, m_numComputedTiles(0)
+{
+    if (scaleFactor <= 1.0 || tileSize <= 0 || maxWindowSize <= 0)
+    {
+        throw std::logic_error("Invalid scale factor, tile size or window size for the Haar features");
+    }
+
+    if (image.channels() == 1)
+    {
+        m_grayImage = image;
+    }
+    else
+    {
+        cvtColor(image, m_grayImage, cv::COLOR_BGR2GRAY);
+    }
+
+    // Levels smaller than this can't hold any detection window
+    const auto minLevelSize = 8;
+    for (auto scale = 1.0;; scale *= scaleFactor)
+    {
+        const cv::Size levelSize(cvRound(m_grayImage.cols / scale), cvRound(m_grayImage.rows / scale));
+        if (std::min(levelSize.width, levelSize.height) < minLevelSize)
+        {
+            break;
+        }
+        std::unique_ptr<Level> pLevel(new Level);
+        pLevel->scale = scale;
+        pLevel->size = levelSize;
+        pLevel->numTiles = cv::Size((levelSize.width + tileSize - 1) / tileSize,
+                                    (levelSize.height + tileSize - 1) / tileSize);
+        m_levels.push_back(std::move(pLevel));
+    }
+}
+
+const cv::Mat & HaarFeatures::grayImage() const
+{
+    return m_grayImage;
+}
+
+size_t HaarFeatures::numLevels() const
+{
+    return m_levels.size();
+}
+
+double HaarFeatures::levelScale(size_t level) const
+{
+    return m_levels.at(level)->scale;
+}
+
+cv::Size HaarFeatures::levelSize(size_t level) const
+{
+    return m_levels.at(level)->size;
+}
+
+int HaarFeatures::tileSize() const
+{
+    return m_tileSize;
+}
+
+int HaarFeatures::maxWindowSize() const
+{
+    return m_maxWindowSize;
+}
+
+int HaarFeatures::integralStep() const
+{
+    return m_tileSize + m_maxWindowSize + 1;
+}
+
+const HaarFeatures::Tile & HaarFeatures::tile(size_t level, const cv::Point & levelPoint) const
+{
+    auto & lvl = *m_levels.at(level);
+    if (!cv::Rect(cv::Point(), lvl.size).contains(levelPoint))
+    {
+        throw std::logic_error("Point outside of the Haar features pyramid level");
+    }
+
+    std::call_once(lvl.allocated, [&lvl]() { lvl.tiles.reset(new LazyTile[lvl.numTiles.area()]); });
+
+    const cv::Point tileIndex(levelPoint.x / m_tileSize, levelPoint.y / m_tileSize);
+    auto & tile = lvl.tiles[tileIndex.y * lvl.numTiles.width + tileIndex.x];
+    std::call_once(tile.computed, [&]() {
+        tile.origin = tileIndex * m_tileSize;
+        computeTile(lvl, tile);
+    });
+    return tile;
+}
+
+size_t HaarFeatures::numComputedTiles() const
+{
+    return m_numComputedTiles;
+}
+
+void HaarFeatures::computeTile(const Level & level, LazyTile & tile) const
+{
+    // The tile is resampled straight from the image with the pixel mapping of cv::resize, so the tiles of a level
+    // are identical to the corresponding regions of the whole level resized at once
+    const auto s = level.scale;
+    const cv::Matx23d levelToImage(s, 0, s * (tile.origin.x + 0.5) - 0.5, 0, s, s * (tile.origin.y + 0.5) - 0.5);
+    const auto patchSize = m_tileSize + m_maxWindowSize;
+    cv::Mat patch;
+    warpAffine(m_grayImage,
+               patch,
+               levelToImage,
+               cv::Size(patchSize, patchSize),
+               cv::INTER_LINEAR | cv::WARP_INVERSE_MAP,
+               cv::BORDER_REPLICATE);
+
+    integral(patch, tile.sum, tile.sqSum, tile.tiltedSum, CV_32S, CV_64F);
+    ++m_numComputedTiles;
+}
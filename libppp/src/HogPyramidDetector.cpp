@@ -0,0 +1,168 @@
+#include "HogPyramidDetector.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <dlib/opencv/cv_image.h>
+#include <dlib/opencv/to_open_cv.h>
+
+using namespace std;
+
+HogPyramidDetector::HogPyramidDetector(const DetectorType & detector, ThreadPool & threadPool)
+: m_detector(detector)
+, m_threadPool(threadPool)
+, m_tileSize(512)
+{
+    // The pyramid is built here, the level detectors only extract the features at the scale of their input image
+    DetectorType::image_scanner_type scanner;
+    scanner.copy_configuration(detector.get_scanner());
+    scanner.set_max_pyramid_levels(1);
+    vector<DetectorType::feature_vector_type> weights;
+    for (unsigned long i = 0; i < detector.num_detectors(); ++i)
+    {
+        weights.push_back(detector.get_w(i));
+    }
+    const auto pLevelDetector = make_shared<DetectorType>(scanner, detector.get_overlap_tester(), weights);
+    m_pLevelDetectors = make_shared<ObjectPool<DetectorType>>(
+        [pLevelDetector]() { return make_shared<DetectorType>(*pLevelDetector); });
+}
+
+void HogPyramidDetector::setTileSize(int tileSize)
+{
+    m_tileSize = tileSize;
+}
+
+void HogPyramidDetector::pyramidLevelRange(double minObjectSize,
+                                           double maxObjectSize,
+                                           size_t & minLevel,
+                                           size_t & maxLevel) const
+{
+    // Each level is 5/6 of the size of the previous one, so objects found at level k are 1.2^k times the window size
+    const auto & scanner = m_detector.get_scanner();
+    const auto windowSize = static_cast<double>(
+        std::max(scanner.get_detection_window_width(), scanner.get_detection_window_height()));
+    const auto levelScaleFactor = 6.0 / 5.0;
+    const auto objectLevel = [&](double objectSize) {
+        return objectSize <= windowSize ? 0.0 : log(objectSize / windowSize) / log(levelScaleFactor);
+    };
+    minLevel = static_cast<size_t>(floor(objectLevel(minObjectSize)));
+    maxLevel = std::min(static_cast<size_t>(ceil(objectLevel(maxObjectSize))),
+                        static_cast<size_t>(scanner.get_max_pyramid_levels() - 1));
+}
+
+vector<dlib::rect_detection> HogPyramidDetector::detect(const cv::Mat & grayImage,
+                                                        double minObjectSize,
+                                                        double maxObjectSize,
+                                                        const function<bool()> & isCancelled) const
+{
+    const auto cancelled = [isCancelled]() { return isCancelled && isCancelled(); };
+
+    size_t minLevel, maxLevel;
+    pyramidLevelRange(minObjectSize, maxObjectSize, minLevel, maxLevel);
+
+    // Build the levels of the pyramid the same way the dlib scanner does, level 0 is the input image
+    const auto & scanner = m_detector.get_scanner();
+    const auto minLevelWidth = static_cast<int>(scanner.get_min_pyramid_layer_width());
+    const auto minLevelHeight = static_cast<int>(scanner.get_min_pyramid_layer_height());
+    dlib::pyramid_down<6> pyr;
+    vector<cv::Mat> levelImages { grayImage };
+    while (levelImages.size() <= maxLevel)
+    {
+        dlib::array2d<uint8_t> levelImage;
+        pyr(dlib::cv_image<uint8_t>(levelImages.back()), levelImage);
+        if (levelImage.nc() < minLevelWidth || levelImage.nr() < minLevelHeight)
+        {
+            break;
+        }
+        levelImages.push_back(dlib::toMat(levelImage).clone());
+    }
+
+    // Large levels are split in tiles overlapping enough for any object to be fully inside one of them
+    const auto overlap = static_cast<int>(
+        std::max(scanner.get_detection_window_width(), scanner.get_detection_window_height())
+        + 2 * scanner.get_cell_size());
+    const auto tileStep = m_tileSize - overlap;
+
+    vector<future<vector<dlib::rect_detection>>> levelResults;
+    for (auto level = minLevel; level < levelImages.size() && !cancelled(); ++level)
+    {
+        const auto & levelImage = levelImages[level];
+        const auto levelSize = levelImage.size();
+        const auto tileLimits = [&](int levelDim, vector<pair<int, int>> & ranges) {
+            if (tileStep <= 0 || levelDim <= m_tileSize)
+            {
+                ranges.emplace_back(0, levelDim);
+                return;
+            }
+            for (auto start = 0; start < levelDim; start += tileStep)
+            {
+                const auto end = std::min(start + m_tileSize, levelDim);
+                ranges.emplace_back(std::max(0, std::min(start, end - m_tileSize)), end);
+                if (end == levelDim)
+                {
+                    break;
+                }
+            }
+        };
+        vector<pair<int, int>> colRanges, rowRanges;
+        tileLimits(levelSize.width, colRanges);
+        tileLimits(levelSize.height, rowRanges);
+
+        for (const auto & rowRange : rowRanges)
+        {
+            for (const auto & colRange : colRanges)
+            {
+                const cv::Rect tileRect(colRange.first,
+                                        rowRange.first,
+                                        colRange.second - colRange.first,
+                                        rowRange.second - rowRange.first);
+                const auto tileImage = levelImage(tileRect);
+                const auto pLevelDetectors = m_pLevelDetectors;
+                levelResults.push_back(m_threadPool.submit([pLevelDetectors, tileImage, tileRect, level, cancelled]() {
+                    vector<dlib::rect_detection> detections;
+                    if (cancelled())
+                    {
+                        // Tasks queued before the cancellation finish right away
+                        return detections;
+                    }
+                    const auto pDetector = pLevelDetectors->acquire();
+                    (*pDetector)(dlib::cv_image<uint8_t>(tileImage), detections);
+
+                    // Map the detections back to the input image
+                    dlib::pyramid_down<6> pyr;
+                    for (auto & detection : detections)
+                    {
+                        const auto tileDetection = dlib::translate_rect(detection.rect, tileRect.x, tileRect.y);
+                        detection.rect = dlib::rectangle(pyr.rect_up(dlib::drectangle(tileDetection), level));
+                    }
+                    return detections;
+                }));
+            }
+        }
+    }
+
+    vector<dlib::rect_detection> allDetections;
+    for (auto & levelResult : levelResults)
+    {
+        const auto detections = levelResult.get();
+        allDetections.insert(allDetections.end(), detections.begin(), detections.end());
+    }
+
+    // Non-max suppression across levels and tiles
+    std::sort(allDetections.rbegin(), allDetections.rend());
+    const auto & overlapTester = m_detector.get_overlap_tester();
+    vector<dlib::rect_detection> finalDetections;
+    for (const auto & detection : allDetections)
+    {
+        const auto overlapsFinalDetection = std::any_of(
+            finalDetections.begin(), finalDetections.end(), [&](const dlib::rect_detection & finalDetection) {
+                return overlapTester(finalDetection.rect, detection.rect);
+            });
+        if (!overlapsFinalDetection)
+        {
+            finalDetections.push_back(detection);
+        }
+    }
+    return finalDetections;
+}
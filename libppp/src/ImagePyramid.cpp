@@ -0,0 +1,50 @@
+#include "ImagePyramid.h"
+
+#include <cmath>
+#include <opencv2/imgproc/imgproc.hpp>
+
+ImagePyramid::ImagePyramid(const cv::Mat & image)
+: m_levels { image }
+{
+}
+
+cv::Mat ImagePyramid::level(size_t index)
+{
+    std::lock_guard<std::mutex> lg(m_mutex);
+    return m_levels[buildLevels(index)];
+}
+
+cv::Mat ImagePyramid::levelForScale(double scale, double & levelScale)
+{
+    if (scale <= 0)
+    {
+        throw std::logic_error("Image pyramid scale should be greater than zero");
+    }
+
+    size_t index = 0;
+    while (std::ldexp(1.0, -static_cast<int>(index + 1)) >= scale)
+    {
+        ++index;
+    }
+
+    std::lock_guard<std::mutex> lg(m_mutex);
+    index = buildLevels(index);
+    levelScale = std::ldexp(1.0, -static_cast<int>(index));
+    return m_levels[index];
+}
+
+size_t ImagePyramid::buildLevels(size_t index)
+{
+    while (m_levels.size() <= index)
+    {
+        const auto & previousLevel = m_levels.back();
+        if (std::min(previousLevel.rows, previousLevel.cols) < 2 * m_minLevelSize)
+        {
+            break;
+        }
+        cv::Mat nextLevel;
+        cv::pyrDown(previousLevel, nextLevel);
+        m_levels.push_back(nextLevel);
+    }
+    return std::min(index, m_levels.size() - 1);
+}
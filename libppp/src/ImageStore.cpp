@@ -13,8 +13,14 @@ std::string ImageStore::setImage(const cv::Mat & inputImage)
 
     {
         std::lock_guard<std::mutex> lg(m_mutex);
+        if (m_imageCollection.find(imageKey) != m_imageCollection.end())
+        {
+            // Same image already in the store, keep it with any pyramid level already built
+            boostImageToTopCache(imageKey);
+            return imageKey;
+        }
         auto it = m_imageKeyOrder.insert(m_imageKeyOrder.end(), imageKey);
-        m_imageCollection[imageKey] = ImageOrderPair(inputImage, it);
+        m_imageCollection[imageKey] = ImageOrderPair(std::make_shared<ImagePyramid>(inputImage), it);
     }
 
     handleStoreSize();
@@ -31,10 +37,17 @@ bool ImageStore::containsImage(const std::string & imageKey)
 }
 
 cv::Mat ImageStore::getImage(const std::string & imageKey)
+{
+    const auto imagePyramid = getImagePyramid(imageKey);
+    return imagePyramid ? imagePyramid->level(0) : cv::Mat();
+}
+
+ImagePyramidSPtr ImageStore::getImagePyramid(const std::string & imageKey)
 {
     std::lock_guard<std::mutex> lg(m_mutex);
     boostImageToTopCache(imageKey);
-    return m_imageCollection[imageKey].first;
+    const auto it = m_imageCollection.find(imageKey);
+    return it != m_imageCollection.end() ? it->second.first : nullptr;
 }
 
 void ImageStore::setStoreSize(size_t storeSize)
@@ -1,5 +1,10 @@
 #include "LandMarks.h"
+#include "Utilities.h"
 
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
 #include <rapidjson/document.h>
 #include <rapidjson/writer.h>
 #include <rapidjson/stringbuffer.h>
@@ -23,6 +28,134 @@ rapidjson::Value rectangleToJson(const cv::Rect& r, rapidjson::Document::Allocat
     return obj;
 }
 
+/*!@brief Reads a coordinate of a landmark, fractional values (e.g. from a UI drag) are rounded to the pixel !*/
+int coordinateFromJson(rapidjson::Value & obj, const char * name, const char * coordinate)
+{
+    if (!obj.IsObject() || !obj.HasMember(coordinate) || !obj[coordinate].IsNumber())
+    {
+        throw std::runtime_error(std::string("Landmark '") + name + "' should have a numeric '" + coordinate + "'");
+    }
+    return ROUND_INT(obj[coordinate].GetDouble());
+}
+
+void pointFromJson(rapidjson::Value & v, const char * name, cv::Point & p)
+{
+    if (v.HasMember(name))
+    {
+        auto & obj = v[name];
+        p = cv::Point(coordinateFromJson(obj, name, "x"), coordinateFromJson(obj, name, "y"));
+    }
+}
+
+void rectangleFromJson(rapidjson::Value & v, const char * name, cv::Rect & r)
+{
+    if (v.HasMember(name))
+    {
+        auto & obj = v[name];
+        r = cv::Rect(coordinateFromJson(obj, name, "x"),
+                     coordinateFromJson(obj, name, "y"),
+                     coordinateFromJson(obj, name, "width"),
+                     coordinateFromJson(obj, name, "height"));
+    }
+}
+
+LandMarks LandMarks::scaled(double sx, double sy) const
+{
+    const auto scalePoint = [sx, sy](const cv::Point & p) {
+        return cv::Point(cvRound(p.x * sx), cvRound(p.y * sy));
+    };
+    const auto scaleRect = [&scalePoint](const cv::Rect & r) {
+        return cv::Rect(scalePoint(r.tl()), scalePoint(r.br()));
+    };
+    const auto scalePoints = [&scalePoint](std::vector<cv::Point> & points) {
+        std::transform(points.begin(), points.end(), points.begin(), scalePoint);
+    };
+
+    auto result = *this;
+    result.eyeLeftPupil = scalePoint(eyeLeftPupil);
+    result.eyeRightPupil = scalePoint(eyeRightPupil);
+    result.vjLeftEyeRect = scaleRect(vjLeftEyeRect);
+    result.vjRightEyeRect = scaleRect(vjRightEyeRect);
+    result.lipUpperCenter = scalePoint(lipUpperCenter);
+    result.lipLowerCenter = scalePoint(lipLowerCenter);
+    result.lipLeftCorner = scalePoint(lipLeftCorner);
+    result.lipRightCorner = scalePoint(lipRightCorner);
+    result.vjMouthRect = scaleRect(vjMouthRect);
+    result.vjFaceRect = scaleRect(vjFaceRect);
+    result.crownPoint = scalePoint(crownPoint);
+    result.chinPoint = scalePoint(chinPoint);
+    scalePoints(result.lipContour1st);
+    scalePoints(result.lipContour2nd);
+    scalePoints(result.allLandmarks);
+    return result;
+}
+
+LandMarks LandMarks::rotated(int rotAngleDegrees, const cv::Size & imageSize) const
+{
+    const auto rotatePoint = [rotAngleDegrees, &imageSize](const cv::Point & p) {
+        return Utilities::rotatePoint(p, imageSize, rotAngleDegrees);
+    };
+    const auto rotateRect = [rotAngleDegrees, &imageSize](const cv::Rect & r) {
+        return Utilities::rotateRect(r, imageSize, rotAngleDegrees);
+    };
+    const auto rotatePoints = [&rotatePoint](std::vector<cv::Point> & points) {
+        std::transform(points.begin(), points.end(), points.begin(), rotatePoint);
+    };
+
+    auto result = *this;
+    result.eyeLeftPupil = rotatePoint(eyeLeftPupil);
+    result.eyeRightPupil = rotatePoint(eyeRightPupil);
+    result.vjLeftEyeRect = rotateRect(vjLeftEyeRect);
+    result.vjRightEyeRect = rotateRect(vjRightEyeRect);
+    result.lipUpperCenter = rotatePoint(lipUpperCenter);
+    result.lipLowerCenter = rotatePoint(lipLowerCenter);
+    result.lipLeftCorner = rotatePoint(lipLeftCorner);
+    result.lipRightCorner = rotatePoint(lipRightCorner);
+    result.vjMouthRect = rotateRect(vjMouthRect);
+    result.vjFaceRect = rotateRect(vjFaceRect);
+    result.crownPoint = rotatePoint(crownPoint);
+    result.chinPoint = rotatePoint(chinPoint);
+    rotatePoints(result.lipContour1st);
+    rotatePoints(result.lipContour2nd);
+    rotatePoints(result.allLandmarks);
+    return result;
+}
+
+double LandMarks::geometryPlausibility() const
+{
+    // 1 within the expected range, decreasing linearly to 0 at half the width of the range outside of it
+    const auto rangeScore = [](double value, double low, double high) {
+        const auto tolerance = (high - low) / 2;
+        const auto excess = std::max(low - value, value - high);
+        return std::max(0.0, std::min(1.0, 1.0 - excess / tolerance));
+    };
+
+    const auto faceWidth = static_cast<double>(vjFaceRect.width);
+    const auto faceHeight = static_cast<double>(vjFaceRect.height);
+    const cv::Point2d eyesDelta = eyeRightPupil - eyeLeftPupil;
+    const auto eyesDistance = cv::norm(eyesDelta);
+    if (faceWidth <= 0 || faceHeight <= 0 || eyesDistance <= 0)
+    {
+        return 0;
+    }
+    const auto eyesCenter = cv::Point2d(eyeLeftPupil + eyeRightPupil) * 0.5;
+    const auto lipsCenter = cv::Point2d(lipLeftCorner + lipRightCorner) * 0.5;
+    const auto faceTop = static_cast<double>(vjFaceRect.y);
+
+    const double scores[] = {
+        // Eyes in the upper half of the face, level and apart
+        rangeScore((std::max(eyeLeftPupil.y, eyeRightPupil.y) - faceTop) / faceHeight, 0.1, 0.6),
+        rangeScore((std::min(eyeLeftPupil.y, eyeRightPupil.y) - faceTop) / faceHeight, 0.1, 0.6),
+        rangeScore(std::abs(eyesDelta.y) / std::abs(eyesDelta.x + 1e-6), 0.0, 0.25),
+        rangeScore(eyesDistance / faceWidth, 0.25, 0.6),
+        // Mouth below the eyes, centered between them and about as wide as the distance between them
+        rangeScore((lipsCenter.y - eyesCenter.y) / eyesDistance, 0.7, 1.5),
+        rangeScore(std::abs(lipsCenter.x - eyesCenter.x) / eyesDistance, 0.0, 0.25),
+        rangeScore(cv::norm(lipRightCorner - lipLeftCorner) / eyesDistance, 0.4, 1.3),
+    };
+    return *std::min_element(std::begin(scores), std::end(scores));
+}
+
 std::string LandMarks::toString() const
 {
     std::stringstream ss;
@@ -48,10 +181,11 @@ std::string LandMarks::toJson() const
     d.AddMember("lipLowerCenter", pointToJson(lipLowerCenter, alloc), alloc);
     d.AddMember("lipLeftCorner", pointToJson(lipLeftCorner, alloc), alloc);
     d.AddMember("lipRightCorner", pointToJson(lipRightCorner, alloc), alloc);
-    d.AddMember("vjMouthRect", rectangleToJson(vjRightEyeRect, alloc), alloc);
+    d.AddMember("vjMouthRect", rectangleToJson(vjMouthRect, alloc), alloc);
 
     d.AddMember("crownPoint", pointToJson(crownPoint, alloc), alloc);
     d.AddMember("chinPoint", pointToJson(chinPoint, alloc), alloc);
+    d.AddMember("shapePredictorLevels", shapePredictorLevels, alloc);
 
     StringBuffer buffer;
     Writer<StringBuffer> writer(buffer);
@@ -59,3 +193,33 @@ std::string LandMarks::toJson() const
 
     return std::string(buffer.GetString());
 }
+
+LandMarks LandMarks::fromJson(rapidjson::Value & v)
+{
+    if (!v.IsObject())
+    {
+        throw std::runtime_error("Landmarks should be a Json object");
+    }
+    LandMarks landMarks;
+    landMarks.imageRotation = 0;
+    rectangleFromJson(v, "vjFaceRect", landMarks.vjFaceRect);
+
+    pointFromJson(v, "eyeLeftPupil", landMarks.eyeLeftPupil);
+    pointFromJson(v, "eyeRightPupil", landMarks.eyeRightPupil);
+    rectangleFromJson(v, "vjLeftEyeRect", landMarks.vjLeftEyeRect);
+    rectangleFromJson(v, "vjRightEyeRect", landMarks.vjRightEyeRect);
+
+    pointFromJson(v, "lipUpperCenter", landMarks.lipUpperCenter);
+    pointFromJson(v, "lipLowerCenter", landMarks.lipLowerCenter);
+    pointFromJson(v, "lipLeftCorner", landMarks.lipLeftCorner);
+    pointFromJson(v, "lipRightCorner", landMarks.lipRightCorner);
+    rectangleFromJson(v, "vjMouthRect", landMarks.vjMouthRect);
+
+    pointFromJson(v, "crownPoint", landMarks.crownPoint);
+    pointFromJson(v, "chinPoint", landMarks.chinPoint);
+    if (v.HasMember("shapePredictorLevels") && v["shapePredictorLevels"].IsInt())
+    {
+        landMarks.shapePredictorLevels = v["shapePredictorLevels"].GetInt();
+    }
+    return landMarks;
+}
@@ -1,15 +1,67 @@
 #include "LipsDetector.h"
+#include "HaarCascade.h"
+#include "HaarFeatureCache.h"
 #include "LandMarks.h"
+#include "StageGraph.h"
 #include "Utilities.h"
 
 #include "CommonHelpers.h"
 #include <algorithm>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/objdetect/objdetect.hpp>
+#include <vector>
 
 using namespace cv;
 using namespace std;
 
+namespace
+{
+/*!@brief Builds the table of the lips likelihood indexed by (R << 8) | G. The values are computed like the original
+ * per pixel transform, v = r / (r + g) * (1 - g / (r + g)) with r and g normalized by R + G + B, scaled as v^2 * 255
+ * and rounded to 8 bits. The blue component cancels out, the results are the same for any of its values
+ !*/
+vector<uchar> createLipsLikelihoodTable()
+{
+    vector<uchar> table(256 * 256);
+    for (auto red = 0; red < 256; ++red)
+    {
+        for (auto green = 0; green < 256; ++green)
+        {
+            const auto rgbSum = static_cast<float>(red) + green;
+            const auto r = red / rgbSum;
+            const auto g = green / rgbSum;
+            const auto v = r / (r + g) * (1 - g / (r + g));
+            // Black pixels (NaN) are converted to zero as cv::Mat::convertTo does
+            table[red << 8 | green] = rgbSum > 0 ? saturate_cast<uchar>(v * v * 255) : 0;
+        }
+    }
+    return table;
+}
+} // namespace
+
+LipsDetector::LipsDetector(HaarFeatureCacheSPtr pHaarFeatureCache, ThreadPoolSPtr pThreadPool)
+: m_pHaarFeatureCache(pHaarFeatureCache ? pHaarFeatureCache : make_shared<HaarFeatureCache>())
+, m_pThreadPool(pThreadPool)
+, m_closeKernel(getStructuringElement(MORPH_ELLIPSE, Size(7, 7)))
+{
+}
+
+Mat LipsDetector::lipsLikelihood(const Mat & bgrImage)
+{
+    static const auto table = createLipsLikelihoodTable();
+
+    Mat likelihood(bgrImage.size(), CV_8UC1);
+    for (auto y = 0; y < bgrImage.rows; ++y)
+    {
+        const auto pSrc = bgrImage.ptr<Vec3b>(y);
+        auto pDst = likelihood.ptr<uchar>(y);
+        for (auto x = 0; x < bgrImage.cols; ++x)
+        {
+            pDst[x] = table[pSrc[x][2] << 8 | pSrc[x][1]];
+        }
+    }
+    return likelihood;
+}
+
 void LipsDetector::configure(rapidjson::Value & config)
 {
     auto & lipsDetectorCfg = config["lipsDetector"];
@@ -17,6 +69,11 @@ void LipsDetector::configure(rapidjson::Value & config)
 
     m_useColorSegmentationAlgorithm = lipsDetectorCfg["useColorSegmentation"].GetBool();
 
+    if (lipsDetectorCfg.HasMember("parallelMouthSearch"))
+    {
+        m_parallelMouthSearch = lipsDetectorCfg["parallelMouthSearch"].GetBool();
+    }
+
     if (m_useHaarCascades)
     {
         const auto haarClassifierBase64 = lipsDetectorCfg["haarCascade"]["data"].GetString();
@@ -25,6 +82,13 @@ void LipsDetector::configure(rapidjson::Value & config)
 }
 
 bool LipsDetector::detectLandMarks(const Mat & inputImage, LandMarks & landmarks)
+{
+    return detectLandMarksWithFeatures(inputImage, nullptr, landmarks);
+}
+
+bool LipsDetector::detectLandMarksWithFeatures(const Mat & inputImage,
+                                               const HaarFeaturesSPtr & pImageFeatures,
+                                               LandMarks & landmarks)
 {
     auto faceRectHeight = landmarks.vjFaceRect.height;
     auto leftEyePos = landmarks.eyeLeftPupil;
@@ -46,97 +110,113 @@ bool LipsDetector::detectLandMarks(const Mat & inputImage, LandMarks & landmarks
     Rect mouthRoiRect(mouthRoiLeftTop, mouthRoiSize);
     auto mouthRoiImage = inputImage(mouthRoiRect);
 
+    // Once the mouth region is known, the mouth cascade and the lips segmentation are independent stages
+    StageGraph stageGraph(m_parallelMouthSearch ? m_pThreadPool : nullptr);
     if (m_useHaarCascades)
     {
-        Mat mouthRoiImageGray;
-        cvtColor(mouthRoiImage, mouthRoiImageGray, COLOR_BGR2GRAY);
-        vector<Rect> mouthRects;
-        vector<int> rejectLevels;
-        vector<double> levelWeights;
-        m_pMouthCascadeClassifier->detectMultiScale(mouthRoiImageGray,
-                                                    mouthRects,
-                                                    1.05,
-                                                    3,
-                                                    CASCADE_SCALE_IMAGE | CASCADE_FIND_BIGGEST_OBJECT,
-                                                    mouthRoiSize / 4,
-                                                    mouthRoiSize);
-
-        if (!mouthRects.empty())
-        {
-            landmarks.vjMouthRect = mouthRects[0];
-            landmarks.vjMouthRect.x += mouthRoiLeftTop.x;
-            landmarks.vjMouthRect.y += mouthRoiLeftTop.y;
-        }
+        stageGraph.addStage([&]() {
+            // The features of the color image are the ones of its gray version, already used to search the eyes
+            const auto pFeatures = pImageFeatures ? pImageFeatures : m_pHaarFeatureCache->features(inputImage);
+            const auto mouthRects
+                = m_pMouthCascadeClassifier->detect(*pFeatures, mouthRoiRect, 3, mouthRoiSize / 4, mouthRoiSize);
+
+            if (!mouthRects.empty())
+            {
+                landmarks.vjMouthRect = *std::max_element(
+                    mouthRects.begin(), mouthRects.end(), [](const Rect & r1, const Rect & r2) {
+                        return r1.area() < r2.area();
+                    });
+            }
+            return true;
+        });
     }
 
     if (m_useColorSegmentationAlgorithm)
     {
-        Mat colorTformImage(mouthRoiHeight, mouthRoiWidth, CV_32F);
+        stageGraph.addStage([&]() {
+            return segmentLips(mouthRoiImage, mouthRoiRect, eyeCentrePoint, mouthCenterPoint, landmarks);
+        });
+    }
+    return stageGraph.run();
+}
 
-        auto dstBeg = colorTformImage.begin<float>();
-        auto srcBeg = mouthRoiImage.begin<Vec3b>();
-        auto srcEnd = mouthRoiImage.end<Vec3b>();
+bool LipsDetector::segmentLips(const Mat & mouthRoiImage,
+                               const Rect & mouthRoiRect,
+                               const Point2d & eyeCentrePoint,
+                               const Point2d & mouthCenterPoint,
+                               LandMarks & landmarks) const
+{
+    const auto mouthRoiLeftTop = mouthRoiRect.tl();
+    const auto mouthRoiWidth = mouthRoiRect.width;
+    const auto mouthRoiHeight = mouthRoiRect.height;
 
-        std::transform(srcBeg, srcEnd, dstBeg, [](const Vec3b & pixel) {
-            const auto rgbSum = static_cast<float>(pixel[0]) + pixel[1] + pixel[2];
-            const auto r = pixel[2] / rgbSum;
-            const auto g = pixel[1] / rgbSum;
-            const auto v = r / (r + g) * (1 - g / (r + g));
-            return v * v * 255;
-        });
+    const auto u = lipsLikelihood(mouthRoiImage);
 
-        Mat u, u2, v, binaryImg;
-        colorTformImage.convertTo(u, CV_8UC1);
-        blur(u, u2, Size(9, 3));
+    Mat v, binaryImg;
+    threshold(u, v, 0, 255, THRESH_OTSU);
+    morphologyEx(v, binaryImg, MORPH_CLOSE, m_closeKernel);
 
-        threshold(u, v, 0, 255, THRESH_OTSU);
-        morphologyEx(v, binaryImg, MORPH_CLOSE, getStructuringElement(MORPH_ELLIPSE, Size(7, 7)));
+    std::vector<std::vector<Point>> contours;
+    findContours(binaryImg, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, mouthRoiLeftTop);
 
-        std::vector<std::vector<Point>> contours;
-        findContours(binaryImg, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, mouthRoiLeftTop);
+    double maxArea1st = 0, maxArea2nd = 0;
+    std::vector<std::vector<Point>>::iterator c1st, c2nd;
 
-        double maxArea1st = 0, maxArea2nd = 0;
-        std::vector<std::vector<Point>>::iterator c1st, c2nd;
+    if (contours.empty())
+    {
+        // No contours were found
+        return false;
+    }
 
-        if (contours.empty())
+    // Select the two biggest regions (assuming they are the lips)
+    for (auto c = contours.begin(); c != contours.end(); ++c)
+    {
+        // Ignore contour if it touches the border of the rectangle at the bottom
+        if (std::any_of(c->begin(), c->end(), [mouthRoiWidth, mouthRoiHeight, &mouthRoiLeftTop](const Point & p) {
+                // return p.x == mouthRoiLeftTop.x || p.x >= mouthRoiLeftTop.x + mouthRoiWidth - 1
+                //        p.y == mouthRoiLeftTop.y || p.y >= mouthRoiLeftTop.y + mouthRoiHeight - 1;
+                return p.y >= mouthRoiLeftTop.y + mouthRoiHeight - 1;
+            }))
         {
-            // No contours were found
-            return false;
+            continue;
         }
+        // auto area = contourArea(*c);
+        auto area = boundingRect(*c).width;
 
-        // Select the two biggest regions (assuming they are the lips)
-        for (auto c = contours.begin(); c != contours.end(); ++c)
+        if (area > maxArea1st)
         {
-            // Ignore contour if it touches the border of the rectangle at the bottom
-            if (std::any_of(c->begin(), c->end(), [mouthRoiWidth, mouthRoiHeight, &mouthRoiLeftTop](const Point & p) {
-                    // return p.x == mouthRoiLeftTop.x || p.x >= mouthRoiLeftTop.x + mouthRoiWidth - 1
-                    //        p.y == mouthRoiLeftTop.y || p.y >= mouthRoiLeftTop.y + mouthRoiHeight - 1;
-                    return p.y >= mouthRoiLeftTop.y + mouthRoiHeight - 1;
-                }))
-            {
-                continue;
-            }
-            // auto area = contourArea(*c);
-            auto area = boundingRect(*c).width;
-
-            if (area > maxArea1st)
-            {
-                maxArea2nd = maxArea1st;
-                c2nd = c1st;
-                maxArea1st = area;
-                c1st = c;
-            }
+            maxArea2nd = maxArea1st;
+            c2nd = c1st;
+            maxArea1st = area;
+            c1st = c;
         }
+    }
 
-        landmarks.lipContour1st = *c1st;
-        if (maxArea2nd > 0)
+    landmarks.lipContour1st = *c1st;
+    if (maxArea2nd > 0)
+    {
+        landmarks.lipContour2nd = *c2nd;
+    }
+
+    auto candidates = Utilities::contourLineIntersection(*c1st, eyeCentrePoint, mouthCenterPoint);
+    auto leftCorner = Point(INT_MAX, 0), rightCorner = Point(INT_MIN, 0);
+    for (const auto & p : *c1st)
+    {
+        if (p.x < leftCorner.x)
         {
-            landmarks.lipContour2nd = *c2nd;
+            leftCorner = p;
         }
+        else if (p.x > rightCorner.x)
+        {
+            rightCorner = p;
+        }
+    }
 
-        auto candidates = Utilities::contourLineIntersection(*c1st, eyeCentrePoint, mouthCenterPoint);
-        auto leftCorner = Point(INT_MAX, 0), rightCorner = Point(INT_MIN, 0);
-        for (const auto & p : *c1st)
+    if (maxArea2nd > 0.5 * maxArea1st)
+    {
+        auto candidates2 = Utilities::contourLineIntersection(*c2nd, eyeCentrePoint, mouthCenterPoint);
+        candidates.insert(candidates.end(), candidates2.begin(), candidates2.end());
+        for (auto & p : *c2nd)
         {
             if (p.x < leftCorner.x)
             {
@@ -147,38 +227,21 @@ bool LipsDetector::detectLandMarks(const Mat & inputImage, LandMarks & landmarks
                 rightCorner = p;
             }
         }
-
-        if (maxArea2nd > 0.5 * maxArea1st)
-        {
-            auto candidates2 = Utilities::contourLineIntersection(*c2nd, eyeCentrePoint, mouthCenterPoint);
-            candidates.insert(candidates.end(), candidates2.begin(), candidates2.end());
-            for (auto & p : *c2nd)
-            {
-                if (p.x < leftCorner.x)
-                {
-                    leftCorner = p;
-                }
-                else if (p.x > rightCorner.x)
-                {
-                    rightCorner = p;
-                }
-            }
-        }
-
-        // auto upperLip = *std::max_element(candidates.begin(), candidates.end(), [](const Point2d &a, const Point2d &b)
-        //                                  {
-        //                                      return a.y < b.y;
-        //                                  });
-        // auto lowerLip = *std::max_element(candidates.begin(), candidates.end(), [](const Point2d &a, const Point2d &b)
-        //                                  {
-        //                                      return a.y > b.y;
-        //                                  });
-
-        // landMarks.lipUpperCenter = upperLip;
-        // landMarks.lipLowerCenter = lowerLip;
-        landmarks.lipLeftCorner = leftCorner;
-        landmarks.lipRightCorner = rightCorner;
     }
+
+    // auto upperLip = *std::max_element(candidates.begin(), candidates.end(), [](const Point2d &a, const Point2d &b)
+    //                                  {
+    //                                      return a.y < b.y;
+    //                                  });
+    // auto lowerLip = *std::max_element(candidates.begin(), candidates.end(), [](const Point2d &a, const Point2d &b)
+    //                                  {
+    //                                      return a.y > b.y;
+    //                                  });
+
+    // landMarks.lipUpperCenter = upperLip;
+    // landMarks.lipLowerCenter = lowerLip;
+    landmarks.lipLeftCorner = leftCorner;
+    landmarks.lipRightCorner = rightCorner;
     return true;
 }
 
@@ -0,0 +1,94 @@
+#include "NearDuplicateIndex.h"
+#include "Utilities.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+NearDuplicateIndex::ImageSignature NearDuplicateIndex::computeSignature(const cv::Mat & grayImage)
+{
+    ImageSignature signature;
+    signature.hash = Utilities::perceptualHash(grayImage);
+    signature.imageSize = grayImage.size();
+    const auto thumbnailSize = 32;
+    cv::resize(grayImage, signature.thumbnail, cv::Size(thumbnailSize, thumbnailSize), 0, 0, cv::INTER_AREA);
+    return signature;
+}
+
+void NearDuplicateIndex::setCapacity(size_t capacity)
+{
+    if (capacity < 1)
+    {
+        throw std::runtime_error("Invalid near duplicate index capacity, should be greater than zero");
+    }
+    std::lock_guard<std::mutex> lg(m_mutex);
+    m_capacity = capacity;
+    while (m_entries.size() > m_capacity)
+    {
+        m_entries.pop_front();
+    }
+}
+
+void NearDuplicateIndex::setMaxHashDistance(int maxHashDistance)
+{
+    std::lock_guard<std::mutex> lg(m_mutex);
+    m_maxHashDistance = maxHashDistance;
+}
+
+void NearDuplicateIndex::setMaxThumbnailDifference(double maxThumbnailDifference)
+{
+    std::lock_guard<std::mutex> lg(m_mutex);
+    m_maxThumbnailDifference = maxThumbnailDifference;
+}
+
+void NearDuplicateIndex::add(const ImageSignature & signature, const LandMarks & landMarks)
+{
+    std::lock_guard<std::mutex> lg(m_mutex);
+    m_entries.push_back(Entry { signature, landMarks });
+    if (m_entries.size() > m_capacity)
+    {
+        m_entries.pop_front();
+    }
+}
+
+bool NearDuplicateIndex::find(const ImageSignature & signature, LandMarks & landMarks) const
+{
+    std::lock_guard<std::mutex> lg(m_mutex);
+
+    const auto & imageSize = signature.imageSize;
+    const auto aspectRatio = static_cast<double>(imageSize.width) / imageSize.height;
+    auto nearestDistance = m_maxHashDistance + 1;
+    const Entry * nearestEntry = nullptr;
+
+    // Most recent entries first, so they win ties
+    for (auto it = m_entries.rbegin(); it != m_entries.rend(); ++it)
+    {
+        const auto & entrySize = it->signature.imageSize;
+        const auto entryAspectRatio = static_cast<double>(entrySize.width) / entrySize.height;
+        if (std::abs(entryAspectRatio - aspectRatio) > m_maxAspectRatioDifference * aspectRatio)
+        {
+            continue;
+        }
+        const auto distance = Utilities::hammingDistance(signature.hash, it->signature.hash);
+        if (distance >= nearestDistance)
+        {
+            continue;
+        }
+        // Similar hashes are only a candidate, the thumbnails must match as well
+        const auto thumbnailDifference = cv::norm(signature.thumbnail, it->signature.thumbnail, cv::NORM_L1)
+            / signature.thumbnail.total();
+        if (thumbnailDifference <= m_maxThumbnailDifference)
+        {
+            nearestDistance = distance;
+            nearestEntry = &*it;
+        }
+    }
+
+    if (nearestEntry == nullptr)
+    {
+        return false;
+    }
+
+    const auto sx = static_cast<double>(imageSize.width) / nearestEntry->signature.imageSize.width;
+    const auto sy = static_cast<double>(imageSize.height) / nearestEntry->signature.imageSize.height;
+    landMarks = nearestEntry->landMarks.scaled(sx, sy);
+    return true;
+}
@@ -20,31 +20,62 @@ Mat PhotoPrintMaker::cropPicture(const Mat & originalImage,
                                  const Point & chinPoint,
                                  const PhotoStandard & ps)
 {
-    const auto centerCrop = centerCropEstimation(ps, crownPoint, chinPoint);
-
-    const auto chinCrownVec = crownPoint - chinPoint;
+    Point2d centerCrop;
+    Point chinCrownVec;
+    Size2d cropSize;
+    cropFrame(ps, crownPoint, chinPoint, centerCrop, chinCrownVec, cropSize);
 
     const auto faceHeightPix = norm(chinCrownVec);
 
-    const auto cropHeightPix = ps.photoHeightMM() / ps.faceHeightMM() * faceHeightPix;
-    const auto cropWidthPix = ps.photoWidthMM() / ps.photoHeightMM() * cropHeightPix;
-
-    const auto centerTop = centerCrop + Point2d(chinCrownVec * (cropHeightPix / faceHeightPix / 2.0));
+    const auto centerTop = centerCrop + Point2d(chinCrownVec * (cropSize.height / faceHeightPix / 2.0));
 
     const auto chinCrown90degRotated = Point2d(chinCrownVec.y, -chinCrownVec.x);
-    const auto centerLeft = centerCrop + chinCrown90degRotated * (cropWidthPix / faceHeightPix / 2.0);
+    const auto centerLeft = centerCrop + chinCrown90degRotated * (cropSize.width / faceHeightPix / 2.0);
 
     const Point2f srcs[3] = { centerCrop, centerLeft, centerTop };
-    const Point2f dsts[3] = { Point2d(cropWidthPix / 2.0, cropHeightPix / 2.0),
-                              Point2d(0.0, cropHeightPix / 2.0),
-                              Point2d(cropWidthPix / 2.0, 0.0) };
+    const Point2f dsts[3] = { Point2d(cropSize.width / 2.0, cropSize.height / 2.0),
+                              Point2d(0.0, cropSize.height / 2.0),
+                              Point2d(cropSize.width / 2.0, 0.0) };
     const auto tform = getAffineTransform(srcs, dsts);
 
     Mat cropImage;
-    warpAffine(originalImage, cropImage, tform, Size(ROUND_INT(cropWidthPix), ROUND_INT(cropHeightPix)));
+    warpAffine(originalImage, cropImage, tform, Size(ROUND_INT(cropSize.width), ROUND_INT(cropSize.height)));
     return cropImage;
 }
 
+RotatedRect PhotoPrintMaker::cropGeometry(const Point & crownPoint,
+                                          const Point & chinPoint,
+                                          const PhotoStandard & ps) const
+{
+    Point2d centerCrop;
+    Point chinCrownVec;
+    Size2d cropSize;
+    cropFrame(ps, crownPoint, chinPoint, centerCrop, chinCrownVec, cropSize);
+
+    // Angle of the crown-chin line with respect to the vertical axis, clockwise
+    const auto angleDeg = atan2(chinCrownVec.x, -chinCrownVec.y) * 180.0 / CV_PI;
+
+    return RotatedRect(centerCrop, Size2f(static_cast<float>(cropSize.width), static_cast<float>(cropSize.height)),
+                       static_cast<float>(angleDeg));
+}
+
+void PhotoPrintMaker::cropFrame(const PhotoStandard & ps,
+                                const Point & crownPoint,
+                                const Point & chinPoint,
+                                Point2d & centerCrop,
+                                Point & chinCrownVec,
+                                Size2d & cropSize) const
+{
+    centerCrop = centerCropEstimation(ps, crownPoint, chinPoint);
+
+    chinCrownVec = crownPoint - chinPoint;
+
+    const auto faceHeightPix = norm(chinCrownVec);
+
+    cropSize.height = ps.photoHeightMM() / ps.faceHeightMM() * faceHeightPix;
+    cropSize.width = ps.photoWidthMM() / ps.photoHeightMM() * cropSize.height;
+}
+
 Mat PhotoPrintMaker::tileCroppedPhoto(const CanvasDefinition & canvas,
                                       const PhotoStandard & ps,
                                       const Mat & croppedImage)
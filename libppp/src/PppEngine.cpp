@@ -7,15 +7,21 @@
 #include "FaceDetector.h"
 #include "LipsDetector.h"
 
+#include "HaarFeatureCache.h"
+#include "HaarFeatures.h"
 #include "ImageStore.h"
+#include "NearDuplicateIndex.h"
 #include "PhotoPrintMaker.h"
+#include "ShapePredictor.h"
+#include "ThreadPool.h"
 
 #include "CanvasDefinition.h"
 #include "PhotoStandard.h"
 
-#include <dlib/image_processing/shape_predictor.h>
-#include <dlib/opencv/cv_image.h>
+#include <fstream>
+#include <iomanip>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <set>
 
 #include "Utilities.h"
 
@@ -26,14 +32,22 @@ PppEngine::PppEngine(IDetectorSPtr pFaceDetector,
                      IDetectorSPtr pLipsDetector,
                      ICrownChinEstimatorSPtr pCrownChinEstimator,
                      IPhotoPrintMakerSPtr pPhotoPrintMaker,
-                     IImageStoreSPtr pImageStore)
-: m_pFaceDetector(pFaceDetector ? pFaceDetector : make_shared<FaceDetector>())
-, m_pEyesDetector(pEyesDetector ? pEyesDetector : make_shared<EyeDetector>())
-, m_pLipsDetector(pLipsDetector ? pLipsDetector : make_shared<LipsDetector>())
+                     IImageStoreSPtr pImageStore,
+                     HaarFeatureCacheSPtr pHaarFeatureCache)
+: m_pThreadPool(make_shared<ThreadPool>())
+, m_pHaarFeatureCache(pHaarFeatureCache ? pHaarFeatureCache : make_shared<HaarFeatureCache>())
+, m_pFaceDetector(pFaceDetector ? pFaceDetector : make_shared<FaceDetector>(m_pThreadPool, m_pHaarFeatureCache))
+, m_pEyesDetector(pEyesDetector ? pEyesDetector : make_shared<EyeDetector>(m_pHaarFeatureCache, m_pThreadPool))
+, m_pLipsDetector(pLipsDetector ? pLipsDetector : make_shared<LipsDetector>(m_pHaarFeatureCache, m_pThreadPool))
 , m_pCrownChinEstimator(pCrownChinEstimator ? pCrownChinEstimator : make_shared<CrownChinEstimator>())
 , m_pPhotoPrintMaker(pPhotoPrintMaker ? pPhotoPrintMaker : make_shared<PhotoPrintMaker>())
 , m_pImageStore(pImageStore ? pImageStore : make_shared<ImageStore>())
 , m_useDlibLandmarkDetection(false)
+, m_minShapeUpdate(0)
+, m_escalateToShapePredictor(false)
+, m_minLandMarksPlausibility(0)
+, m_pNearDuplicateIndex(make_shared<NearDuplicateIndex>())
+, m_reuseNearDuplicateLandMarks(false)
 {
 }
 
@@ -67,26 +81,54 @@ bool PppEngine::configure(const std::string & configString)
 
     const size_t imageStoreSize = config["imageStoreSize"].GetInt();
     m_pImageStore->setStoreSize(imageStoreSize);
+    m_pNearDuplicateIndex->setCapacity(imageStoreSize);
+
+    if (config.HasMember("nearDuplicateDetection"))
+    {
+        auto & nearDuplicateCfg = config["nearDuplicateDetection"];
+        m_reuseNearDuplicateLandMarks = nearDuplicateCfg["enabled"].GetBool();
+        m_pNearDuplicateIndex->setMaxHashDistance(nearDuplicateCfg["maxHashDistance"].GetInt());
+        m_pNearDuplicateIndex->setMaxThumbnailDifference(nearDuplicateCfg["maxThumbnailDifference"].GetDouble());
+    }
 
     m_pPhotoPrintMaker->configure(config);
 
     m_useDlibLandmarkDetection = config["useDlibLandmarkDetection"].GetBool();
 
-    if (m_useDlibLandmarkDetection)
+    m_escalateToShapePredictor = false;
+    if (config.HasMember("detectorEscalation"))
+    {
+        auto & escalationCfg = config["detectorEscalation"];
+        m_escalateToShapePredictor = escalationCfg["enabled"].GetBool();
+        m_minLandMarksPlausibility = escalationCfg["minLandMarksPlausibility"].GetDouble();
+    }
+
+    if (m_useDlibLandmarkDetection || m_escalateToShapePredictor)
     {
         auto & shapePredictor = config["shapePredictor"];
-        m_shapePredictor = std::make_shared<dlib::shape_predictor>();
-        const auto shapePredictorFile = shapePredictor["file"].GetString();
-        if (ifstream(shapePredictorFile).good())
+        // The quantized variant of the model replaces it when enabled, ShapePredictor reads both formats
+        const auto useQuantizedModel = shapePredictor.HasMember("quantized")
+            && shapePredictor["quantized"]["enabled"].GetBool();
+        auto & shapePredictorModel = useQuantizedModel ? shapePredictor["quantized"] : shapePredictor;
+        // The model is loaded into the flattened layout of ShapePredictor, the dlib model is never created
+        const auto shapePredictorFile = shapePredictorModel["file"].GetString();
+        ifstream shapePredictorStream(shapePredictorFile, ios::binary);
+        if (shapePredictorStream.good())
         {
-            dlib::deserialize(shapePredictorFile) >> *m_shapePredictor;
+            m_pShapePredictor = make_shared<ShapePredictor>(shapePredictorStream);
         }
         else
         {
-            const auto shapePredictorFileContent = shapePredictor["data"].GetString();
+            const auto shapePredictorFileContent = shapePredictorModel["data"].GetString();
             auto spData = Utilities::base64Decode(shapePredictorFileContent, strlen(shapePredictorFileContent));
             imemstream stream(reinterpret_cast<char *>(&spData[0]), spData.size());
-            deserialize(*m_shapePredictor, stream);
+            m_pShapePredictor = make_shared<ShapePredictor>(stream);
+        }
+
+        m_minShapeUpdate = 0;
+        if (shapePredictor.HasMember("earlyExit") && shapePredictor["earlyExit"]["enabled"].GetBool())
+        {
+            m_minShapeUpdate = shapePredictor["earlyExit"]["minShapeUpdate"].GetFloat();
         }
 
         // Prepare landmark mapping
@@ -117,11 +159,16 @@ bool PppEngine::configure(const std::string & configString)
     return true;
 }
 
+static runtime_error imageNotFound(const string & imageKey)
+{
+    return runtime_error("Image with key='" + imageKey + "' not found!");
+}
+
 void PppEngine::verifyImageExists(const string & imageKey) const
 {
     if (!m_pImageStore->containsImage(imageKey))
     {
-        throw runtime_error("Image with key='" + imageKey + "' not found!");
+        throw imageNotFound(imageKey);
     }
 }
 
@@ -131,46 +178,118 @@ string PppEngine::setInputImage(const cv::Mat & inputImage) const
 }
 
 bool PppEngine::detectLandMarks(const string & imageKey, LandMarks & landMarks) const
+{
+    // The caller that starts the detection writes straight into its own landmarks, followers get a copy
+    const auto result = m_landMarksFlights.run(imageKey, [&]() {
+        const auto success = detectLandMarksImpl(imageKey, landMarks);
+        return make_pair(success, landMarks);
+    });
+    landMarks = result.second;
+    return result.first;
+}
+
+bool PppEngine::detectLandMarksImpl(const string & imageKey, LandMarks & landMarks) const
 {
     verifyImageExists(imageKey);
     // Convert the image to gray scale as needed by some algorithms
 
     const auto & inputImage = m_pImageStore->getImage(imageKey);
-    cv::Mat grayImage;
-    cvtColor(inputImage, grayImage, cv::COLOR_BGR2GRAY);
+    // The gray image comes from the feature cache, so the cascades running on it or on the input image share the
+    // same pyramid and integral images
+    const auto grayImage = m_pHaarFeatureCache->features(inputImage)->grayImage();
+
+    // Reuse the landmarks of a previous re-encoded or resized copy of this photo if there is one
+    NearDuplicateIndex::ImageSignature imageSignature;
+    if (m_reuseNearDuplicateLandMarks)
+    {
+        imageSignature = NearDuplicateIndex::computeSignature(grayImage);
+        if (m_pNearDuplicateIndex->find(imageSignature, landMarks))
+        {
+            return true;
+        }
+    }
 
     // Detect the face
-    if (!m_pFaceDetector->detectLandMarks(grayImage, landMarks))
+    if (!m_pFaceDetector->detectLandMarks(grayImage, landMarks) || !detectFaceLandMarks(inputImage, landMarks))
     {
         return false;
     }
 
-    if (!m_useDlibLandmarkDetection)
+    if (m_reuseNearDuplicateLandMarks)
     {
-        // Detect the eye pupils
-        if (!m_pEyesDetector->detectLandMarks(grayImage, landMarks))
-        {
-            return false;
-        }
+        m_pNearDuplicateIndex->add(imageSignature, landMarks);
+    }
+    return true;
+}
+
+bool PppEngine::detectAllLandMarks(const string & imageKey, vector<LandMarks> & facesLandMarks) const
+{
+    verifyImageExists(imageKey);
+    const auto & inputImage = m_pImageStore->getImage(imageKey);
+    const auto grayImage = m_pHaarFeatureCache->features(inputImage)->grayImage();
 
-        // Detect mouth landmarks
-        if (!m_pLipsDetector->detectLandMarks(inputImage, landMarks))
+    // The faces are landmarked concurrently, they only share the (thread safe) detectors and caches
+    vector<future<pair<bool, LandMarks>>> faceResults;
+    for (const auto & faceLandMarks : m_pFaceDetector->detectAllLandMarks(grayImage))
+    {
+        faceResults.push_back(m_pThreadPool->submit([this, inputImage, faceLandMarks]() mutable {
+            const auto success = detectFaceLandMarks(inputImage, faceLandMarks);
+            return make_pair(success, faceLandMarks);
+        }));
+    }
+
+    // Faces whose landmarks are not found are dropped, the others keep the order of the face detector
+    facesLandMarks.clear();
+    for (auto & faceResult : faceResults)
+    {
+        const auto result = faceResult.get();
+        if (result.first)
         {
-            return false;
+            facesLandMarks.push_back(result.second);
         }
     }
-    else
+    return !facesLandMarks.empty();
+}
+
+bool PppEngine::detectFaceLandMarks(const cv::Mat & inputImage, LandMarks & landMarks) const
+{
+    // The face may have been found in a rotated image. The other detectors expect an upright face, so they run on
+    // the (exactly) rotated image and the landmarks are mapped back to the input image at the end
+    const auto imageRotation = landMarks.imageRotation;
+    const auto uprightImage = Utilities::rotateImage(inputImage, imageRotation);
+    // A rotated copy is only used for this face, caching its features would evict those of the input image. The
+    // features are given to the eyes and lips detectors, so they share them without caching them either
+    const auto pUprightFeatures = m_pHaarFeatureCache->features(uprightImage, imageRotation == 0);
+    const auto & uprightGrayImage = pUprightFeatures->grayImage();
+
+    auto landMarksFound = false;
+    if (!m_useDlibLandmarkDetection || m_escalateToShapePredictor)
     {
-        using namespace dlib;
-        // Detect the face
-        if (!m_pFaceDetector->detectLandMarks(grayImage, landMarks))
+        // Detect the eye pupils and mouth landmarks
+        const auto faceLandMarks = landMarks;
+        landMarksFound = m_pEyesDetector->detectLandMarksWithFeatures(uprightGrayImage, pUprightFeatures, landMarks)
+            && m_pLipsDetector->detectLandMarksWithFeatures(uprightImage, pUprightFeatures, landMarks);
+
+        if (m_escalateToShapePredictor
+            && (!landMarksFound || landMarks.geometryPlausibility() < m_minLandMarksPlausibility))
+        {
+            // Start over from the face for the shape predictor
+            landMarks = faceLandMarks;
+            landMarksFound = false;
+        }
+        else if (!landMarksFound)
         {
             return false;
         }
-        array2d<bgr_pixel> dlibImage;
-        assign_image(dlibImage, cv_image<bgr_pixel>(inputImage));
+    }
+
+    if (!landMarksFound)
+    {
+        // The shape predictor only samples pixels around the face found above, straight from the image
         const auto faceRect = Utilities::convert(landMarks.vjFaceRect);
-        auto shape = (*m_shapePredictor)(dlibImage, faceRect);
+        size_t numLevelsRun;
+        auto shape = (*m_pShapePredictor)(uprightImage, faceRect, m_minShapeUpdate, numLevelsRun);
+        landMarks.shapePredictorLevels = static_cast<int>(numLevelsRun);
 
         landMarks.vjFaceRect = Utilities::convert(faceRect);
 
@@ -187,7 +306,16 @@ bool PppEngine::detectLandMarks(const string & imageKey, LandMarks & landMarks)
     }
 
     // Estimate chin and crown point (maths from existing landmarks)
-    return m_pCrownChinEstimator->estimateCrownChin(landMarks);
+    if (!m_pCrownChinEstimator->estimateCrownChin(landMarks))
+    {
+        return false;
+    }
+
+    if (imageRotation != 0)
+    {
+        landMarks = landMarks.rotated(-imageRotation, uprightGrayImage.size());
+    }
+    return true;
 }
 
 cv::Point PppEngine::getLandMark(const dlib::full_object_detection & shape, LandMarkType type) const
@@ -202,6 +330,18 @@ cv::Point PppEngine::getLandMark(const dlib::full_object_detection & shape, Land
     return result;
 }
 
+bool PppEngine::estimateCrownChin(LandMarks & landMarks) const
+{
+    return m_pCrownChinEstimator->estimateCrownChin(landMarks);
+}
+
+cv::RotatedRect PppEngine::cropGeometry(const PhotoStandard & ps,
+                                        const cv::Point & crownMark,
+                                        const cv::Point & chinMark) const
+{
+    return m_pPhotoPrintMaker->cropGeometry(crownMark, chinMark, ps);
+}
+
 cv::Mat PppEngine::cropPicture(const string & imageKey,
                                PhotoStandard & ps,
                                CanvasDefinition & canvas,
@@ -209,8 +349,36 @@ cv::Mat PppEngine::cropPicture(const string & imageKey,
                                cv::Point & chinMark) const
 {
     verifyImageExists(imageKey);
-    const auto & inputImage = m_pImageStore->getImage(imageKey);
-    return m_pPhotoPrintMaker->cropPicture(inputImage, crownMark, chinMark, ps);
+
+    // Crop from the smallest pyramid level that still has the resolution needed to print the photo in the canvas,
+    // that reads less memory for large inputs and avoids aliasing when the crop gets resized for printing
+    const auto cropHeightPix = ps.photoHeightMM() / ps.faceHeightMM() * norm(crownMark - chinMark);
+    const auto printHeightPix = canvas.resolution_ppmm() * ps.photoHeightMM();
+    const auto pImagePyramid = m_pImageStore->getImagePyramid(imageKey);
+    if (!pImagePyramid)
+    {
+        // The image was evicted from the store since it was checked
+        throw imageNotFound(imageKey);
+    }
+    auto levelScale = 1.0;
+    const auto levelImage = pImagePyramid->levelForScale(printHeightPix / cropHeightPix, levelScale);
+    const cv::Point levelCrownMark(ROUND_INT(crownMark.x * levelScale), ROUND_INT(crownMark.y * levelScale));
+    const cv::Point levelChinMark(ROUND_INT(chinMark.x * levelScale), ROUND_INT(chinMark.y * levelScale));
+    return m_pPhotoPrintMaker->cropPicture(levelImage, levelCrownMark, levelChinMark, ps);
+}
+
+static string tiledPrintRequestKey(const string & imageKey,
+                                   const PhotoStandard & ps,
+                                   const CanvasDefinition & canvas,
+                                   const cv::Point & crownMark,
+                                   const cv::Point & chinMark)
+{
+    stringstream ss;
+    ss << imageKey << hexfloat << '|' << ps.photoWidthMM() << '|' << ps.photoHeightMM() << '|' << ps.faceHeightMM()
+       << '|' << ps.eyesHeightMM() << '|' << canvas.width_mm() << '|' << canvas.height_mm() << '|'
+       << canvas.resolution_ppmm() << '|' << canvas.border() << '|' << crownMark.x << ',' << crownMark.y << '|'
+       << chinMark.x << ',' << chinMark.y;
+    return ss.str();
 }
 
 cv::Mat PppEngine::createTiledPrint(const string & imageKey,
@@ -219,6 +387,17 @@ cv::Mat PppEngine::createTiledPrint(const string & imageKey,
                                     cv::Point & crownMark,
                                     cv::Point & chinMark) const
 {
+    const auto requestKey = tiledPrintRequestKey(imageKey, ps, canvas, crownMark, chinMark);
+    return m_tiledPrintFlights.run(requestKey,
+                                   [&]() { return createTiledPrintImpl(imageKey, ps, canvas, crownMark, chinMark); });
+}
+
+cv::Mat PppEngine::createTiledPrintImpl(const string & imageKey,
+                                        PhotoStandard & ps,
+                                        CanvasDefinition & canvas,
+                                        cv::Point & crownMark,
+                                        cv::Point & chinMark) const
+{
 
     const auto croppedImage = cropPicture(imageKey, ps, canvas, crownMark, chinMark);
 
@@ -226,3 +405,36 @@ cv::Mat PppEngine::createTiledPrint(const string & imageKey,
 
     return tiledPrintPhoto;
 }
+
+cv::Mat PppEngine::createPreview(const string & imageKey,
+                                 PhotoStandard & ps,
+                                 CanvasDefinition & canvas,
+                                 cv::Point & crownMark,
+                                 cv::Point & chinMark,
+                                 const cv::Size & maxSize,
+                                 bool tiled) const
+{
+    if (maxSize.width <= 0 || maxSize.height <= 0)
+    {
+        throw runtime_error("Preview size should be greater than zero");
+    }
+    const cv::Size previewSize(min(maxSize.width, kMaxPreviewWidth), min(maxSize.height, kMaxPreviewHeight));
+
+    // Size of what is being previewed in mm and the resolution (pixels per mm) for it to fit the preview size
+    const auto widthMM = tiled ? canvas.width_mm() : ps.photoWidthMM();
+    const auto heightMM = tiled ? canvas.height_mm() : ps.photoHeightMM();
+    const auto previewResolution = min(previewSize.width / widthMM, previewSize.height / heightMM);
+    CanvasDefinition previewCanvas(widthMM, heightMM, previewResolution, "mm");
+
+    const auto croppedImage = cropPicture(imageKey, ps, previewCanvas, crownMark, chinMark);
+    if (tiled)
+    {
+        return m_pPhotoPrintMaker->tileCroppedPhoto(previewCanvas, ps, croppedImage);
+    }
+
+    cv::Mat previewImage;
+    resize(croppedImage,
+           previewImage,
+           cv::Size(ROUND_INT(previewResolution * widthMM), ROUND_INT(previewResolution * heightMM)));
+    return previewImage;
+}
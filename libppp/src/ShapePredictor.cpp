@@ -0,0 +1,431 @@
+#include "ShapePredictor.h"
+
+#include <dlib/image_processing/generic_image.h>
+#include <dlib/image_processing/shape_predictor.h>
+#include <dlib/opencv/cv_image.h>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+const char kQuantizedMagic[4] = { 'P', 'P', 'S', 'P' };
+const uint32_t kQuantizedVersion = 1;
+
+///<- Header of the quantized models, followed by the initial shape and the levels, see build.py for the layout
+struct QuantizedHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t numParts;
+    uint32_t numLevels;
+    uint32_t numSplits;
+};
+
+struct QuantizedLevelHeader
+{
+    uint32_t numTrees;
+    uint32_t numPixels;
+    float deltaScale; ///<- Scale of the offsets of the feature pixels
+};
+
+template <typename T>
+void readArray(istream & stream, size_t count, vector<T> & array)
+{
+    const auto offset = array.size();
+    array.resize(offset + count);
+    if (count > 0 && !stream.read(reinterpret_cast<char *>(array.data() + offset), count * sizeof(T)))
+    {
+        throw runtime_error("Invalid quantized shape predictor model");
+    }
+}
+
+template <typename T>
+void readValue(istream & stream, T & value)
+{
+    if (!stream.read(reinterpret_cast<char *>(&value), sizeof(T)))
+    {
+        throw runtime_error("Invalid quantized shape predictor model");
+    }
+}
+
+///<- Largest distance between the positions of a part in two shapes
+float maxPartMove(const dlib::matrix<float, 0, 1> & shape, const dlib::matrix<float, 0, 1> & movedShape)
+{
+    float maxSquaredMove = 0;
+    for (long k = 0; k < shape.size(); k += 2)
+    {
+        const auto dx = movedShape(k) - shape(k);
+        const auto dy = movedShape(k + 1) - shape(k + 1);
+        maxSquaredMove = max(maxSquaredMove, dx * dx + dy * dy);
+    }
+    return sqrt(maxSquaredMove);
+}
+} // namespace
+
+ShapePredictor::ShapePredictor(istream & stream)
+{
+    // Models serialized by dlib start with the version, an integer whose first byte can't be the one of the magic
+    if (stream.peek() == kQuantizedMagic[0])
+    {
+        loadQuantizedModel(stream);
+    }
+    else
+    {
+        loadDlibModel(stream);
+    }
+}
+
+void ShapePredictor::loadDlibModel(istream & stream)
+{
+    // Same format as dlib::serialize(const shape_predictor &, ostream &)
+    int version = 0;
+    dlib::deserialize(version, stream);
+    if (version != 1)
+    {
+        throw runtime_error("Unexpected version of the shape predictor model");
+    }
+    vector<vector<dlib::impl::regression_tree>> forests;
+    vector<vector<unsigned long>> anchorIndices;
+    vector<vector<dlib::vector<float, 2>>> deltas;
+    dlib::deserialize(m_initialShape, stream);
+    dlib::deserialize(forests, stream);
+    dlib::deserialize(anchorIndices, stream);
+    dlib::deserialize(deltas, stream);
+
+    if (m_initialShape.size() == 0 || m_initialShape.size() % 2 != 0 || forests.size() != anchorIndices.size()
+        || forests.size() != deltas.size())
+    {
+        throw runtime_error("Invalid shape predictor model");
+    }
+
+    // The trees of the models trained by dlib are all complete and of the same depth
+    const auto firstForest = find_if(forests.begin(), forests.end(), [](const vector<dlib::impl::regression_tree> & f) {
+        return !f.empty();
+    });
+    m_numSplits = firstForest == forests.end() ? 0 : firstForest->front().splits.size();
+    const auto shapeSize = static_cast<size_t>(m_initialShape.size());
+    size_t numTrees = 0;
+    for (size_t levelIndex = 0; levelIndex < forests.size(); ++levelIndex)
+    {
+        const auto & forest = forests[levelIndex];
+        if (anchorIndices[levelIndex].size() != deltas[levelIndex].size()
+            || anchorIndices[levelIndex].size() > numeric_limits<uint16_t>::max() + size_t(1))
+        {
+            throw runtime_error("Invalid shape predictor model");
+        }
+
+        Level level;
+        level.firstTree = numTrees;
+        level.numTrees = forest.size();
+        numTrees += forest.size();
+        level.firstPixel = m_anchorIndices.size();
+        level.numPixels = anchorIndices[levelIndex].size();
+        m_levels.push_back(level);
+
+        for (const auto anchorIndex : anchorIndices[levelIndex])
+        {
+            if (anchorIndex >= shapeSize / 2)
+            {
+                throw runtime_error("Invalid shape predictor model");
+            }
+        }
+        m_anchorIndices.insert(
+            m_anchorIndices.end(), anchorIndices[levelIndex].begin(), anchorIndices[levelIndex].end());
+        m_deltas.insert(m_deltas.end(), deltas[levelIndex].begin(), deltas[levelIndex].end());
+
+        for (const auto & tree : forest)
+        {
+            if (tree.splits.size() != m_numSplits || tree.leaf_values.size() != m_numSplits + 1)
+            {
+                throw runtime_error("Unsupported shape predictor model, all the trees must have the same depth");
+            }
+            for (const auto & split : tree.splits)
+            {
+                if (split.idx1 >= level.numPixels || split.idx2 >= level.numPixels)
+                {
+                    throw runtime_error("Invalid shape predictor model");
+                }
+                m_splitPixels1.push_back(static_cast<uint16_t>(split.idx1));
+                m_splitPixels2.push_back(static_cast<uint16_t>(split.idx2));
+                // Differences of pixels are within [-255, 255], so thresholds out of [-256, 255] can be clamped
+                m_splitThresholds.push_back(
+                    static_cast<int16_t>(min(max(floor(split.thresh), -256.0f), 255.0f)));
+            }
+            for (const auto & leafValue : tree.leaf_values)
+            {
+                if (static_cast<size_t>(leafValue.size()) != shapeSize)
+                {
+                    throw runtime_error("Invalid shape predictor model");
+                }
+                m_leafValues.insert(m_leafValues.end(), leafValue.begin(), leafValue.end());
+            }
+        }
+    }
+}
+
+void ShapePredictor::loadQuantizedModel(istream & stream)
+{
+    static_assert(sizeof(QuantizedHeader) == 20 && sizeof(QuantizedLevelHeader) == 12,
+                  "Quantized shape predictor structures don't match the binary format");
+    const uint32_t one = 1;
+    if (*reinterpret_cast<const uint8_t *>(&one) != 1)
+    {
+        throw runtime_error("Quantized shape predictor models are only supported on little-endian platforms");
+    }
+
+    QuantizedHeader header;
+    readValue(stream, header);
+    if (memcmp(header.magic, kQuantizedMagic, sizeof(kQuantizedMagic)) != 0 || header.numParts == 0)
+    {
+        throw runtime_error("Invalid quantized shape predictor model");
+    }
+    if (header.version != kQuantizedVersion)
+    {
+        throw runtime_error("Unsupported quantized shape predictor model version");
+    }
+
+    const size_t shapeSize = 2 * header.numParts;
+    vector<float> initialShape;
+    readArray(stream, shapeSize, initialShape);
+    m_initialShape.set_size(static_cast<long>(shapeSize));
+    copy(initialShape.begin(), initialShape.end(), m_initialShape.begin());
+
+    m_numSplits = header.numSplits;
+    size_t numTrees = 0;
+    vector<uint16_t> anchorIndices;
+    vector<int16_t> deltas;
+    for (uint32_t levelIndex = 0; levelIndex < header.numLevels; ++levelIndex)
+    {
+        QuantizedLevelHeader levelHeader;
+        readValue(stream, levelHeader);
+
+        Level level;
+        level.firstTree = numTrees;
+        level.numTrees = levelHeader.numTrees;
+        numTrees += levelHeader.numTrees;
+        level.firstPixel = m_anchorIndices.size();
+        level.numPixels = levelHeader.numPixels;
+        m_levels.push_back(level);
+
+        // Feature pixels are restored in full precision, they are a tiny part of the model
+        anchorIndices.clear();
+        deltas.clear();
+        readArray(stream, level.numPixels, anchorIndices);
+        readArray(stream, 2 * level.numPixels, deltas);
+        for (size_t i = 0; i < level.numPixels; ++i)
+        {
+            if (anchorIndices[i] >= header.numParts)
+            {
+                throw runtime_error("Invalid quantized shape predictor model");
+            }
+            m_anchorIndices.push_back(anchorIndices[i]);
+            m_deltas.emplace_back(deltas[2 * i] * levelHeader.deltaScale, deltas[2 * i + 1] * levelHeader.deltaScale);
+        }
+
+        const auto firstSplit = m_splitPixels1.size();
+        readArray(stream, level.numTrees * m_numSplits, m_splitPixels1);
+        readArray(stream, level.numTrees * m_numSplits, m_splitPixels2);
+        readArray(stream, level.numTrees * m_numSplits, m_splitThresholds);
+        for (auto split = firstSplit; split < m_splitPixels1.size(); ++split)
+        {
+            if (m_splitPixels1[split] >= level.numPixels || m_splitPixels2[split] >= level.numPixels)
+            {
+                throw runtime_error("Invalid quantized shape predictor model");
+            }
+        }
+        readArray(stream, level.numTrees, m_leafScales);
+        readArray(stream, level.numTrees * (m_numSplits + 1) * shapeSize, m_quantizedLeafValues);
+    }
+    m_isQuantized = true;
+}
+
+size_t ShapePredictor::numParts() const
+{
+    return m_initialShape.size() / 2;
+}
+
+size_t ShapePredictor::numLevels() const
+{
+    return m_levels.size();
+}
+
+bool ShapePredictor::isQuantized() const
+{
+    return m_isQuantized;
+}
+
+dlib::full_object_detection ShapePredictor::operator()(const cv::Mat & image, const dlib::rectangle & faceRect) const
+{
+    size_t numLevelsRun;
+    return (*this)(image, faceRect, 0, numLevelsRun);
+}
+
+vector<dlib::full_object_detection> ShapePredictor::operator()(const cv::Mat & image,
+                                                               const vector<dlib::rectangle> & faceRects) const
+{
+    vector<size_t> numLevelsRun;
+    return (*this)(image, faceRects, 0, numLevelsRun);
+}
+
+dlib::full_object_detection ShapePredictor::operator()(const cv::Mat & image,
+                                                       const dlib::rectangle & faceRect,
+                                                       float minShapeUpdate,
+                                                       size_t & numLevelsRun) const
+{
+    vector<size_t> numLevelsRunPerFace;
+    auto detection = (*this)(image, vector<dlib::rectangle> { faceRect }, minShapeUpdate, numLevelsRunPerFace).front();
+    numLevelsRun = numLevelsRunPerFace.front();
+    return detection;
+}
+
+vector<dlib::full_object_detection> ShapePredictor::operator()(const cv::Mat & image,
+                                                               const vector<dlib::rectangle> & faceRects,
+                                                               float minShapeUpdate,
+                                                               vector<size_t> & numLevelsRun) const
+{
+    // Pixels are read like dlib does, so the intensity of color pixels is the mean of their components
+    if (image.type() == CV_8UC1)
+    {
+        return predict(dlib::cv_image<unsigned char>(image), faceRects, minShapeUpdate, numLevelsRun);
+    }
+    if (image.type() == CV_8UC3)
+    {
+        return predict(dlib::cv_image<dlib::bgr_pixel>(image), faceRects, minShapeUpdate, numLevelsRun);
+    }
+    throw invalid_argument("The shape predictor only supports gray scale and BGR images");
+}
+
+template <typename ImageType>
+vector<dlib::full_object_detection> ShapePredictor::predict(const ImageType & image,
+                                                            const vector<dlib::rectangle> & faceRects,
+                                                            float minShapeUpdate,
+                                                            vector<size_t> & numLevelsRun) const
+{
+    vector<dlib::matrix<float, 0, 1>> shapes(faceRects.size(), m_initialShape);
+    numLevelsRun.assign(faceRects.size(), 0);
+    vector<bool> isConverged(faceRects.size(), false);
+    vector<float> pixelValues;
+    dlib::matrix<float, 0, 1> previousShape;
+    for (const auto & level : m_levels)
+    {
+        // All the faces go through a level before the next one, so the trees of the level are still in the cache
+        for (size_t i = 0; i < faceRects.size(); ++i)
+        {
+            if (isConverged[i])
+            {
+                continue;
+            }
+            if (minShapeUpdate > 0)
+            {
+                previousShape = shapes[i];
+            }
+            extractPixelValues(image, faceRects[i], level, shapes[i], pixelValues);
+            evaluateTrees(level, pixelValues, &shapes[i](0));
+            ++numLevelsRun[i];
+            // Shapes are normalized to the face rectangle, so the moves are already relative to the size of the face
+            isConverged[i] = minShapeUpdate > 0 && maxPartMove(previousShape, shapes[i]) < minShapeUpdate;
+        }
+    }
+
+    vector<dlib::full_object_detection> detections;
+    detections.reserve(faceRects.size());
+    for (size_t i = 0; i < faceRects.size(); ++i)
+    {
+        const auto tformToImage = dlib::impl::unnormalizing_tform(faceRects[i]);
+        vector<dlib::point> parts(numParts());
+        for (size_t k = 0; k < parts.size(); ++k)
+        {
+            parts[k] = tformToImage(dlib::impl::location(shapes[i], k));
+        }
+        detections.emplace_back(faceRects[i], parts);
+    }
+    return detections;
+}
+
+template <typename ImageType>
+void ShapePredictor::extractPixelValues(const ImageType & image,
+                                        const dlib::rectangle & faceRect,
+                                        const Level & level,
+                                        const dlib::matrix<float, 0, 1> & currentShape,
+                                        vector<float> & pixelValues) const
+{
+    // Same computations as dlib::impl::extract_feature_pixel_values, so the same pixels are sampled
+    const dlib::matrix<float, 2, 2> tform
+        = dlib::matrix_cast<float>(dlib::impl::find_tform_between_shapes(m_initialShape, currentShape).get_m());
+    const auto tformToImage = dlib::impl::unnormalizing_tform(faceRect);
+    const auto area = dlib::get_rect(image);
+    const dlib::const_image_view<ImageType> imageView(image);
+
+    pixelValues.resize(level.numPixels);
+    for (size_t i = 0; i < level.numPixels; ++i)
+    {
+        const auto pixelIndex = level.firstPixel + i;
+        const dlib::point p = tformToImage(tform * m_deltas[pixelIndex]
+                                           + dlib::impl::location(currentShape, m_anchorIndices[pixelIndex]));
+        pixelValues[i] = area.contains(p) ? dlib::get_pixel_intensity(imageView[p.y()][p.x()]) : 0;
+    }
+}
+
+void ShapePredictor::evaluateTrees(const Level & level, const vector<float> & pixelValues, float * pShape) const
+{
+    const auto shapeSize = static_cast<int>(m_initialShape.size());
+    const auto numLeaves = m_numSplits + 1;
+    for (auto tree = level.firstTree; tree < level.firstTree + level.numTrees; ++tree)
+    {
+        const auto pPixels1 = m_splitPixels1.data() + tree * m_numSplits;
+        const auto pPixels2 = m_splitPixels2.data() + tree * m_numSplits;
+        const auto pThresholds = m_splitThresholds.data() + tree * m_numSplits;
+
+        // Go to the left child when the difference of the pixels is above the threshold, as dlib does
+        size_t node = 0;
+        while (node < m_numSplits)
+        {
+            const auto isLeft = pixelValues[pPixels1[node]] - pixelValues[pPixels2[node]] > pThresholds[node];
+            node = 2 * node + (isLeft ? 1 : 2);
+        }
+        const auto leafOffset = (tree * numLeaves + node - m_numSplits) * shapeSize;
+        if (m_isQuantized)
+        {
+            addQuantizedLeafValues(m_quantizedLeafValues.data() + leafOffset, m_leafScales[tree], pShape);
+            continue;
+        }
+        const auto pLeafValues = m_leafValues.data() + leafOffset;
+
+        auto k = 0;
+#if CV_SIMD
+        for (; k <= shapeSize - cv::v_float32::nlanes; k += cv::v_float32::nlanes)
+        {
+            cv::v_store(pShape + k, cv::vx_load(pShape + k) + cv::vx_load(pLeafValues + k));
+        }
+#endif
+        for (; k < shapeSize; ++k)
+        {
+            pShape[k] += pLeafValues[k];
+        }
+    }
+}
+
+void ShapePredictor::addQuantizedLeafValues(const int8_t * pLeafValues, float scale, float * pShape) const
+{
+    const auto shapeSize = static_cast<int>(m_initialShape.size());
+    auto k = 0;
+#if CV_SIMD
+    const auto scales = cv::vx_setall_f32(scale);
+    for (; k <= shapeSize - cv::v_float32::nlanes; k += cv::v_float32::nlanes)
+    {
+        const auto leafValues = cv::v_cvt_f32(cv::vx_load_expand_q(pLeafValues + k));
+        cv::v_store(pShape + k, cv::v_muladd(leafValues, scales, cv::vx_load(pShape + k)));
+    }
+#endif
+    for (; k < shapeSize; ++k)
+    {
+        pShape[k] += pLeafValues[k] * scale;
+    }
+}
@@ -0,0 +1,144 @@
+#include "StageGraph.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+StageGraph::StageGraph(ThreadPoolSPtr pThreadPool)
+: m_pThreadPool(pThreadPool)
+, m_numUnfinishedStages(0)
+{
+}
+
+size_t StageGraph::addStage(Stage stage, const vector<size_t> & dependencies)
+{
+    const auto index = m_nodes.size();
+    for (const auto dependency : dependencies)
+    {
+        if (dependency >= index)
+        {
+            throw invalid_argument("Stages can only depend on the stages added before them");
+        }
+        m_nodes[dependency].dependents.push_back(index);
+    }
+    m_nodes.push_back(Node { move(stage), {}, dependencies.size(), 0, false, StageState::PENDING });
+    return index;
+}
+
+bool StageGraph::run()
+{
+    unique_lock<mutex> lock(m_mutex);
+    m_numUnfinishedStages = m_nodes.size();
+    m_pException = nullptr;
+    for (auto & node : m_nodes)
+    {
+        node.numPendingDependencies = node.numDependencies;
+        node.dependencyFailed = false;
+        node.state = StageState::PENDING;
+    }
+    lock.unlock();
+
+    if (m_pThreadPool)
+    {
+        for (size_t i = 0; i < m_nodes.size(); ++i)
+        {
+            if (m_nodes[i].numDependencies == 0)
+            {
+                scheduleStage(i);
+            }
+        }
+    }
+    else
+    {
+        // The dependencies of a stage were added before it, so they completed when it is reached
+        for (size_t i = 0; i < m_nodes.size(); ++i)
+        {
+            runStage(i);
+        }
+    }
+
+    lock.lock();
+    m_allFinished.wait(lock, [this]() { return m_numUnfinishedStages == 0; });
+    if (m_pException)
+    {
+        rethrow_exception(m_pException);
+    }
+    return all_of(
+        m_nodes.begin(), m_nodes.end(), [](const Node & node) { return node.state == StageState::SUCCEEDED; });
+}
+
+bool StageGraph::succeeded(size_t stage) const
+{
+    lock_guard<mutex> lg(m_mutex);
+    return m_nodes.at(stage).state == StageState::SUCCEEDED;
+}
+
+void StageGraph::runStage(size_t index)
+{
+    auto & node = m_nodes[index];
+    bool dependencyFailed;
+    {
+        lock_guard<mutex> lg(m_mutex);
+        dependencyFailed = node.dependencyFailed;
+    }
+
+    auto success = false;
+    if (!dependencyFailed)
+    {
+        try
+        {
+            success = node.stage();
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lg(m_mutex);
+            if (!m_pException)
+            {
+                m_pException = current_exception();
+            }
+        }
+    }
+    finishStage(index, success);
+}
+
+void StageGraph::finishStage(size_t index, bool success)
+{
+    vector<size_t> readyStages;
+    ThreadPool * pThreadPool;
+    {
+        lock_guard<mutex> lg(m_mutex);
+        // The graph may be destroyed as soon as the last stage finishes, nothing of it is used after that
+        pThreadPool = m_pThreadPool.get();
+        auto & node = m_nodes[index];
+        node.state = success ? StageState::SUCCEEDED : StageState::FAILED;
+        for (const auto dependent : node.dependents)
+        {
+            auto & dependentNode = m_nodes[dependent];
+            dependentNode.dependencyFailed |= !success;
+            if (--dependentNode.numPendingDependencies == 0)
+            {
+                readyStages.push_back(dependent);
+            }
+        }
+        if (--m_numUnfinishedStages == 0)
+        {
+            m_allFinished.notify_all();
+        }
+    }
+
+    if (pThreadPool)
+    {
+        for (const auto readyStage : readyStages)
+        {
+            scheduleStage(readyStage);
+        }
+    }
+}
+
+void StageGraph::scheduleStage(size_t index)
+{
+    // The stage reports its result through the graph, the future of the task is not needed
+    m_pThreadPool->submit([this, index]() { runStage(index); });
+}
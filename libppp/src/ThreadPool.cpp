@@ -0,0 +1,65 @@
+#include "ThreadPool.h"
+
+namespace
+{
+///<- Pool the current thread works for, if any
+thread_local const ThreadPool * t_pCurrentPool = nullptr;
+}
+
+ThreadPool::ThreadPool(size_t numThreads)
+: m_stopping(false)
+{
+#ifdef EMSCRIPTEN
+    // The web assembly build has no thread support, tasks run in the calling thread
+    numThreads = 0;
+#endif
+    m_workers.reserve(numThreads);
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lg(m_mutex);
+        m_stopping = true;
+        m_tasks.clear();
+    }
+    m_condition.notify_all();
+    for (auto & worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::numThreads() const
+{
+    return m_workers.size();
+}
+
+bool ThreadPool::isWorkerThread() const
+{
+    return t_pCurrentPool == this;
+}
+
+void ThreadPool::workerLoop()
+{
+    t_pCurrentPool = this;
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> ul(m_mutex);
+            m_condition.wait(ul, [this]() { return m_stopping || !m_tasks.empty(); });
+            if (m_stopping)
+            {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
@@ -1,4 +1,5 @@
 #include "Utilities.h"
+#include "HaarCascade.h"
 
 #include <fstream>
 #include <mutex>
@@ -7,12 +8,6 @@
 #include <base64_kernel_1.h>
 #include <dlib/geometry/rectangle.h>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/objdetect/objdetect.hpp>
-
-namespace cv
-{
-FWD_DECL(CascadeClassifier)
-}
 
 static uint8_t fromChar(char ch)
 {
@@ -152,25 +147,21 @@ std::string Utilities::base64Encode(const std::vector<BYTE> & rawStr)
     return result;
 }
 
-cv::CascadeClassifierSPtr Utilities::loadClassifierFromBase64(const char * haarCascadeBase64Data)
+HaarCascadeSPtr Utilities::loadClassifierFromBase64(const char * haarCascadeBase64Data)
 {
-    auto xmlHaarCascade = base64Decode(haarCascadeBase64Data, strlen(haarCascadeBase64Data));
-    auto classifier = std::make_shared<cv::CascadeClassifier>();
-    const std::string s(xmlHaarCascade.begin(), xmlHaarCascade.end());
-    try
-    {
-        cv::FileStorage fs(s, cv::FileStorage::READ | cv::FileStorage::MEMORY);
-        classifier->read(fs.getFirstTopLevelNode());
-        if (classifier->empty())
-        {
-            throw std::runtime_error("Failed to load classifier from configuration");
-        }
-        return classifier;
+    auto haarCascadeData = base64Decode(haarCascadeBase64Data, strlen(haarCascadeBase64Data));
+    if (HaarCascade::isBinary(haarCascadeData.data(), haarCascadeData.size()))
+    {
+        return std::make_shared<HaarCascade>(haarCascadeData.data(), haarCascadeData.size());
     }
-    catch (std::exception & e)
+
+    const std::string s(haarCascadeData.begin(), haarCascadeData.end());
+    cv::FileStorage fs(s, cv::FileStorage::READ | cv::FileStorage::MEMORY);
+    if (!fs.isOpened())
     {
-        throw e;
+        throw std::runtime_error("Failed to load classifier from configuration");
     }
+    return std::make_shared<HaarCascade>(fs.getFirstTopLevelNode());
     // static std::mutex g_mutex;
     // std::lock_guard<std::mutex> lg(g_mutex);
     // std::string tmpFile = "cascade.xml";
@@ -214,26 +205,97 @@ uint32_t Utilities::crc32(uint32_t crc, const uint8_t * begin, const uint8_t * e
     return crc;
 }
 
-cv::Mat Utilities::rotateImage(const cv::Mat & inputImage, int rotAngleDegrees)
+uint64_t Utilities::perceptualHash(const cv::Mat & image)
 {
-    if (rotAngleDegrees == 0)
-        return inputImage;
+    cv::Mat grayImage = image;
+    if (image.channels() != 1)
+    {
+        cv::cvtColor(image, grayImage, cv::COLOR_BGR2GRAY);
+    }
 
-    static const std::set<int> validAngles = {90, 180, 270 };
-    const auto absAngle = std::abs(rotAngleDegrees);
-    if (validAngles.find(absAngle) == validAngles.end())
+    cv::Mat thumbnail;
+    cv::resize(grayImage, thumbnail, cv::Size(9, 8), 0, 0, cv::INTER_AREA);
+
+    uint64_t hash = 0;
+    for (auto row = 0; row < thumbnail.rows; ++row)
+    {
+        const auto pixels = thumbnail.ptr<uint8_t>(row);
+        for (auto col = 0; col < thumbnail.cols - 1; ++col)
+        {
+            hash = (hash << 1) | (pixels[col] > pixels[col + 1] ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+int Utilities::hammingDistance(uint64_t hash1, uint64_t hash2)
+{
+    auto diff = hash1 ^ hash2;
+    auto numBits = 0;
+    while (diff)
+    {
+        diff &= diff - 1;
+        ++numBits;
+    }
+    return numBits;
+}
+
+// Normalizes a rotation angle to 0, 90, 180 or 270 degrees
+static int normalizedRightAngle(int rotAngleDegrees)
+{
+    const auto angle = (rotAngleDegrees % 360 + 360) % 360;
+    if (angle % 90 != 0)
+    {
         throw std::logic_error("Provided rotation angle is not supported.");
+    }
+    return angle;
+}
 
-    const auto h = inputImage.size().height;
-    const auto w = inputImage.size().width;
+cv::Mat Utilities::rotateImage(const cv::Mat & inputImage, int rotAngleDegrees)
+{
+    const auto angle = normalizedRightAngle(rotAngleDegrees);
+    if (angle == 0)
+    {
+        return inputImage;
+    }
 
-    const auto M = cv::getRotationMatrix2D(cv::Point2f(h / 2.0, w / 2.0), rotAngleDegrees, 1);
-    const auto size = absAngle == 90 || absAngle == 270 ? cv::Size(h, w) : cv::Size(w, h);
     cv::Mat rotatedImage;
-    cv::warpAffine(inputImage, rotatedImage, M, size);
+    const auto rotateCode = angle == 90 ? cv::ROTATE_90_COUNTERCLOCKWISE
+                                        : angle == 180 ? cv::ROTATE_180 : cv::ROTATE_90_CLOCKWISE;
+    cv::rotate(inputImage, rotatedImage, rotateCode);
     return rotatedImage;
 }
 
+cv::Point Utilities::rotatePoint(const cv::Point & point, const cv::Size & imageSize, int rotAngleDegrees)
+{
+    const auto w = imageSize.width;
+    const auto h = imageSize.height;
+    switch (normalizedRightAngle(rotAngleDegrees))
+    {
+        case 90:
+            return cv::Point(point.y, w - 1 - point.x);
+        case 180:
+            return cv::Point(w - 1 - point.x, h - 1 - point.y);
+        case 270:
+            return cv::Point(h - 1 - point.y, point.x);
+        default:
+            return point;
+    }
+}
+
+cv::Rect Utilities::rotateRect(const cv::Rect & rect, const cv::Size & imageSize, int rotAngleDegrees)
+{
+    if (rect.area() <= 0)
+    {
+        return rect;
+    }
+    // Rotate the first and last pixels of the rectangle
+    const auto p1 = rotatePoint(rect.tl(), imageSize, rotAngleDegrees);
+    const auto p2 = rotatePoint(rect.br() - cv::Point(1, 1), imageSize, rotAngleDegrees);
+    return cv::Rect(cv::Point(std::min(p1.x, p2.x), std::min(p1.y, p2.y)),
+                    cv::Point(std::max(p1.x, p2.x) + 1, std::max(p1.y, p2.y) + 1));
+}
+
 /* Update a running CRC with the bytes buf[0..len-1]--the CRC
 should be initialized to all 1's, and the transmitted value
 is the 1's complement of the final running CRC (see the
@@ -8,7 +8,11 @@
 
 #include <regex>
 
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 
 #ifdef EMSCRIPTEN
 #include <emscripten.h>
@@ -26,6 +30,15 @@ cv::Point fromJson(rapidjson::Value & v)
     return cv::Point(v["x"].GetInt(), v["y"].GetInt());
 }
 
+template <typename T>
+std::vector<BYTE> toBytes(const T & x)
+{
+    vector<BYTE> v(static_cast<const BYTE *>(static_cast<const void *>(&x)),
+                   static_cast<const BYTE *>(static_cast<const void *>(&x)) + sizeof(x));
+    reverse(v.begin(), v.end()); // Little endian notation
+    return v;
+}
+
 PublicPppEngine::PublicPppEngine()
 : m_pPppEngine(new PppEngine)
 {
@@ -78,6 +91,74 @@ std::string PublicPppEngine::detectLandmarks(const std::string & imageId) const
     return landMarks.toJson();
 }
 
+std::string PublicPppEngine::detectAllLandmarks(const std::string & imageId) const
+{
+    std::vector<LandMarks> facesLandMarks;
+    m_pPppEngine->detectAllLandMarks(imageId, facesLandMarks);
+    std::string result = "[";
+    for (const auto & landMarks : facesLandMarks)
+    {
+        result += (result.size() > 1 ? "," : "") + landMarks.toJson();
+    }
+    return result + "]";
+}
+
+std::string PublicPppEngine::estimateCrownChin(const std::string & request) const
+{
+    rapidjson::Document d;
+    if (d.Parse(request.c_str()).HasParseError() || !d.IsObject())
+    {
+        throw std::runtime_error("The crown and chin estimation request is not a valid Json object");
+    }
+    if (!d.HasMember("landmarks") || !d["landmarks"].IsObject())
+    {
+        throw std::runtime_error("The crown and chin estimation request has no landmarks");
+    }
+    for (const auto name : { "eyeLeftPupil", "eyeRightPupil", "lipLeftCorner", "lipRightCorner" })
+    {
+        if (!d["landmarks"].HasMember(name))
+        {
+            throw std::runtime_error(std::string("Landmark '") + name + "' is required to estimate the crown and chin");
+        }
+    }
+
+    auto landMarks = LandMarks::fromJson(d["landmarks"]);
+    if (!m_pPppEngine->estimateCrownChin(landMarks))
+    {
+        throw std::runtime_error("Unable to estimate the crown and chin points from the given landmarks");
+    }
+
+    if (!d.HasMember("standard"))
+    {
+        return landMarks.toJson();
+    }
+
+    if (!d["standard"].IsObject())
+    {
+        throw std::runtime_error("The photo standard should be a Json object");
+    }
+    const auto ps = PhotoStandard::fromJson(d["standard"]);
+    const auto cropRect = m_pPppEngine->cropGeometry(*ps, landMarks.crownPoint, landMarks.chinPoint);
+
+    rapidjson::Document result;
+    result.Parse(landMarks.toJson().c_str());
+    auto & alloc = result.GetAllocator();
+    rapidjson::Value center(rapidjson::kObjectType);
+    center.AddMember("x", cropRect.center.x, alloc);
+    center.AddMember("y", cropRect.center.y, alloc);
+    rapidjson::Value cropRectJson(rapidjson::kObjectType);
+    cropRectJson.AddMember("center", center, alloc);
+    cropRectJson.AddMember("width", cropRect.size.width, alloc);
+    cropRectJson.AddMember("height", cropRect.size.height, alloc);
+    cropRectJson.AddMember("angle", cropRect.angle, alloc);
+    result.AddMember("cropRect", cropRectJson, alloc);
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    result.Accept(writer);
+    return std::string(buffer.GetString());
+}
+
 std::string PublicPppEngine::createTiledPrint(const std::string & imageId, const std::string & request) const
 {
     rapidjson::Document d;
@@ -109,13 +190,70 @@ std::string PublicPppEngine::createTiledPrint(const std::string & imageId, const
     return std::string(pictureData.begin(), pictureData.end());
 }
 
-template <typename T>
-std::vector<BYTE> toBytes(const T & x)
+std::string PublicPppEngine::createPreview(const std::string & imageId, const std::string & request) const
 {
-    vector<BYTE> v(static_cast<const BYTE *>(static_cast<const void *>(&x)),
-                   static_cast<const BYTE *>(static_cast<const void *>(&x)) + sizeof(x));
-    reverse(v.begin(), v.end()); // Little endian notation
-    return v;
+    rapidjson::Document d;
+    d.Parse(request.c_str());
+
+    const auto ps = PhotoStandard::fromJson(d["standard"]);
+    const auto canvas = CanvasDefinition::fromJson(d["canvas"]);
+    auto crownPoint = fromJson(d["crownPoint"]);
+    auto chinPoint = fromJson(d["chinPoint"]);
+
+    cv::Size maxSize(640, 480);
+    auto tiled = false;
+    string format = "jpeg";
+    auto quality = 75;
+    if (d.HasMember("preview"))
+    {
+        auto & preview = d["preview"];
+        const auto readSize = [&preview](const char * name, int & size) {
+            if (preview.HasMember(name))
+            {
+                if (!preview[name].IsInt() || preview[name].GetInt() <= 0)
+                {
+                    throw std::runtime_error(std::string("Preview '") + name + "' should be a positive integer");
+                }
+                size = preview[name].GetInt();
+            }
+        };
+        readSize("maxWidth", maxSize.width);
+        readSize("maxHeight", maxSize.height);
+        if (preview.HasMember("tiled"))
+        {
+            tiled = preview["tiled"].GetBool();
+        }
+        if (preview.HasMember("format"))
+        {
+            format = preview["format"].GetString();
+        }
+        if (preview.HasMember("quality"))
+        {
+            quality = preview["quality"].GetInt();
+        }
+    }
+
+    const auto result = m_pPppEngine->createPreview(imageId, *ps, *canvas, crownPoint, chinPoint, maxSize, tiled);
+
+    std::vector<BYTE> pictureData;
+    if (format == "rgba")
+    {
+        cv::Mat rgbaImage;
+        cvtColor(result, rgbaImage, cv::COLOR_BGR2RGBA);
+        pictureData = toBytes(static_cast<uint32_t>(rgbaImage.cols));
+        const auto heightBytes = toBytes(static_cast<uint32_t>(rgbaImage.rows));
+        pictureData.insert(pictureData.end(), heightBytes.begin(), heightBytes.end());
+        pictureData.insert(pictureData.end(), rgbaImage.datastart, rgbaImage.dataend);
+    }
+    else if (format == "jpeg")
+    {
+        imencode(".jpg", result, pictureData, { cv::IMWRITE_JPEG_QUALITY, quality });
+    }
+    else
+    {
+        throw std::runtime_error("Unsupported preview format '" + format + "'");
+    }
+    return std::string(pictureData.begin(), pictureData.end());
 }
 
 /*  The pHYs chunk specifies the intended pixel size or aspect ratio for display of the image. It contains:
@@ -153,6 +291,17 @@ void PublicPppEngine::setPngResolutionDpi(std::vector<BYTE> & imageStream, doubl
 }
 
 #pragma region C Interface
+/*!@brief Copies a string with its terminating null into a buffer of the caller, throwing if it does not fit !*/
+void copyToBuffer(const std::string & str, char * buffer, int bufferSize)
+{
+    if (static_cast<int>(str.size()) >= bufferSize)
+    {
+        throw std::runtime_error("The output takes " + std::to_string(str.size() + 1) + " bytes, the buffer only "
+                                 + std::to_string(bufferSize));
+    }
+    strcpy(buffer, str.c_str());
+}
+
 #define TRYRUN(statements)                                                                                             \
     try                                                                                                                \
     {                                                                                                                  \
@@ -185,6 +334,20 @@ bool detect_landmarks(const char * img_id, char * landmarks)
     TRYRUN(auto landmarksStr = g_c_pppInstance.detectLandmarks(img_id); strcpy(landmarks, landmarksStr.c_str()););
 }
 
+EMSCRIPTEN_KEEPALIVE
+bool detect_all_landmarks(const char * img_id, char * landmarks, int landmarks_size)
+{
+    // The landmarks of every face are returned, so their size is only bounded by the number of faces
+    TRYRUN(auto landmarksStr = g_c_pppInstance.detectAllLandmarks(img_id);
+           copyToBuffer(landmarksStr, landmarks, landmarks_size););
+}
+
+EMSCRIPTEN_KEEPALIVE
+bool estimate_crown_chin(const char * request, char * landmarks)
+{
+    TRYRUN(auto landmarksStr = g_c_pppInstance.estimateCrownChin(request); strcpy(landmarks, landmarksStr.c_str()););
+}
+
 EMSCRIPTEN_KEEPALIVE
 int create_tiled_print(const char * img_id, const char * request, char * out_buf)
 {
@@ -202,4 +365,26 @@ int create_tiled_print(const char * img_id, const char * request, char * out_buf
     }
 }
 
+EMSCRIPTEN_KEEPALIVE
+int create_preview(const char * img_id, const char * request, char * out_buf, int out_buf_size)
+{
+    try
+    {
+        auto output = g_c_pppInstance.createPreview(img_id, request);
+        const auto out_size = static_cast<int>(output.size());
+        if (out_size > out_buf_size)
+        {
+            throw std::runtime_error("The preview takes " + std::to_string(out_size) + " bytes, the output buffer only "
+                                     + std::to_string(out_buf_size));
+        }
+        copy(output.begin(), output.end(), out_buf);
+        return out_size;
+    }
+    catch (const std::exception & ex)
+    {
+        g_last_error = ex.what();
+        return 0;
+    }
+}
+
 #pragma endregion
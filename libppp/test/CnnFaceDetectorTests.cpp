@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include "CnnFaceDetector.h"
+#include "FaceDetector.h"
+#include "TestHelpers.h"
+#include "Utilities.h"
+
+#include <chrono>
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+class CnnFaceDetectorTests : public testing::Test
+{
+protected:
+    CnnFaceDetector m_cnnFaceDetector;
+    cv::Mat m_grayImage;
+
+    void SetUp() override
+    {
+        m_grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+
+        rapidjson::Document config;
+        config.Parse(cnnConfigString().c_str());
+        m_cnnFaceDetector.configure(config);
+    }
+
+    /*!@brief Gets the configuration with the CNN face detector enabled and its model (downloaded by build.py) !*/
+    static std::string cnnConfigString()
+    {
+        std::string configString;
+        readConfigFromFile("", configString);
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        auto & cnnFaceDetectorCfg = config["cnnFaceDetector"];
+        cnnFaceDetectorCfg["enabled"].SetBool(true);
+        const auto modelFile = resolvePath("libppp/share/mmod_human_face_detector.dat");
+        cnnFaceDetectorCfg["file"].SetString(modelFile.c_str(), config.GetAllocator());
+
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        config.Accept(writer);
+        return buffer.GetString();
+    }
+};
+
+TEST_F(CnnFaceDetectorTests, FindsTheFaceInAllOrientations)
+{
+    for (const auto angle : { 0, 90, -90, 180 })
+    {
+        const auto rotatedImage = Utilities::rotateImage(m_grayImage, angle);
+
+        LandMarks landmarks;
+        ASSERT_TRUE(m_cnnFaceDetector.detectLandMarks(rotatedImage, landmarks)) << "No face found at " << angle;
+        EXPECT_EQ(0, (angle + landmarks.imageRotation) % 360);
+        EXPECT_GT(landmarks.faceConfidence, 0);
+
+        // The face is within the upright image
+        const auto uprightSize = Utilities::rotateImage(rotatedImage, landmarks.imageRotation).size();
+        EXPECT_GT((landmarks.vjFaceRect & cv::Rect(cv::Point(), uprightSize)).area(),
+                  0.9 * landmarks.vjFaceRect.area());
+    }
+}
+
+TEST_F(CnnFaceDetectorTests, BatchedInferenceMatchesSingleImages)
+{
+    cv::Mat smallImage;
+    cv::resize(m_grayImage, smallImage, cv::Size(), 0.5, 0.5, cv::INTER_AREA);
+    const std::vector<cv::Mat> images
+        = { smallImage, Utilities::rotateImage(smallImage, 180), Utilities::rotateImage(smallImage, 90) };
+
+    const auto batchDetections = m_cnnFaceDetector.detect(images);
+    ASSERT_EQ(images.size(), batchDetections.size());
+    EXPECT_FALSE(batchDetections[0].empty());
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        const auto singleDetections = m_cnnFaceDetector.detect({ images[i] });
+        ASSERT_EQ(1, singleDetections.size());
+        ASSERT_EQ(singleDetections[0].size(), batchDetections[i].size()) << "Image " << i;
+        for (size_t k = 0; k < singleDetections[0].size(); ++k)
+        {
+            EXPECT_EQ(singleDetections[0][k].rect, batchDetections[i][k].rect);
+            EXPECT_NEAR(singleDetections[0][k].detection_confidence, batchDetections[i][k].detection_confidence, 1e-4);
+        }
+    }
+}
+
+TEST_F(CnnFaceDetectorTests, DISABLED_CompareWithHaarAndHogDetectors)
+{
+    const auto configString = cnnConfigString();
+    const auto createFaceDetector = [&configString](bool useHog, bool useCnn) {
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        config["useDlibFaceDetection"].SetBool(useHog);
+        config["cnnFaceDetector"]["enabled"].SetBool(useCnn);
+        auto pFaceDetector = std::make_shared<FaceDetector>();
+        pFaceDetector->configure(config);
+        return pFaceDetector;
+    };
+
+    std::vector<cv::Mat> workingImages;
+    for (const auto & detectorName : { "Haar", "HOG", "CNN" })
+    {
+        const auto useHog = std::string(detectorName) == "HOG";
+        const auto useCnn = std::string(detectorName) == "CNN";
+        auto pFaceDetector = createFaceDetector(useHog, useCnn);
+        std::chrono::duration<double, std::milli> elapsedTime(0);
+        auto numImages = 0;
+        auto numMissed = 0;
+
+        const auto process = [&](const std::string & imagePrefix,
+                                 cv::Mat & rgbImage,
+                                 cv::Mat & grayImage,
+                                 const LandMarks & manualAnnotations,
+                                 LandMarks & detectedLandMarks) -> bool {
+            const auto start = std::chrono::steady_clock::now();
+            const auto isDetected = pFaceDetector->detectLandMarks(grayImage, detectedLandMarks);
+            elapsedTime += std::chrono::steady_clock::now() - start;
+
+            // Missed if the rectangle doesn't contain both eyes and mouth points
+            const auto faceRect = detectedLandMarks.vjFaceRect;
+            const auto isAccurate = isDetected && IN_ROI(faceRect, manualAnnotations.eyeLeftPupil)
+                && IN_ROI(faceRect, manualAnnotations.eyeRightPupil)
+                && IN_ROI(faceRect, manualAnnotations.lipLeftCorner)
+                && IN_ROI(faceRect, manualAnnotations.lipRightCorner);
+            ++numImages;
+            numMissed += isAccurate ? 0 : 1;
+            if (useCnn)
+            {
+                cv::Mat workingImage;
+                cv::resize(grayImage, workingImage, cv::Size(360, 480), 0, 0, cv::INTER_AREA);
+                workingImages.push_back(workingImage);
+            }
+            return isAccurate;
+        };
+
+        std::vector<ResultData> rd;
+        processDatabase(process,
+                        std::vector<std::string>(),
+                        "research/mugshot_frontal_original_all/via_region_data_dpd.csv",
+                        rd);
+
+        ASSERT_GT(numImages, 0);
+        std::cout << detectorName << " face detector: " << elapsedTime.count() / numImages << " ms per image, "
+                  << numMissed << "/" << numImages << " missed faces" << std::endl;
+    }
+
+    // Throughput of the batched inference on images of the same size, upright only
+    CnnFaceDetector cnnFaceDetector;
+    rapidjson::Document config;
+    config.Parse(configString.c_str());
+    cnnFaceDetector.configure(config);
+    const auto start = std::chrono::steady_clock::now();
+    cnnFaceDetector.detect(workingImages);
+    const std::chrono::duration<double> elapsedTime = std::chrono::steady_clock::now() - start;
+    std::cout << "CNN face detector batched throughput: " << workingImages.size() / elapsedTime.count()
+              << " images per second" << std::endl;
+}
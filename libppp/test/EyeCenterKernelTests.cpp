@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include "EyeCenterKernel.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+class EyeCenterKernelTests : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        // Unit gradients with about two thirds of them below the threshold, as in the eye regions
+        cv::Mat angles(m_gradientX.size(), CV_64F);
+        cv::randu(angles, 0, 2 * CV_PI);
+        cv::Mat mask(m_gradientX.size(), CV_8U);
+        cv::randu(mask, 0, 3);
+        for (auto y = 0; y < angles.rows; ++y)
+        {
+            for (auto x = 0; x < angles.cols; ++x)
+            {
+                const auto isAboveThreshold = mask.at<uchar>(y, x) == 0;
+                m_gradientX.at<double>(y, x) = isAboveThreshold ? cos(angles.at<double>(y, x)) : 0.0;
+                m_gradientY.at<double>(y, x) = isAboveThreshold ? sin(angles.at<double>(y, x)) : 0.0;
+            }
+        }
+        cv::randu(m_weight, 0, 256);
+    }
+
+    cv::Mat m_gradientX = cv::Mat(35, 50, CV_64F);
+    cv::Mat m_gradientY = cv::Mat(35, 50, CV_64F);
+    cv::Mat m_weight = cv::Mat(35, 50, CV_8U);
+
+    ///<- Straightforward implementation of the votes in double precision, the kernel must match it
+    static cv::Mat referenceVotes(const cv::Mat & gradientX,
+                                  const cv::Mat & gradientY,
+                                  const cv::Mat & weight,
+                                  double weightDivisor)
+    {
+        cv::Mat outSum = cv::Mat::zeros(gradientX.size(), CV_64F);
+        for (auto y = 0; y < gradientX.rows; ++y)
+        {
+            for (auto x = 0; x < gradientX.cols; ++x)
+            {
+                const auto gx = gradientX.at<double>(y, x);
+                const auto gy = gradientY.at<double>(y, x);
+                if (gx == 0.0 && gy == 0.0)
+                {
+                    continue;
+                }
+                const auto w = weight.empty() ? 1.0 : weight.at<uchar>(y, x) / weightDivisor;
+                for (auto cy = 0; cy < outSum.rows; ++cy)
+                {
+                    for (auto cx = 0; cx < outSum.cols; ++cx)
+                    {
+                        if (x == cx && y == cy)
+                        {
+                            continue;
+                        }
+                        const double dx = x - cx;
+                        const double dy = y - cy;
+                        const auto magnitude = sqrt(dx * dx + dy * dy);
+                        const auto dotProduct = std::max(0.0, dx / magnitude * gx + dy / magnitude * gy);
+                        outSum.at<double>(cy, cx) += dotProduct * dotProduct * w;
+                    }
+                }
+            }
+        }
+        return outSum;
+    }
+
+    static void expectSameVotes(const cv::Mat & expectedVotes, const cv::Mat & votes)
+    {
+        ASSERT_EQ(CV_32F, votes.type());
+        ASSERT_EQ(expectedVotes.size(), votes.size());
+
+        double maxVotes;
+        cv::minMaxLoc(expectedVotes, nullptr, &maxVotes);
+        cv::Mat doubleVotes;
+        votes.convertTo(doubleVotes, CV_64F);
+        EXPECT_LT(cv::norm(doubleVotes, expectedVotes, cv::NORM_INF), 1e-5 * maxVotes);
+
+        // The center found is the expected one, or one with the same votes up to the rounding errors
+        cv::Point center;
+        cv::minMaxLoc(votes, nullptr, nullptr, nullptr, &center);
+        EXPECT_NEAR(maxVotes, expectedVotes.at<double>(center), 1e-5 * maxVotes);
+    }
+};
+
+TEST_F(EyeCenterKernelTests, MatchesTheReferenceVotes)
+{
+    const EyeCenterKernel kernel(cv::Size(50, 50));
+
+    cv::Mat votes;
+    kernel.accumulate(m_gradientX, m_gradientY, cv::Mat(), 150.0f, votes);
+    expectSameVotes(referenceVotes(m_gradientX, m_gradientY, cv::Mat(), 150.0), votes);
+
+    kernel.accumulate(m_gradientX, m_gradientY, m_weight, 150.0f, votes);
+    expectSameVotes(referenceVotes(m_gradientX, m_gradientY, m_weight, 150.0), votes);
+}
+
+TEST_F(EyeCenterKernelTests, HandlesWidthsThatAreNotMultipleOfTheSimdWidth)
+{
+    const EyeCenterKernel kernel(cv::Size(50, 50));
+    const cv::Rect roi(3, 2, 23, 29);
+
+    cv::Mat votes;
+    kernel.accumulate(m_gradientX(roi), m_gradientY(roi), cv::Mat(), 150.0f, votes);
+    expectSameVotes(referenceVotes(m_gradientX(roi), m_gradientY(roi), cv::Mat(), 150.0), votes);
+}
+
+TEST_F(EyeCenterKernelTests, WindowVotesMatchTheFullVotes)
+{
+    const EyeCenterKernel kernel(cv::Size(50, 50));
+    const cv::Rect window(31, 20, 7, 7);
+
+    cv::Mat votes, windowVotes;
+    kernel.accumulate(m_gradientX, m_gradientY, cv::Mat(), 150.0f, votes);
+    kernel.accumulate(m_gradientX, m_gradientY, cv::Mat(), 150.0f, window, windowVotes);
+    ASSERT_EQ(window.size(), windowVotes.size());
+    // Only the rounding may differ, the centers of the window might be processed by other SIMD lanes
+    EXPECT_LT(cv::norm(votes(window), windowVotes, cv::NORM_INF), 1e-5 * cv::norm(votes, cv::NORM_INF));
+
+    EXPECT_THROW(kernel.accumulate(m_gradientX, m_gradientY, cv::Mat(), 150.0f, window + cv::Point(15, 0), votes),
+                 std::logic_error);
+}
+
+TEST_F(EyeCenterKernelTests, RejectsImagesLargerThanTheTables)
+{
+    const EyeCenterKernel kernel(cv::Size(50, 30));
+
+    cv::Mat votes;
+    EXPECT_THROW(kernel.accumulate(m_gradientX, m_gradientY, cv::Mat(), 150.0f, votes), std::logic_error);
+}
+
+TEST_F(EyeCenterKernelTests, DISABLED_Benchmark)
+{
+    const EyeCenterKernel kernel(cv::Size(50, 50));
+    const auto numIterations = 20;
+
+    cv::Mat votes;
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < numIterations; ++i)
+    {
+        votes = referenceVotes(m_gradientX, m_gradientY, cv::Mat(), 150.0);
+    }
+    const std::chrono::duration<double, std::milli> referenceTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < numIterations; ++i)
+    {
+        kernel.accumulate(m_gradientX, m_gradientY, cv::Mat(), 150.0f, votes);
+    }
+    const std::chrono::duration<double, std::milli> kernelTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Eye center votes for a " << m_gradientX.cols << "x" << m_gradientX.rows
+              << " region: reference " << referenceTime.count() / numIterations << " ms, kernel "
+              << kernelTime.count() / numIterations << " ms" << std::endl;
+}
@@ -1,7 +1,17 @@
 #include "EyeDetector.h"
+#include "FaceDetector.h"
+#include "LandMarks.h"
+#include "TestHelpers.h"
+#include "ThreadPool.h"
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <iostream>
+#include <numeric>
+
+#include <opencv2/imgcodecs.hpp>
+
 class EyeDetectorTests : public testing::Test
 {
 
@@ -11,6 +21,34 @@ protected:
     }
 
     EyeDetectorSPtr m_pEyeDetector = std::make_shared<EyeDetector>();
+
+    static EyeDetectorSPtr createEyeDetector(bool coarseToFine, bool parallelEyeSearch = true)
+    {
+        std::string configString;
+        readConfigFromFile("", configString);
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        config["eyesDetector"]["coarseToFine"]["enabled"].SetBool(coarseToFine);
+        config["eyesDetector"]["parallelEyeSearch"].SetBool(parallelEyeSearch);
+
+        // The eyes are only searched concurrently in a pool
+        auto pThreadPool = parallelEyeSearch ? std::make_shared<ThreadPool>(2) : nullptr;
+        auto pEyeDetector = std::make_shared<EyeDetector>(nullptr, pThreadPool);
+        pEyeDetector->configure(config);
+        return pEyeDetector;
+    }
+
+    static FaceDetectorSPtr createFaceDetector()
+    {
+        std::string configString;
+        readConfigFromFile("", configString);
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+
+        auto pFaceDetector = std::make_shared<FaceDetector>();
+        pFaceDetector->configure(config);
+        return pFaceDetector;
+    }
 };
 
 TEST_F(EyeDetectorTests, FallbackWorks)
@@ -18,3 +56,84 @@ TEST_F(EyeDetectorTests, FallbackWorks)
     // EyeDetector d;
     // d.configure();
 }
+
+TEST_F(EyeDetectorTests, CoarseToFineFindsTheSamePupils)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+    LandMarks faceLandMarks;
+    ASSERT_TRUE(createFaceDetector()->detectLandMarks(grayImage, faceLandMarks));
+    ASSERT_EQ(0, faceLandMarks.imageRotation);
+
+    auto landMarks = faceLandMarks;
+    ASSERT_TRUE(createEyeDetector(false)->detectLandMarks(grayImage, landMarks));
+    auto coarseToFineLandMarks = faceLandMarks;
+    ASSERT_TRUE(createEyeDetector(true)->detectLandMarks(grayImage, coarseToFineLandMarks));
+
+    const auto pupilsDistance = cv::norm(landMarks.eyeLeftPupil - landMarks.eyeRightPupil);
+    EXPECT_LT(cv::norm(landMarks.eyeLeftPupil - coarseToFineLandMarks.eyeLeftPupil), 0.05 * pupilsDistance);
+    EXPECT_LT(cv::norm(landMarks.eyeRightPupil - coarseToFineLandMarks.eyeRightPupil), 0.05 * pupilsDistance);
+}
+
+TEST_F(EyeDetectorTests, ParallelEyeSearchFindsTheSamePupils)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+    LandMarks faceLandMarks;
+    ASSERT_TRUE(createFaceDetector()->detectLandMarks(grayImage, faceLandMarks));
+
+    auto sequentialLandMarks = faceLandMarks;
+    ASSERT_TRUE(createEyeDetector(false, false)->detectLandMarks(grayImage, sequentialLandMarks));
+    auto parallelLandMarks = faceLandMarks;
+    ASSERT_TRUE(createEyeDetector(false, true)->detectLandMarks(grayImage, parallelLandMarks));
+
+    EXPECT_EQ(sequentialLandMarks.eyeLeftPupil, parallelLandMarks.eyeLeftPupil);
+    EXPECT_EQ(sequentialLandMarks.eyeRightPupil, parallelLandMarks.eyeRightPupil);
+}
+
+TEST_F(EyeDetectorTests, DISABLED_CoarseToFineAccuracy)
+{
+    const auto pFaceDetector = createFaceDetector();
+    for (const auto coarseToFine : { false, true })
+    {
+        const auto pEyeDetector = createEyeDetector(coarseToFine);
+        std::chrono::duration<double, std::milli> elapsedTime(0);
+        std::vector<double> relativeErrors;
+
+        const auto process = [&](const std::string & imagePrefix,
+                                 cv::Mat & rgbImage,
+                                 cv::Mat & grayImage,
+                                 const LandMarks & manualAnnotations,
+                                 LandMarks & detectedLandMarks) -> bool {
+            if (!pFaceDetector->detectLandMarks(grayImage, detectedLandMarks) || detectedLandMarks.imageRotation != 0)
+            {
+                return false;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            pEyeDetector->detectLandMarks(grayImage, detectedLandMarks);
+            elapsedTime += std::chrono::steady_clock::now() - start;
+
+            // Pupil errors relative to the annotated distance between pupils
+            const auto pupilsDistance = cv::norm(manualAnnotations.eyeLeftPupil - manualAnnotations.eyeRightPupil);
+            relativeErrors.push_back(
+                cv::norm(detectedLandMarks.eyeLeftPupil - manualAnnotations.eyeLeftPupil) / pupilsDistance);
+            relativeErrors.push_back(
+                cv::norm(detectedLandMarks.eyeRightPupil - manualAnnotations.eyeRightPupil) / pupilsDistance);
+            return true;
+        };
+
+        std::vector<ResultData> rd;
+        processDatabase(process,
+                        std::vector<std::string>(),
+                        "research/mugshot_frontal_original_all/via_region_data_dpd.csv",
+                        rd);
+
+        ASSERT_FALSE(relativeErrors.empty());
+        const auto numImages = relativeErrors.size() / 2;
+        const auto meanError
+            = std::accumulate(relativeErrors.begin(), relativeErrors.end(), 0.0) / relativeErrors.size();
+        std::cout << (coarseToFine ? "Coarse to fine" : "Full") << " pupil search: "
+                  << elapsedTime.count() / numImages << " ms per image, mean error " << meanError * 100
+                  << "%, median error " << median(relativeErrors) * 100 << "% of the distance between pupils"
+                  << std::endl;
+    }
+}
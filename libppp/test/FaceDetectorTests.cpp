@@ -3,6 +3,9 @@
 #include "Utilities.h"
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <iostream>
+
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 
@@ -70,4 +73,212 @@ TEST_F(FaceDetectorTests, DISABLED_DetectFaceRotation)
         const auto angleSum = angle + detectedLandMarks.imageRotation;
         EXPECT_TRUE(angleSum == 0 || angleSum == 360);
     }
-}
\ No newline at end of file
+}
+TEST_F(FaceDetectorTests, ParallelRotationSearchMatchesSequentialSearch)
+{
+    const auto imageFileName = resolvePath("research/sample_test_images/000.jpg");
+    const auto inputImage = cv::imread(imageFileName, cv::IMREAD_GRAYSCALE);
+
+    std::string configString;
+    readConfigFromFile("", configString);
+    rapidjson::Document config;
+    config.Parse(configString.c_str());
+    config["faceDetector"]["parallelRotationSearch"].SetBool(false);
+    FaceDetector sequentialFaceDetector;
+    sequentialFaceDetector.configure(config);
+
+    for (const auto angle : { 0, 90, -90, 180 })
+    {
+        const auto rotatedImage = Utilities::rotateImage(inputImage, angle);
+
+        LandMarks parallelLandMarks, sequentialLandMarks;
+        const auto parallelFound = m_pFaceDetector->detectLandMarks(rotatedImage, parallelLandMarks);
+        const auto sequentialFound = sequentialFaceDetector.detectLandMarks(rotatedImage, sequentialLandMarks);
+
+        ASSERT_EQ(sequentialFound, parallelFound);
+        if (sequentialFound)
+        {
+            EXPECT_EQ(sequentialLandMarks.imageRotation, parallelLandMarks.imageRotation);
+            EXPECT_EQ(sequentialLandMarks.vjFaceRect, parallelLandMarks.vjFaceRect);
+        }
+    }
+}
+
+TEST_F(FaceDetectorTests, DISABLED_CoarseSearchBenchmark)
+{
+    std::string configString;
+    readConfigFromFile("", configString);
+
+    const auto createFaceDetector = [&configString](bool useCoarseSearch) {
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        config["faceDetector"]["coarseSearch"]["enabled"].SetBool(useCoarseSearch);
+        auto pFaceDetector = std::make_shared<FaceDetector>();
+        pFaceDetector->configure(config);
+        return pFaceDetector;
+    };
+
+    for (const auto useCoarseSearch : { false, true })
+    {
+        auto pFaceDetector = createFaceDetector(useCoarseSearch);
+        std::chrono::duration<double, std::milli> elapsedTime(0);
+        auto numImages = 0;
+        auto numAccurate = 0;
+
+        const auto process = [&](const std::string & imagePrefix,
+                                 cv::Mat & rgbImage,
+                                 cv::Mat & grayImage,
+                                 const LandMarks & manualAnnotations,
+                                 LandMarks & detectedLandMarks) -> bool {
+            const auto start = std::chrono::steady_clock::now();
+            const auto isDetected = pFaceDetector->detectLandMarks(grayImage, detectedLandMarks);
+            elapsedTime += std::chrono::steady_clock::now() - start;
+
+            // Accurate if the rectangle contains both eyes and mouth points
+            const auto faceRect = detectedLandMarks.vjFaceRect;
+            const auto isAccurate = isDetected && IN_ROI(faceRect, manualAnnotations.eyeLeftPupil)
+                && IN_ROI(faceRect, manualAnnotations.eyeRightPupil)
+                && IN_ROI(faceRect, manualAnnotations.lipLeftCorner)
+                && IN_ROI(faceRect, manualAnnotations.lipRightCorner);
+            ++numImages;
+            numAccurate += isAccurate ? 1 : 0;
+            return isAccurate;
+        };
+
+        std::vector<ResultData> rd;
+        processDatabase(process,
+                        std::vector<std::string>(),
+                        "research/mugshot_frontal_original_all/via_region_data_dpd.csv",
+                        rd);
+
+        ASSERT_GT(numImages, 0);
+        std::cout << (useCoarseSearch ? "Coarse to fine" : "Full resolution") << " search: "
+                  << elapsedTime.count() / numImages << " ms per image, " << numAccurate << "/" << numImages
+                  << " accurate detections" << std::endl;
+    }
+}
+
+TEST_F(FaceDetectorTests, CanSelectHogFilters)
+{
+    const auto frontalFaceDetector = dlib::get_frontal_face_detector();
+    ASSERT_EQ(5, frontalFaceDetector.num_detectors());
+
+    const auto frontOnlyDetector = FaceDetector::selectHogFilters(frontalFaceDetector, { 0 });
+    EXPECT_EQ(1, frontOnlyDetector.num_detectors());
+    EXPECT_EQ(frontalFaceDetector.get_w(0), frontOnlyDetector.get_w(0));
+
+    EXPECT_THROW(FaceDetector::selectHogFilters(frontalFaceDetector, { 5 }), std::runtime_error);
+    EXPECT_THROW(FaceDetector::selectHogFilters(frontalFaceDetector, {}), std::runtime_error);
+}
+
+TEST_F(FaceDetectorTests, DISABLED_FrontOnlyHogFilterAccuracy)
+{
+    std::string configString;
+    readConfigFromFile("", configString);
+
+    for (const auto frontOnly : { false, true })
+    {
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        config["useDlibFaceDetection"].SetBool(true);
+        if (frontOnly)
+        {
+            auto & hogFilters = config["faceDetector"]["hogFilters"];
+            hogFilters.Clear();
+            hogFilters.PushBack(0, config.GetAllocator());
+        }
+        FaceDetector faceDetector;
+        faceDetector.configure(config);
+
+        std::chrono::duration<double, std::milli> elapsedTime(0);
+        auto numImages = 0;
+        auto numAccurate = 0;
+        const auto process = [&](const std::string & imagePrefix,
+                                 cv::Mat & rgbImage,
+                                 cv::Mat & grayImage,
+                                 const LandMarks & manualAnnotations,
+                                 LandMarks & detectedLandMarks) -> bool {
+            const auto start = std::chrono::steady_clock::now();
+            const auto isDetected = faceDetector.detectLandMarks(grayImage, detectedLandMarks);
+            elapsedTime += std::chrono::steady_clock::now() - start;
+
+            const auto faceRect = detectedLandMarks.vjFaceRect;
+            const auto isAccurate = isDetected && IN_ROI(faceRect, manualAnnotations.eyeLeftPupil)
+                && IN_ROI(faceRect, manualAnnotations.eyeRightPupil)
+                && IN_ROI(faceRect, manualAnnotations.lipLeftCorner)
+                && IN_ROI(faceRect, manualAnnotations.lipRightCorner);
+            ++numImages;
+            numAccurate += isAccurate ? 1 : 0;
+            return isAccurate;
+        };
+
+        std::vector<ResultData> rd;
+        processDatabase(process,
+                        std::vector<std::string>(),
+                        "research/mugshot_frontal_original_all/via_region_data_dpd.csv",
+                        rd);
+
+        ASSERT_GT(numImages, 0);
+        std::cout << (frontOnly ? "Front looking HOG filter" : "All HOG filters") << ": "
+                  << elapsedTime.count() / numImages << " ms per image, " << numAccurate << "/" << numImages
+                  << " accurate detections" << std::endl;
+    }
+}
+
+TEST_F(FaceDetectorTests, EscalatesWeakHaarFacesToHog)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+
+    std::string configString;
+    readConfigFromFile("", configString);
+    const auto detectFace = [&configString, &grayImage](bool useHog, bool escalate, double minHaarFaceConfidence) {
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        config["useDlibFaceDetection"].SetBool(useHog);
+        config["detectorEscalation"]["enabled"].SetBool(escalate);
+        config["detectorEscalation"]["minHaarFaceConfidence"].SetDouble(minHaarFaceConfidence);
+        FaceDetector faceDetector;
+        faceDetector.configure(config);
+
+        LandMarks landmarks;
+        EXPECT_TRUE(faceDetector.detectLandMarks(grayImage, landmarks));
+        return landmarks;
+    };
+
+    const auto haarLandMarks = detectFace(false, false, 0);
+    const auto hogLandMarks = detectFace(true, false, 0);
+    EXPECT_GT(haarLandMarks.faceConfidence, 4) << "Haar faces group more windows than the minimum neighbors";
+
+    // A clear face is accepted from the Haar cascade
+    const auto confidentLandMarks = detectFace(false, true, haarLandMarks.faceConfidence);
+    EXPECT_EQ(haarLandMarks.vjFaceRect, confidentLandMarks.vjFaceRect);
+    EXPECT_EQ(haarLandMarks.faceConfidence, confidentLandMarks.faceConfidence);
+
+    // Otherwise the face is searched again with the HOG detector
+    const auto escalatedLandMarks = detectFace(false, true, haarLandMarks.faceConfidence + 1);
+    EXPECT_EQ(hogLandMarks.vjFaceRect, escalatedLandMarks.vjFaceRect);
+    EXPECT_EQ(hogLandMarks.faceConfidence, escalatedLandMarks.faceConfidence);
+}
+
+TEST_F(FaceDetectorTests, DetectsAllTheFacesOfGroupPhotos)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+
+    // Same face twice, the second copy smaller
+    cv::Mat smallerImage, groupImage;
+    cv::resize(grayImage, smallerImage, cv::Size(), 0.75, 0.75);
+    cv::copyMakeBorder(
+        smallerImage, smallerImage, 0, grayImage.rows - smallerImage.rows, 0, 0, cv::BORDER_CONSTANT, cv::Scalar(0));
+    cv::hconcat(grayImage, smallerImage, groupImage);
+
+    const auto facesLandMarks = m_pFaceDetector->detectAllLandMarks(groupImage);
+    ASSERT_GE(facesLandMarks.size(), 2);
+    EXPECT_LT(facesLandMarks[0].vjFaceRect.x, grayImage.cols) << "The biggest face comes first";
+    EXPECT_GE(facesLandMarks[1].vjFaceRect.x, grayImage.cols);
+    EXPECT_GT(facesLandMarks[0].vjFaceRect.area(), facesLandMarks[1].vjFaceRect.area());
+
+    // The single face detection keeps the biggest face
+    LandMarks landMarks;
+    ASSERT_TRUE(m_pFaceDetector->detectLandMarks(groupImage, landMarks));
+    EXPECT_EQ(facesLandMarks[0].vjFaceRect, landMarks.vjFaceRect);
+}
@@ -0,0 +1,292 @@
+#include <gtest/gtest.h>
+
+#include "HaarCascade.h"
+#include "HaarFeatures.h"
+#include "TestHelpers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+
+namespace
+{
+// Single stage cascade accepting 8x8 windows that are darker on the left half than on the right half
+const char * kCascadeXml = R"(<?xml version="1.0"?>
+<opencv_storage>
+<cascade>
+  <stageType>BOOST</stageType>
+  <featureType>HAAR</featureType>
+  <height>8</height>
+  <width>8</width>
+  <stages>
+    <_>
+      <maxWeakCount>1</maxWeakCount>
+      <stageThreshold>0.</stageThreshold>
+      <weakClassifiers>
+        <_>
+          <internalNodes>0 -1 0 0.1</internalNodes>
+          <leafValues>-1. 1.</leafValues></_></weakClassifiers></_></stages>
+  <features>
+    <_>
+      <rects>
+        <_>0 0 8 8 -1.</_>
+        <_>4 0 4 8 2.</_></rects></_></features></cascade>
+</opencv_storage>)";
+
+// Same cascade in the old format
+const char * kOldCascadeXml = R"(<?xml version="1.0"?>
+<opencv_storage>
+<edge type_id="opencv-haar-classifier">
+  <size>8 8</size>
+  <stages>
+    <_>
+      <trees>
+        <_>
+          <_>
+            <feature>
+              <rects>
+                <_>0 0 8 8 -1.</_>
+                <_>4 0 4 8 2.</_></rects>
+              <tilted>0</tilted></feature>
+            <threshold>0.1</threshold>
+            <left_val>-1.</left_val>
+            <right_val>1.</right_val></_></_></trees>
+      <stage_threshold>0.</stage_threshold>
+      <parent>-1</parent>
+      <next>-1</next></_></stages></edge>
+</opencv_storage>)";
+
+HaarCascadeSPtr loadCascade(const std::string & xml)
+{
+    cv::FileStorage fs(xml, cv::FileStorage::READ | cv::FileStorage::MEMORY);
+    return std::make_shared<HaarCascade>(fs.getFirstTopLevelNode());
+}
+
+// Reads a binary cascade compiled by build.py
+std::vector<char> readBinaryCascade(const std::string & fileName)
+{
+    std::ifstream ifs(resolvePath("libppp/share/haarcascades/" + fileName), std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+}
+
+cv::Rect biggestRect(const std::vector<cv::Rect> & rects)
+{
+    return *std::max_element(rects.begin(), rects.end(), [](const cv::Rect & r1, const cv::Rect & r2) {
+        return r1.area() < r2.area();
+    });
+}
+
+// Searches a region of the image with a bundled cascade and with cv::CascadeClassifier, checking that the biggest
+// objects they find are the same within the given tolerance (ratio of the size of the object found by OpenCV)
+void expectSameBiggestObjectAsOpenCv(const std::string & cascadeFileName,
+                                     const cv::Mat & grayImage,
+                                     const cv::Rect & roi,
+                                     int minNeighbors,
+                                     const cv::Size & minSize,
+                                     double tolerance)
+{
+    const auto cascadeFile = resolvePath("libppp/share/haarcascades/" + cascadeFileName);
+    cv::CascadeClassifier classifier;
+    if (!classifier.load(cascadeFile))
+    {
+        // OpenCV only loads the cascades in the old format once converted
+        const auto convertedCascadeFile = cv::tempfile(".xml");
+        ASSERT_TRUE(cv::CascadeClassifier::convert(cascadeFile, convertedCascadeFile)) << cascadeFileName;
+        ASSERT_TRUE(classifier.load(convertedCascadeFile)) << cascadeFileName;
+        std::remove(convertedCascadeFile.c_str());
+    }
+    std::vector<cv::Rect> expectedObjects;
+    classifier.detectMultiScale(grayImage(roi), expectedObjects, 1.05, minNeighbors, 0, minSize);
+    ASSERT_FALSE(expectedObjects.empty()) << cascadeFileName;
+
+    cv::FileStorage fs(cascadeFile, cv::FileStorage::READ);
+    const HaarCascade cascade(fs.getFirstTopLevelNode());
+    const auto objects = cascade.detect(HaarFeatures(grayImage), roi, minNeighbors, minSize);
+    ASSERT_FALSE(objects.empty()) << cascadeFileName;
+
+    const auto expectedObject = biggestRect(expectedObjects) + roi.tl();
+    const auto object = biggestRect(objects);
+    EXPECT_GT((object & expectedObject).area(), (1 - 2 * tolerance) * expectedObject.area()) << cascadeFileName;
+    EXPECT_NEAR(expectedObject.width, object.width, tolerance * expectedObject.width) << cascadeFileName;
+}
+} // namespace
+
+class HaarCascadeTests : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        for (const auto & edge : { m_smallEdge, m_largeEdge })
+        {
+            m_image(cv::Rect(edge.x, edge.y, edge.width / 2, edge.height)).setTo(0);
+            m_image(cv::Rect(edge.x + edge.width / 2, edge.y, edge.width / 2, edge.height)).setTo(255);
+        }
+    }
+
+    const cv::Rect m_smallEdge = cv::Rect(40, 20, 8, 8);
+    const cv::Rect m_largeEdge = cv::Rect(100, 60, 16, 16);
+    cv::Mat m_image = cv::Mat(120, 160, CV_8UC1, cv::Scalar(128));
+};
+
+TEST_F(HaarCascadeTests, DetectsObjectsAtAllScales)
+{
+    const auto pCascade = loadCascade(kCascadeXml);
+    EXPECT_EQ(cv::Size(8, 8), pCascade->windowSize());
+
+    // Without grouping every window accepted by the cascade is returned
+    const HaarFeatures features(m_image);
+    const auto objects = pCascade->detect(features, cv::Rect(cv::Point(), m_image.size()), 0);
+    EXPECT_TRUE(std::find(objects.begin(), objects.end(), m_smallEdge) != objects.end());
+    EXPECT_TRUE(std::any_of(objects.begin(), objects.end(), [this](const cv::Rect & object) {
+        return (object & m_largeEdge).area() > 0.7 * m_largeEdge.area();
+    }));
+    for (const auto & object : objects)
+    {
+        EXPECT_TRUE((object & m_smallEdge).area() > 0 || (object & m_largeEdge).area() > 0);
+    }
+
+    const auto largeObjects = pCascade->detect(features, cv::Rect(cv::Point(), m_image.size()), 0, cv::Size(12, 12));
+    EXPECT_FALSE(largeObjects.empty());
+    for (const auto & object : largeObjects)
+    {
+        EXPECT_GE(object.width, 12);
+    }
+}
+
+TEST_F(HaarCascadeTests, OnlySearchesTheRegionOfInterest)
+{
+    const auto pCascade = loadCascade(kCascadeXml);
+    const HaarFeatures features(m_image);
+
+    const cv::Rect roi(20, 0, 50, 50);
+    const auto objects = pCascade->detect(features, roi, 0);
+    EXPECT_TRUE(std::find(objects.begin(), objects.end(), m_smallEdge) != objects.end())
+        << "Objects should be in image coordinates";
+    for (const auto & object : objects)
+    {
+        EXPECT_GT((object & roi).area(), 0.8 * object.area());
+    }
+
+    EXPECT_TRUE(pCascade->detect(features, cv::Rect(60, 0, 100, 50), 0).empty());
+
+    const cv::Mat flatImage(120, 160, CV_8UC1, cv::Scalar(128));
+    EXPECT_TRUE(pCascade->detect(HaarFeatures(flatImage), cv::Rect(0, 0, 160, 120), 0).empty());
+}
+
+TEST_F(HaarCascadeTests, CountsTheWindowsGroupedIntoEachObject)
+{
+    const auto pCascade = loadCascade(kCascadeXml);
+    const HaarFeatures features(m_image);
+    const cv::Rect roi(cv::Point(), m_image.size());
+
+    std::vector<int> numNeighbors;
+    const auto candidates = pCascade->detect(features, roi, 0, numNeighbors);
+    ASSERT_EQ(candidates.size(), numNeighbors.size());
+    EXPECT_TRUE(std::all_of(numNeighbors.begin(), numNeighbors.end(), [](int n) { return n == 1; }));
+
+    const auto objects = pCascade->detect(features, roi, 2, numNeighbors);
+    EXPECT_EQ(pCascade->detect(features, roi, 2), objects);
+    ASSERT_EQ(objects.size(), numNeighbors.size());
+    ASSERT_FALSE(objects.empty());
+    for (const auto n : numNeighbors)
+    {
+        EXPECT_GT(n, 2);
+    }
+    EXPECT_LE(std::accumulate(numNeighbors.begin(), numNeighbors.end(), 0), static_cast<int>(candidates.size()));
+}
+
+TEST_F(HaarCascadeTests, OldFormatIsEquivalent)
+{
+    const auto pCascade = loadCascade(kCascadeXml);
+    const auto pOldCascade = loadCascade(kOldCascadeXml);
+    EXPECT_EQ(pCascade->windowSize(), pOldCascade->windowSize());
+
+    const HaarFeatures features(m_image);
+    const cv::Rect roi(cv::Point(), m_image.size());
+    EXPECT_EQ(pCascade->detect(features, roi, 0), pOldCascade->detect(features, roi, 0));
+}
+
+TEST_F(HaarCascadeTests, LoadsTheBundledCascades)
+{
+    const auto cascadeWindowSize = [](const std::string & fileName) {
+        cv::FileStorage fs(resolvePath("libppp/share/haarcascades/" + fileName), cv::FileStorage::READ);
+        return HaarCascade(fs.getFirstTopLevelNode()).windowSize();
+    };
+    EXPECT_EQ(cv::Size(20, 20), cascadeWindowSize("haarcascade_frontalface_alt2.xml"));
+    EXPECT_EQ(cv::Size(18, 12), cascadeWindowSize("ojoI.xml"));
+    EXPECT_EQ(cv::Size(18, 12), cascadeWindowSize("ojoD.xml"));
+    EXPECT_EQ(cv::Size(25, 15), cascadeWindowSize("Mouth.xml"));
+}
+
+TEST_F(HaarCascadeTests, BinaryFormatIsEquivalent)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+    const HaarFeatures features(grayImage);
+    const cv::Rect roi(cv::Point(), grayImage.size());
+    for (const std::string name : { "haarcascade_frontalface_alt2", "ojoI", "Mouth" })
+    {
+        cv::FileStorage fs(resolvePath("libppp/share/haarcascades/" + name + ".xml"), cv::FileStorage::READ);
+        const HaarCascade cascade(fs.getFirstTopLevelNode());
+        const auto binary = readBinaryCascade(name + ".bin");
+        ASSERT_TRUE(HaarCascade::isBinary(binary.data(), binary.size())) << name;
+        const HaarCascade binaryCascade(binary.data(), binary.size());
+
+        EXPECT_EQ(cascade.windowSize(), binaryCascade.windowSize()) << name;
+        const auto objects = cascade.detect(features, roi, 0);
+        EXPECT_FALSE(objects.empty()) << name;
+        EXPECT_EQ(objects, binaryCascade.detect(features, roi, 0)) << name;
+    }
+}
+
+TEST_F(HaarCascadeTests, RejectsInvalidBinaries)
+{
+    auto binary = readBinaryCascade("ojoD.bin");
+    ASSERT_NO_THROW(HaarCascade(binary.data(), binary.size()));
+    EXPECT_FALSE(HaarCascade::isBinary(kCascadeXml, strlen(kCascadeXml)));
+    EXPECT_THROW(HaarCascade(binary.data(), binary.size() - 1), std::runtime_error);
+
+    // Feature index of the first node, right after the header and the features
+    int numFeatures;
+    memcpy(&numFeatures, binary.data() + 16, sizeof(numFeatures));
+    const int invalidFeatureIndex = numFeatures;
+    memcpy(binary.data() + 36 + 64 * numFeatures, &invalidFeatureIndex, sizeof(invalidFeatureIndex));
+    EXPECT_THROW(HaarCascade(binary.data(), binary.size()), std::runtime_error);
+}
+
+TEST_F(HaarCascadeTests, FindsTheSameFaceAsOpenCv)
+{
+    // The pyramid levels are resampled slightly differently, so the faces may differ in a few pixels
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+    const cv::Size minFaceSize(grayImage.cols / 6, grayImage.cols / 6);
+    expectSameBiggestObjectAsOpenCv("haarcascade_frontalface_alt2.xml",
+                                    grayImage,
+                                    cv::Rect(cv::Point(), grayImage.size()),
+                                    4,
+                                    minFaceSize,
+                                    0.05);
+}
+
+TEST_F(HaarCascadeTests, FindsTheSameEyesAndMouthAsOpenCv)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+    cv::CascadeClassifier faceClassifier(resolvePath("libppp/share/haarcascades/haarcascade_frontalface_alt2.xml"));
+    std::vector<cv::Rect> faces;
+    faceClassifier.detectMultiScale(grayImage, faces, 1.05, 4, 0, cv::Size(grayImage.cols / 6, grayImage.cols / 6));
+    ASSERT_FALSE(faces.empty());
+    const auto face = biggestRect(faces);
+
+    // The eyes are searched in the left and right quarters of the upper half of the face and the mouth in its lower
+    // third, the objects are smaller than the face so a few pixels make a bigger difference
+    const cv::Rect leftEyeRegion(face.x, face.y + face.height / 5, face.width / 2, face.height * 3 / 10);
+    const cv::Rect rightEyeRegion(leftEyeRegion + cv::Point(face.width / 2, 0));
+    const cv::Rect mouthRegion(
+        face.x + face.width / 5, face.y + face.height * 2 / 3, face.width * 3 / 5, face.height / 3);
+    expectSameBiggestObjectAsOpenCv("ojoI.xml", grayImage, leftEyeRegion, 3, cv::Size(), 0.1);
+    expectSameBiggestObjectAsOpenCv("ojoD.xml", grayImage, rightEyeRegion, 3, cv::Size(), 0.1);
+    expectSameBiggestObjectAsOpenCv("Mouth.xml", grayImage, mouthRegion, 3, cv::Size(), 0.1);
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include "HaarFeatureCache.h"
+#include "HaarFeatures.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+class HaarFeaturesTests : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        cv::randu(m_image, 0, 256);
+    }
+
+    cv::Mat m_image = cv::Mat(200, 300, CV_8UC1);
+
+    ///<- Sum of the pixels of a rectangle of a level computed from the integral of its tile
+    static int tileRectSum(const HaarFeatures & features, size_t level, const cv::Rect & rect)
+    {
+        const auto & tile = features.tile(level, rect.tl());
+        const auto r = rect - tile.origin;
+        return tile.sum.at<int>(r.y, r.x) - tile.sum.at<int>(r.y, r.br().x) - tile.sum.at<int>(r.br().y, r.x)
+            + tile.sum.at<int>(r.br().y, r.br().x);
+    }
+
+    static int rectSum(const cv::Mat & integralImage, const cv::Rect & r)
+    {
+        return integralImage.at<int>(r.y, r.x) - integralImage.at<int>(r.y, r.br().x)
+            - integralImage.at<int>(r.br().y, r.x) + integralImage.at<int>(r.br().y, r.br().x);
+    }
+};
+
+TEST_F(HaarFeaturesTests, LevelsFollowTheScaleFactor)
+{
+    const HaarFeatures features(m_image, 1.25, 64, 24);
+
+    EXPECT_EQ(1.0, features.levelScale(0));
+    EXPECT_EQ(m_image.size(), features.levelSize(0));
+    EXPECT_DOUBLE_EQ(1.25 * 1.25, features.levelScale(2));
+    EXPECT_EQ(cv::Size(192, 128), features.levelSize(2));
+
+    const auto lastLevel = features.numLevels() - 1;
+    EXPECT_GE(features.levelSize(lastLevel).height, 8);
+    EXPECT_LT(cvRound(m_image.rows / (features.levelScale(lastLevel) * 1.25)), 8);
+}
+
+TEST_F(HaarFeaturesTests, TilesMatchTheIntegralOfTheWholeLevel)
+{
+    const HaarFeatures features(m_image, 1.25, 64, 24);
+    EXPECT_EQ(64 + 24 + 1, features.integralStep());
+
+    cv::Mat integralImage;
+    integral(m_image, integralImage, CV_32S);
+    for (const auto & rect : { cv::Rect(0, 0, 24, 24), cv::Rect(70, 75, 24, 20), cv::Rect(127, 63, 24, 24) })
+    {
+        EXPECT_EQ(rectSum(integralImage, rect), tileRectSum(features, 0, rect));
+    }
+
+    // Other levels are resampled like cv::resize does, up to its fixed point rounding
+    cv::Mat level, levelIntegralImage;
+    resize(m_image, level, features.levelSize(2), 0, 0, cv::INTER_LINEAR);
+    integral(level, levelIntegralImage, CV_32S);
+    const cv::Rect rect(65, 70, 24, 24);
+    EXPECT_NEAR(rectSum(levelIntegralImage, rect), tileRectSum(features, 2, rect), rect.area());
+}
+
+TEST_F(HaarFeaturesTests, TilesAreComputedOnDemand)
+{
+    const HaarFeatures features(m_image, 1.05, 64, 24);
+    EXPECT_EQ(0, features.numComputedTiles());
+
+    EXPECT_EQ(cv::Point(64, 0), features.tile(0, cv::Point(100, 10)).origin);
+    EXPECT_EQ(1, features.numComputedTiles());
+
+    features.tile(0, cv::Point(127, 63));
+    EXPECT_EQ(1, features.numComputedTiles()) << "Same tile should not be computed twice";
+
+    features.tile(3, cv::Point(100, 10));
+    EXPECT_EQ(2, features.numComputedTiles());
+
+    EXPECT_THROW(features.tile(0, cv::Point(300, 10)), std::logic_error);
+}
+
+TEST_F(HaarFeaturesTests, CacheSharesTheFeaturesOfAnImage)
+{
+    HaarFeatureCache cache;
+    const auto pFeatures = cache.features(m_image);
+    EXPECT_EQ(pFeatures, cache.features(m_image));
+    EXPECT_EQ(pFeatures, cache.features(m_image(cv::Rect(10, 20, 100, 50)))) << "Regions share the image features";
+    EXPECT_EQ(m_image.data, pFeatures->grayImage().data);
+
+    cv::Mat bgrImage;
+    cvtColor(m_image, bgrImage, cv::COLOR_GRAY2BGR);
+    const auto pBgrFeatures = cache.features(bgrImage);
+    EXPECT_NE(pFeatures, pBgrFeatures);
+    EXPECT_EQ(pBgrFeatures, cache.features(pBgrFeatures->grayImage()))
+        << "A BGR image should share its features with its gray version";
+    EXPECT_EQ(2, cache.size());
+}
+
+TEST_F(HaarFeaturesTests, CacheEvictsTheLeastRecentlyUsedImages)
+{
+    HaarFeatureCache cache(1);
+    const auto pFeatures = cache.features(m_image);
+
+    const cv::Mat otherImage(100, 100, CV_8UC1, cv::Scalar(128));
+    const auto pOtherFeatures = cache.features(otherImage, false);
+    EXPECT_NE(pOtherFeatures, cache.features(otherImage, false)) << "Features should not be cached when asked";
+    EXPECT_EQ(pFeatures, cache.features(m_image));
+
+    cache.features(otherImage);
+    EXPECT_EQ(1, cache.size());
+    EXPECT_NE(pFeatures, cache.features(m_image));
+}
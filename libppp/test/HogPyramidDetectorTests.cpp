@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include "HogPyramidDetector.h"
+#include "TestHelpers.h"
+#include "ThreadPool.h"
+
+#include <atomic>
+
+#include <dlib/opencv/cv_image.h>
+#include <opencv2/imgcodecs.hpp>
+
+class HogPyramidDetectorTests : public testing::Test
+{
+protected:
+    ThreadPool m_threadPool { 4 };
+    dlib::frontal_face_detector m_frontalFaceDetector = dlib::get_frontal_face_detector();
+    HogPyramidDetector m_hogPyramidDetector { m_frontalFaceDetector, m_threadPool };
+};
+
+TEST_F(HogPyramidDetectorTests, PyramidLevelRangeFollowsObjectSizes)
+{
+    size_t minLevel, maxLevel;
+    m_hogPyramidDetector.pyramidLevelRange(10, 80, minLevel, maxLevel);
+    EXPECT_EQ(0, minLevel);
+    EXPECT_EQ(0, maxLevel);
+
+    // 80 * 1.2^2 = 115.2 and 80 * 1.2^5 = 199.1
+    m_hogPyramidDetector.pyramidLevelRange(120, 199, minLevel, maxLevel);
+    EXPECT_EQ(2, minLevel);
+    EXPECT_EQ(5, maxLevel);
+}
+
+TEST_F(HogPyramidDetectorTests, FindsTheSameFaceAsTheDlibDetector)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+    const auto expectedDetections = m_frontalFaceDetector(dlib::cv_image<uint8_t>(grayImage));
+    ASSERT_FALSE(expectedDetections.empty());
+
+    // Small tiles so that the largest levels get split
+    m_hogPyramidDetector.setTileSize(256);
+    const auto detections = m_hogPyramidDetector.detect(grayImage, 0, std::max(grayImage.cols, grayImage.rows));
+    ASSERT_EQ(expectedDetections.size(), detections.size());
+    for (const auto & expectedDetection : expectedDetections)
+    {
+        const auto matchingDetection
+            = std::find_if(detections.begin(), detections.end(), [&](const dlib::rect_detection & detection) {
+                  return detection.rect.intersect(expectedDetection).area() > 0.9 * expectedDetection.area();
+              });
+        EXPECT_NE(detections.end(), matchingDetection) << "Face " << expectedDetection << " not detected";
+    }
+}
+
+TEST_F(HogPyramidDetectorTests, CancelledDetectionStopsScanning)
+{
+    const auto grayImage = cv::imread(resolvePath("research/sample_test_images/000.jpg"), cv::IMREAD_GRAYSCALE);
+    const auto maxObjectSize = std::max(grayImage.cols, grayImage.rows);
+    m_hogPyramidDetector.setTileSize(256);
+    EXPECT_FALSE(m_hogPyramidDetector.detect(grayImage, 0, maxObjectSize, []() { return false; }).empty());
+
+    // Cancelled before the first level, nothing is scanned
+    std::atomic<int> numChecks(0);
+    const auto detections = m_hogPyramidDetector.detect(grayImage, 0, maxObjectSize, [&numChecks]() {
+        ++numChecks;
+        return true;
+    });
+    EXPECT_TRUE(detections.empty());
+    EXPECT_EQ(1, numChecks.load()) << "No level should be scanned once cancelled";
+}
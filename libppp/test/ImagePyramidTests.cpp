@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+
+#include "ImagePyramid.h"
+
+class ImagePyramidTests : public testing::Test
+{
+protected:
+    cv::Mat m_image = cv::Mat(480, 640, CV_8UC3, cv::Scalar(10, 20, 30));
+    ImagePyramidSPtr m_pImagePyramid = std::make_shared<ImagePyramid>(m_image);
+};
+
+TEST_F(ImagePyramidTests, LevelsHalveTheImageSize)
+{
+    EXPECT_EQ(m_image.data, m_pImagePyramid->level(0).data) << "Level 0 should be the image itself";
+    EXPECT_EQ(cv::Size(320, 240), m_pImagePyramid->level(1).size());
+    EXPECT_EQ(cv::Size(80, 60), m_pImagePyramid->level(3).size());
+    EXPECT_EQ(cv::Vec3b(10, 20, 30), m_pImagePyramid->level(3).at<cv::Vec3b>(30, 40));
+}
+
+TEST_F(ImagePyramidTests, LevelForScaleSelectsClosestLevelAbove)
+{
+    auto levelScale = 0.0;
+    EXPECT_EQ(m_image.size(), m_pImagePyramid->levelForScale(2.0, levelScale).size());
+    EXPECT_EQ(1.0, levelScale);
+
+    EXPECT_EQ(m_image.size(), m_pImagePyramid->levelForScale(0.6, levelScale).size());
+    EXPECT_EQ(1.0, levelScale);
+
+    EXPECT_EQ(cv::Size(320, 240), m_pImagePyramid->levelForScale(0.5, levelScale).size());
+    EXPECT_EQ(0.5, levelScale);
+
+    EXPECT_EQ(cv::Size(160, 120), m_pImagePyramid->levelForScale(0.2, levelScale).size());
+    EXPECT_EQ(0.25, levelScale);
+}
+
+TEST_F(ImagePyramidTests, LevelsStopAtMinimumSize)
+{
+    auto levelScale = 0.0;
+    const auto smallestLevel = m_pImagePyramid->levelForScale(0.001, levelScale);
+    EXPECT_EQ(cv::Size(80, 60), smallestLevel.size());
+    EXPECT_EQ(1.0 / 8, levelScale);
+}
@@ -63,3 +63,21 @@ TEST_F(ImageStoreTests, ImagesArePrioritizedByAccess)
     EXPECT_FALSE(m_pImageStore->containsImage(key1));
     EXPECT_FALSE(m_pImageStore->containsImage(key3));
 }
+
+TEST_F(ImageStoreTests, ImagePyramidIsKeptWithTheImage)
+{
+    m_pImageStore->setStoreSize(1);
+
+    const auto key = m_pImageStore->setImage(m_mat3);
+    const auto imagePyramid = m_pImageStore->getImagePyramid(key);
+    ASSERT_NE(nullptr, imagePyramid);
+    verifyEqualImages(m_mat3, imagePyramid->level(0));
+
+    // Setting the same image again keeps the pyramid built so far
+    EXPECT_EQ(key, m_pImageStore->setImage(m_mat3));
+    EXPECT_EQ(imagePyramid, m_pImageStore->getImagePyramid(key));
+
+    // Evicted images take their pyramid with them
+    m_pImageStore->setImage(m_mat1);
+    EXPECT_EQ(nullptr, m_pImageStore->getImagePyramid(key));
+}
@@ -8,9 +8,16 @@
 #include "TestHelpers.h"
 
 #include <FaceDetector.h>
+#include <HaarFeatureCache.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
 #include <numeric>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <tuple>
 
 using namespace cv;
 
@@ -206,6 +213,96 @@ TEST_F(PppEngineIntegrationTests, EndToEndDetectioWorks)
     processResults(resultsData);
 }
 
+TEST_F(PppEngineIntegrationTests, RotatedImagesKeepTheFeaturesOfTheInputImageCached)
+{
+    // The eyes and the mouth are searched with the Haar cascades
+    std::string configString;
+    readConfigFromFile("", configString);
+    rapidjson::Document config;
+    config.Parse(configString.c_str());
+    config["useDlibLandmarkDetection"].SetBool(false);
+    config["eyesDetector"]["useHaarCascade"].SetBool(true);
+    config["lipsDetector"]["useHaarCascade"].SetBool(true);
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    config.Accept(writer);
+
+    const auto pHaarFeatureCache = std::make_shared<HaarFeatureCache>();
+    const auto pPppEngine
+        = std::make_shared<PppEngine>(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, pHaarFeatureCache);
+    pPppEngine->configure(buffer.GetString());
+
+    // The face is found in a rotated copy of the image, where the eyes and the mouth are searched too
+    const auto image = imread(resolvePath("research/sample_test_images/000.jpg"));
+    const auto imgKey = pPppEngine->setInputImage(Utilities::rotateImage(image, 90));
+    LandMarks landMarks;
+    ASSERT_TRUE(pPppEngine->detectLandMarks(imgKey, landMarks));
+    ASSERT_NE(0, landMarks.imageRotation);
+    EXPECT_EQ(1, pHaarFeatureCache->size()) << "Only the features of the input image should be cached";
+}
+
+TEST_F(PppEngineIntegrationTests, DISABLED_MinimalShapePredictorBenchmark)
+{
+    std::string configString;
+    readConfigFromFile("", configString);
+    rapidjson::Document config;
+    config.Parse(configString.c_str());
+    config["useDlibLandmarkDetection"].SetBool(true);
+    const auto toString = [](const rapidjson::Document & document) {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        document.Accept(writer);
+        return std::string(buffer.GetString());
+    };
+    const auto currentModelSize = strlen(config["shapePredictor"]["data"].GetString()) / 4 * 3;
+    const auto currentConfigString = toString(config);
+
+    // The minimal model and its configuration node are written by research/scripts/train_minimal_shape_predictor.py
+    std::ifstream minimalConfigStream(resolvePath("libppp/share/sp_model_minimal.json"));
+    const std::string minimalConfigString((std::istreambuf_iterator<char>(minimalConfigStream)),
+                                          std::istreambuf_iterator<char>());
+    rapidjson::Document minimalConfig;
+    minimalConfig.Parse(minimalConfigString.c_str());
+    ASSERT_FALSE(minimalConfig.HasParseError());
+    const auto minimalModelFile = resolvePath("libppp/share/" + std::string(minimalConfig["file"].GetString()));
+    std::ifstream minimalModelStream(minimalModelFile, std::ios::binary | std::ios::ate);
+    const auto minimalModelSize = static_cast<size_t>(minimalModelStream.tellg());
+    minimalConfig["file"].SetString(minimalModelFile.c_str(), minimalConfig.GetAllocator());
+    config["shapePredictor"].CopyFrom(minimalConfig, config.GetAllocator());
+    const auto minimalModelConfigString = toString(config);
+
+    for (const auto & model : { std::make_tuple("Current", currentConfigString, currentModelSize),
+                                std::make_tuple("Minimal", minimalModelConfigString, minimalModelSize) })
+    {
+        const auto pPppEngine = std::make_shared<PppEngine>();
+        ASSERT_TRUE(pPppEngine->configure(std::get<1>(model)));
+        std::chrono::duration<double, std::milli> elapsedTime(0);
+
+        const auto process = [&](const std::string & imagePrefix,
+                                 Mat & rgbImage,
+                                 Mat & grayImage,
+                                 const LandMarks & annotations,
+                                 LandMarks & detectedLandMarks) -> bool {
+            const auto imgKey = pPppEngine->setInputImage(rgbImage);
+            const auto start = std::chrono::steady_clock::now();
+            const auto success = pPppEngine->detectLandMarks(imgKey, detectedLandMarks);
+            elapsedTime += std::chrono::steady_clock::now() - start;
+            return success;
+        };
+
+        std::vector<ResultData> resultsData;
+        processDatabase(process,
+                        std::vector<std::string>(),
+                        "research/mugshot_frontal_original_all/via_region_data_dpd.csv",
+                        resultsData);
+
+        ASSERT_FALSE(resultsData.empty());
+        std::cout << std::get<0>(model) << " shape predictor: model size " << std::get<2>(model) << " bytes, "
+                  << elapsedTime.count() / resultsData.size() << " ms per image" << std::endl;
+        processResults(resultsData);
+    }
+}
+
 TEST_F(PppEngineIntegrationTests, DevelopementTestSingleCase)
 {
     auto imageFileName = resolvePath("research/mugshot_frontal_original_all/012_frontal.jpg");
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "LandMarks.h"
+
+class LandMarksTests : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        // Proportions of an upright frontal face as found by the Haar face detector
+        m_landMarks.vjFaceRect = cv::Rect(100, 100, 200, 200);
+        m_landMarks.eyeLeftPupil = cv::Point(160, 180);
+        m_landMarks.eyeRightPupil = cv::Point(240, 180);
+        m_landMarks.lipLeftCorner = cv::Point(170, 265);
+        m_landMarks.lipRightCorner = cv::Point(230, 265);
+    }
+
+    LandMarks m_landMarks;
+};
+
+TEST_F(LandMarksTests, FrontalFaceGeometryIsPlausible)
+{
+    EXPECT_DOUBLE_EQ(1.0, m_landMarks.geometryPlausibility());
+
+    // Small deviations are still plausible
+    m_landMarks.eyeRightPupil.y += 5;
+    m_landMarks.lipLeftCorner.x -= 10;
+    EXPECT_DOUBLE_EQ(1.0, m_landMarks.geometryPlausibility());
+}
+
+TEST_F(LandMarksTests, MisplacedLandMarksAreImplausible)
+{
+    auto mouthAboveEyes = m_landMarks;
+    mouthAboveEyes.lipLeftCorner.y = mouthAboveEyes.lipRightCorner.y = 120;
+    EXPECT_DOUBLE_EQ(0.0, mouthAboveEyes.geometryPlausibility());
+
+    auto eyesTooClose = m_landMarks;
+    eyesTooClose.eyeRightPupil.x = eyesTooClose.eyeLeftPupil.x + 10;
+    EXPECT_DOUBLE_EQ(0.0, eyesTooClose.geometryPlausibility());
+
+    auto tiltedEyes = m_landMarks;
+    tiltedEyes.eyeRightPupil.y += 40;
+    EXPECT_LT(tiltedEyes.geometryPlausibility(), 0.5);
+
+    auto eyesOutsideOfTheFace = m_landMarks;
+    eyesOutsideOfTheFace.eyeLeftPupil.y = eyesOutsideOfTheFace.eyeRightPupil.y = 320;
+    EXPECT_DOUBLE_EQ(0.0, eyesOutsideOfTheFace.geometryPlausibility());
+
+    EXPECT_DOUBLE_EQ(0.0, m_landMarks.rotated(180, cv::Size(400, 400)).geometryPlausibility())
+        << "Only upright faces are plausible";
+
+    EXPECT_DOUBLE_EQ(0.0, LandMarks().geometryPlausibility());
+}
+
+TEST_F(LandMarksTests, JsonRoundTripKeepsTheLandMarks)
+{
+    m_landMarks.vjRightEyeRect = cv::Rect(210, 160, 60, 40);
+    m_landMarks.vjMouthRect = cv::Rect(160, 240, 80, 50);
+    m_landMarks.crownPoint = cv::Point(200, 60);
+    m_landMarks.chinPoint = cv::Point(200, 320);
+
+    rapidjson::Document d;
+    d.Parse(m_landMarks.toJson().c_str());
+    const auto landMarks = LandMarks::fromJson(d);
+
+    EXPECT_EQ(m_landMarks.vjFaceRect, landMarks.vjFaceRect);
+    EXPECT_EQ(m_landMarks.vjRightEyeRect, landMarks.vjRightEyeRect);
+    EXPECT_EQ(m_landMarks.vjMouthRect, landMarks.vjMouthRect);
+    EXPECT_EQ(m_landMarks.eyeLeftPupil, landMarks.eyeLeftPupil);
+    EXPECT_EQ(m_landMarks.lipRightCorner, landMarks.lipRightCorner);
+    EXPECT_EQ(m_landMarks.crownPoint, landMarks.crownPoint);
+    EXPECT_EQ(m_landMarks.chinPoint, landMarks.chinPoint);
+}
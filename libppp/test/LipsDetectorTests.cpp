@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "LipsDetector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+class LipsDetectorTests : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        cv::randu(m_bgrImage, cv::Scalar::all(0), cv::Scalar::all(256));
+        // Black pixels and pixels without red nor green
+        m_bgrImage.at<cv::Vec3b>(0, 0) = cv::Vec3b(0, 0, 0);
+        m_bgrImage.at<cv::Vec3b>(0, 1) = cv::Vec3b(200, 0, 0);
+    }
+
+    cv::Mat m_bgrImage = cv::Mat(240, 320, CV_8UC3);
+
+    ///<- Per pixel transform in floating point the likelihood table is built from
+    static cv::Mat referenceLipsLikelihood(const cv::Mat & bgrImage)
+    {
+        cv::Mat colorTformImage(bgrImage.size(), CV_32F);
+        std::transform(bgrImage.begin<cv::Vec3b>(),
+                       bgrImage.end<cv::Vec3b>(),
+                       colorTformImage.begin<float>(),
+                       [](const cv::Vec3b & pixel) {
+                           const auto rgbSum = static_cast<float>(pixel[0]) + pixel[1] + pixel[2];
+                           const auto r = pixel[2] / rgbSum;
+                           const auto g = pixel[1] / rgbSum;
+                           const auto v = r / (r + g) * (1 - g / (r + g));
+                           return v * v * 255;
+                       });
+        cv::Mat likelihood;
+        colorTformImage.convertTo(likelihood, CV_8UC1);
+        return likelihood;
+    }
+};
+
+TEST_F(LipsDetectorTests, LikelihoodTableMatchesTheFloatTransform)
+{
+    // Every BGR color: red is the row and green the column of an image filled with each blue component in turn
+    cv::Mat allColorsImage(256, 256, CV_8UC3);
+    for (auto blue = 0; blue < 256; ++blue)
+    {
+        for (auto red = 0; red < 256; ++red)
+        {
+            for (auto green = 0; green < 256; ++green)
+            {
+                allColorsImage.at<cv::Vec3b>(red, green)
+                    = cv::Vec3b(static_cast<uchar>(blue), static_cast<uchar>(green), static_cast<uchar>(red));
+            }
+        }
+        const auto allColorsLikelihood = LipsDetector::lipsLikelihood(allColorsImage);
+        ASSERT_EQ(CV_8UC1, allColorsLikelihood.type());
+        ASSERT_EQ(allColorsImage.size(), allColorsLikelihood.size());
+        ASSERT_EQ(0, cv::norm(referenceLipsLikelihood(allColorsImage), allColorsLikelihood, cv::NORM_INF))
+            << "Blue component " << blue;
+    }
+
+    // Random image
+    const auto likelihood = LipsDetector::lipsLikelihood(m_bgrImage);
+    EXPECT_EQ(0, cv::norm(referenceLipsLikelihood(m_bgrImage), likelihood, cv::NORM_INF));
+
+    // Region of interest of a larger image
+    const cv::Rect roi(13, 7, 101, 57);
+    EXPECT_EQ(0, cv::norm(likelihood(roi), LipsDetector::lipsLikelihood(m_bgrImage(roi)), cv::NORM_INF));
+}
+
+TEST_F(LipsDetectorTests, DISABLED_LikelihoodBenchmark)
+{
+    const auto numIterations = 100;
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < numIterations; ++i)
+    {
+        referenceLipsLikelihood(m_bgrImage);
+    }
+    const std::chrono::duration<double, std::milli> referenceTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < numIterations; ++i)
+    {
+        LipsDetector::lipsLikelihood(m_bgrImage);
+    }
+    const std::chrono::duration<double, std::milli> tableTime = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Lips likelihood of a " << m_bgrImage.cols << "x" << m_bgrImage.rows << " image: float transform "
+              << referenceTime.count() / numIterations << " ms, table " << tableTime.count() / numIterations << " ms"
+              << std::endl;
+}
@@ -9,4 +9,6 @@ public:
     MOCK_METHOD1(configure, void (rapidjson::Value&));
 
     MOCK_METHOD2(detectLandMarks, bool (const cv::Mat&, LandMarks&));
+
+    MOCK_METHOD1(detectAllLandMarks, std::vector<LandMarks> (const cv::Mat&));
 };
\ No newline at end of file
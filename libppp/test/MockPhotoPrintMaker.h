@@ -7,6 +7,7 @@ class MockPhotoPrintMaker : public IPhotoPrintMaker
 {
 public:
     MOCK_METHOD4(cropPicture, cv::Mat (const cv::Mat&, const cv::Point&, const cv::Point&, const PhotoStandard&));
+    MOCK_CONST_METHOD3(cropGeometry, cv::RotatedRect (const cv::Point&, const cv::Point&, const PhotoStandard&));
     MOCK_METHOD3(tileCroppedPhoto, cv::Mat (const CanvasDefinition&, const PhotoStandard&, const cv::Mat&));
     MOCK_METHOD1(configure, void (rapidjson::Value&));
 };
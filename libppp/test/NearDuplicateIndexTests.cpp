@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include "NearDuplicateIndex.h"
+
+class NearDuplicateIndexTests : public testing::Test
+{
+protected:
+    NearDuplicateIndexSPtr m_pNearDuplicateIndex = std::make_shared<NearDuplicateIndex>();
+
+    static cv::Mat createImage(int seed)
+    {
+        cv::Mat image(600, 400, CV_8UC1);
+        cv::RNG rng(seed);
+        rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+        cv::GaussianBlur(image, image, cv::Size(0, 0), 25);
+        cv::normalize(image, image, 0, 255, cv::NORM_MINMAX);
+        return image;
+    }
+};
+
+TEST_F(NearDuplicateIndexTests, ResizedImageReusesRescaledLandMarks)
+{
+    const auto image = createImage(1);
+    cv::Mat resizedImage;
+    cv::resize(image, resizedImage, cv::Size(200, 300), 0, 0, cv::INTER_AREA);
+
+    LandMarks landMarks;
+    landMarks.vjFaceRect = cv::Rect(100, 120, 200, 240);
+    landMarks.crownPoint = cv::Point(200, 100);
+    landMarks.chinPoint = cv::Point(202, 400);
+    m_pNearDuplicateIndex->add(NearDuplicateIndex::computeSignature(image), landMarks);
+
+    LandMarks reusedLandMarks;
+    ASSERT_TRUE(m_pNearDuplicateIndex->find(NearDuplicateIndex::computeSignature(resizedImage), reusedLandMarks));
+    EXPECT_EQ(cv::Rect(50, 60, 100, 120), reusedLandMarks.vjFaceRect);
+    EXPECT_EQ(cv::Point(100, 50), reusedLandMarks.crownPoint);
+    EXPECT_EQ(cv::Point(101, 200), reusedLandMarks.chinPoint);
+}
+
+TEST_F(NearDuplicateIndexTests, DifferentImagesAreNotMatched)
+{
+    m_pNearDuplicateIndex->add(NearDuplicateIndex::computeSignature(createImage(1)), LandMarks());
+
+    LandMarks landMarks;
+    EXPECT_FALSE(m_pNearDuplicateIndex->find(NearDuplicateIndex::computeSignature(createImage(2)), landMarks));
+
+    // Same content but different aspect ratio
+    cv::Mat stretchedImage;
+    cv::resize(createImage(1), stretchedImage, cv::Size(400, 500));
+    EXPECT_FALSE(m_pNearDuplicateIndex->find(NearDuplicateIndex::computeSignature(stretchedImage), landMarks));
+}
+
+TEST_F(NearDuplicateIndexTests, OldestEntriesAreDropped)
+{
+    m_pNearDuplicateIndex->setCapacity(1);
+    const auto image1 = createImage(1);
+    const auto image2 = createImage(2);
+    m_pNearDuplicateIndex->add(NearDuplicateIndex::computeSignature(image1), LandMarks());
+    m_pNearDuplicateIndex->add(NearDuplicateIndex::computeSignature(image2), LandMarks());
+
+    LandMarks landMarks;
+    EXPECT_FALSE(m_pNearDuplicateIndex->find(NearDuplicateIndex::computeSignature(image1), landMarks));
+    EXPECT_TRUE(m_pNearDuplicateIndex->find(NearDuplicateIndex::computeSignature(image2), landMarks));
+}
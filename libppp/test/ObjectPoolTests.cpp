@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+
+#include "ObjectPool.h"
+
+class ObjectPoolTests : public testing::Test
+{
+protected:
+    int m_numCreated = 0;
+    ObjectPool<int> m_objectPool { [this]() { return std::make_shared<int>(m_numCreated++); } };
+};
+
+TEST_F(ObjectPoolTests, ReleasedObjectsAreReused)
+{
+    {
+        const auto pObject1 = m_objectPool.acquire();
+        const auto pObject2 = m_objectPool.acquire();
+        EXPECT_NE(pObject1.get(), pObject2.get()) << "Objects in use must not be shared";
+        EXPECT_EQ(0, m_objectPool.numAvailable());
+    }
+    EXPECT_EQ(2, m_objectPool.numAvailable());
+
+    const auto pObject = m_objectPool.acquire();
+    EXPECT_EQ(2, m_numCreated) << "A released object should have been reused";
+    EXPECT_EQ(1, m_objectPool.numAvailable());
+}
+
+TEST_F(ObjectPoolTests, ObjectsCanOutliveThePool)
+{
+    std::shared_ptr<int> pObject;
+    {
+        ObjectPool<int> objectPool([]() { return std::make_shared<int>(42); });
+        pObject = objectPool.acquire();
+    }
+    EXPECT_EQ(42, *pObject);
+}
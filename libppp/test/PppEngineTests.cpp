@@ -2,6 +2,7 @@
 #include <memory>
 
 #include "CanvasDefinition.h"
+#include "HaarFeatureCache.h"
 #include "LandMarks.h"
 #include "PhotoStandard.h"
 
@@ -10,6 +11,9 @@
 #include "MockImageStore.h"
 #include "MockPhotoPrintMaker.h"
 #include "PppEngine.h"
+#include "TestHelpers.h"
+
+#include <opencv2/imgcodecs.hpp>
 
 using namespace testing;
 
@@ -101,3 +105,121 @@ TEST_F(PppEngineTests, LandMarkDetectionWorkflowHappyPath)
     // Act
     EXPECT_EQ(true, m_pppEngine->detectLandMarks(imgKey, landmarks));
 }
+
+TEST_F(PppEngineTests, DetectsTheLandMarksOfAllTheFaces)
+{
+    cv::Mat dummyImage(20, 30, CV_8UC3, cv::Scalar(10, 20, 30));
+    std::string imgKey = "a1b2c3d4";
+
+    std::vector<LandMarks> detectedFaces(3);
+    detectedFaces[0].vjFaceRect = cv::Rect(0, 0, 10, 10);
+    detectedFaces[1].vjFaceRect = cv::Rect(10, 0, 8, 8);
+    detectedFaces[2].vjFaceRect = cv::Rect(20, 0, 6, 6);
+
+    EXPECT_CALL(*m_pImageStore, containsImage(Ref(imgKey))).WillOnce(Return(true));
+    EXPECT_CALL(*m_pImageStore, getImage(Ref(imgKey))).WillOnce(Return(dummyImage));
+    EXPECT_CALL(*m_pFaceDetector, detectAllLandMarks(_)).WillOnce(Return(detectedFaces));
+    EXPECT_CALL(*m_pEyesDetector, detectLandMarks(_, _)).Times(3).WillRepeatedly(Return(true));
+    EXPECT_CALL(*m_pLipsDetector, detectLandMarks(_, _)).Times(3).WillRepeatedly(Return(true));
+    // The crown and chin of the second face are not found, so it is dropped
+    EXPECT_CALL(*m_pCrownChinEstimator, estimateCrownChin(_))
+        .Times(3)
+        .WillRepeatedly(Invoke([](LandMarks & landMarks) { return landMarks.vjFaceRect.x != 10; }));
+
+    std::vector<LandMarks> facesLandMarks;
+    ASSERT_TRUE(m_pppEngine->detectAllLandMarks(imgKey, facesLandMarks));
+    ASSERT_EQ(2, facesLandMarks.size());
+    EXPECT_EQ(detectedFaces[0].vjFaceRect, facesLandMarks[0].vjFaceRect);
+    EXPECT_EQ(detectedFaces[2].vjFaceRect, facesLandMarks[1].vjFaceRect);
+}
+
+TEST_F(PppEngineTests, RotatedFacesKeepTheFeaturesOfTheInputImageCached)
+{
+    const auto pHaarFeatureCache = std::make_shared<HaarFeatureCache>();
+    const auto pppEngine = std::make_shared<PppEngine>(m_pFaceDetector,
+                                                       m_pEyesDetector,
+                                                       m_pLipsDetector,
+                                                       m_pCrownChinEstimator,
+                                                       m_pPhotoPrintMaker,
+                                                       m_pImageStore,
+                                                       pHaarFeatureCache);
+    cv::Mat dummyImage(20, 30, CV_8UC3, cv::Scalar(10, 20, 30));
+    std::string imgKey = "a1b2c3d4";
+    const auto pInputFeatures = pHaarFeatureCache->features(dummyImage);
+
+    // Both faces were found in the image rotated by 90 degrees, as many upright copies as the cache capacity
+    std::vector<LandMarks> detectedFaces(2);
+    for (auto & detectedFace : detectedFaces)
+    {
+        detectedFace.imageRotation = 90;
+    }
+
+    EXPECT_CALL(*m_pImageStore, containsImage(Ref(imgKey))).WillOnce(Return(true));
+    EXPECT_CALL(*m_pImageStore, getImage(Ref(imgKey))).WillOnce(Return(dummyImage));
+    EXPECT_CALL(*m_pFaceDetector, detectAllLandMarks(_)).WillOnce(Return(detectedFaces));
+    EXPECT_CALL(*m_pEyesDetector, detectLandMarks(_, _)).Times(2).WillRepeatedly(Return(true));
+    EXPECT_CALL(*m_pLipsDetector, detectLandMarks(_, _)).Times(2).WillRepeatedly(Return(true));
+    EXPECT_CALL(*m_pCrownChinEstimator, estimateCrownChin(_)).Times(2).WillRepeatedly(Return(true));
+
+    std::vector<LandMarks> facesLandMarks;
+    ASSERT_TRUE(pppEngine->detectAllLandMarks(imgKey, facesLandMarks));
+    EXPECT_EQ(1, pHaarFeatureCache->size()) << "The upright copies should not be cached";
+    EXPECT_EQ(pInputFeatures, pHaarFeatureCache->features(dummyImage, false));
+}
+
+TEST_F(PppEngineTests, CroppingAnEvictedImageFails)
+{
+    const std::string imgKey = "a1b2c3d4";
+    PhotoStandard passportStandard(35.0, 45.0, 34.0);
+    CanvasDefinition canvasDefinition(6, 4, 300, "inch");
+    cv::Point crownMark(100, 100), chinMark(100, 300);
+
+    // The image is evicted between the check and the crop
+    EXPECT_CALL(*m_pImageStore, containsImage(imgKey)).WillOnce(Return(true));
+    EXPECT_CALL(*m_pImageStore, getImagePyramid(imgKey)).WillOnce(Return(nullptr));
+    EXPECT_CALL(*m_pPhotoPrintMaker, cropPicture(_, _, _, _)).Times(0);
+
+    EXPECT_THROW(m_pppEngine->cropPicture(imgKey, passportStandard, canvasDefinition, crownMark, chinMark),
+                 std::runtime_error);
+}
+
+TEST_F(PppEngineTests, EstimateCrownChinOnlyRunsTheEstimator)
+{
+    LandMarks landmarks;
+    landmarks.eyeLeftPupil = cv::Point(400, 300);
+    landmarks.eyeRightPupil = cv::Point(600, 300);
+
+    EXPECT_CALL(*m_pImageStore, getImage(_)).Times(0);
+    EXPECT_CALL(*m_pFaceDetector, detectLandMarks(_, _)).Times(0);
+    EXPECT_CALL(*m_pCrownChinEstimator, estimateCrownChin(Ref(landmarks))).WillOnce(Return(true));
+
+    EXPECT_TRUE(m_pppEngine->estimateCrownChin(landmarks));
+}
+
+TEST_F(PppEngineTests, ShapePredictorRunsOnTheDetectedFace)
+{
+    std::string configString;
+    readConfigFromFile("", configString);
+    m_pppEngine->configure(configString);
+
+    const auto image = cv::imread(resolvePath("research/sample_test_images/000.jpg"));
+    const std::string imgKey = "a1b2c3d4";
+    LandMarks faceLandMarks;
+    faceLandMarks.vjFaceRect = cv::Rect(image.cols / 4, image.rows / 4, image.cols / 2, image.rows / 2);
+
+    EXPECT_CALL(*m_pImageStore, containsImage(imgKey)).WillOnce(Return(true));
+    EXPECT_CALL(*m_pImageStore, getImage(imgKey)).WillOnce(Return(image));
+    // The face is detected only once, the shape predictor runs on it
+    EXPECT_CALL(*m_pFaceDetector, detectLandMarks(_, _))
+        .WillOnce(DoAll(SetArgReferee<1>(faceLandMarks), Return(true)));
+    EXPECT_CALL(*m_pEyesDetector, detectLandMarks(_, _)).Times(0);
+    EXPECT_CALL(*m_pLipsDetector, detectLandMarks(_, _)).Times(0);
+    EXPECT_CALL(*m_pCrownChinEstimator, estimateCrownChin(_)).WillOnce(Return(true));
+
+    LandMarks landmarks;
+    ASSERT_TRUE(m_pppEngine->detectLandMarks(imgKey, landmarks));
+    EXPECT_FALSE(landmarks.allLandmarks.empty());
+    EXPECT_TRUE(IN_ROI(faceLandMarks.vjFaceRect, landmarks.eyeLeftPupil));
+    EXPECT_TRUE(IN_ROI(faceLandMarks.vjFaceRect, landmarks.eyeRightPupil));
+    EXPECT_GT(landmarks.shapePredictorLevels, 0);
+}
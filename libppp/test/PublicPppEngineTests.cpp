@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+
+#include "TestHelpers.h"
+#include "libppp.h"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <opencv2/core/core.hpp>
+#include <rapidjson/document.h>
+
+class PublicPppEngineTests : public testing::Test
+{
+protected:
+    PublicPppEngine m_pppEngine;
+    std::string m_imageId;
+
+    void SetUp() override
+    {
+        std::string configString;
+        readConfigFromFile("", configString);
+        m_pppEngine.configure(configString.c_str());
+
+        std::ifstream imageFile(resolvePath("research/sample_test_images/000.jpg"), std::ios::binary);
+        const std::string imageData((std::istreambuf_iterator<char>(imageFile)), std::istreambuf_iterator<char>());
+        m_imageId = m_pppEngine.setImage(imageData.data(), imageData.size());
+    }
+
+    /*!@brief Creates a preview request of a 35x45 mm photo in a 6x4 inch canvas, with the crown and chin of 000.jpg !*/
+    static std::string previewRequest(const std::string & previewOptions)
+    {
+        return R"({
+            "standard": { "pictureWidth": 35, "pictureHeight": 45, "faceHeight": 34, "units": "mm" },
+            "canvas": { "width": 6, "height": 4, "resolution": 300, "units": "inch" },
+            "crownPoint": { "x": 941, "y": 999 },
+            "chinPoint": { "x": 927, "y": 1675 },
+            "preview": )"
+            + previewOptions + "}";
+    }
+
+    /*!@brief Decodes a preview in "rgba" format, checking its header !*/
+    static cv::Mat decodeRgbaPreview(const std::string & preview)
+    {
+        if (preview.size() < 8)
+        {
+            ADD_FAILURE() << "The preview should start with its size";
+            return cv::Mat();
+        }
+        const auto readUInt32 = [&preview](size_t offset) {
+            uint32_t value = 0;
+            for (size_t i = 0; i < 4; ++i)
+            {
+                value = value << 8 | static_cast<uint8_t>(preview[offset + i]);
+            }
+            return static_cast<int>(value);
+        };
+        const auto width = readUInt32(0);
+        const auto height = readUInt32(4);
+        if (static_cast<size_t>(8 + 4 * width * height) != preview.size())
+        {
+            ADD_FAILURE() << "The header should hold the size of the pixels";
+            return cv::Mat();
+        }
+
+        cv::Mat image(height, width, CV_8UC4);
+        std::copy(preview.begin() + 8, preview.end(), image.data);
+        return image;
+    }
+};
+
+TEST_F(PublicPppEngineTests, PreviewOfThePhotoHasTheExactSize)
+{
+    const auto preview = decodeRgbaPreview(m_pppEngine.createPreview(
+        m_imageId, previewRequest(R"({ "maxWidth": 640, "maxHeight": 480, "format": "rgba" })")));
+
+    // The 35x45 mm photo fills the height
+    EXPECT_EQ(cv::Size(373, 480), preview.size());
+    ASSERT_FALSE(preview.empty());
+    EXPECT_EQ(255, preview.at<cv::Vec4b>(0, 0)[3]) << "Pixels should be opaque";
+}
+
+TEST_F(PublicPppEngineTests, TiledPreviewHasTheLayoutOfThePrint)
+{
+    const auto preview = decodeRgbaPreview(m_pppEngine.createPreview(
+        m_imageId, previewRequest(R"({ "maxWidth": 640, "maxHeight": 480, "tiled": true, "format": "rgba" })")));
+
+    // The 6x4 inch canvas fills the width, with 4 columns and 2 rows of 147x189 photos
+    ASSERT_EQ(cv::Size(640, 427), preview.size());
+    const cv::Rect firstTile(0, 0, 147, 189);
+    for (auto row = 0; row < 2; ++row)
+    {
+        for (auto col = 0; col < 4; ++col)
+        {
+            const auto tile = preview(firstTile + cv::Point(col * firstTile.width, row * firstTile.height));
+            EXPECT_EQ(0, cv::norm(preview(firstTile), tile, cv::NORM_INF)) << "Tile " << row << ", " << col;
+        }
+    }
+
+    // The rest of the canvas is the background
+    const cv::Rect rightMargin(4 * firstTile.width, 0, preview.cols - 4 * firstTile.width, preview.rows);
+    EXPECT_EQ(cv::Scalar(128, 128, 128, 255), cv::mean(preview(rightMargin)));
+}
+
+TEST_F(PublicPppEngineTests, PreviewSizeIsLimited)
+{
+    const auto preview = decodeRgbaPreview(m_pppEngine.createPreview(
+        m_imageId, previewRequest(R"({ "maxWidth": 100000, "maxHeight": 100000, "format": "rgba" })")));
+    EXPECT_EQ(cv::Size(933, 1200), preview.size()) << "The size should be clamped to 1600x1200";
+
+    for (const auto & invalidOptions : { R"({ "maxWidth": 0 })", R"({ "maxHeight": -1 })", R"({ "maxWidth": 6.5 })" })
+    {
+        EXPECT_THROW(m_pppEngine.createPreview(m_imageId, previewRequest(invalidOptions)), std::runtime_error)
+            << invalidOptions;
+    }
+}
+
+TEST_F(PublicPppEngineTests, PreviewThatDoesNotFitTheBufferFails)
+{
+    std::string configString;
+    readConfigFromFile("", configString);
+    ASSERT_TRUE(configure(configString.c_str()));
+
+    char imageId[64];
+    std::ifstream imageFile(resolvePath("research/sample_test_images/000.jpg"), std::ios::binary);
+    const std::string imageData((std::istreambuf_iterator<char>(imageFile)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(set_image(imageData.data(), static_cast<int>(imageData.size()), imageId));
+
+    const auto request = previewRequest(R"({ "maxWidth": 640, "maxHeight": 480, "format": "rgba" })");
+    const auto previewSize = 8 + 4 * 373 * 480;
+    std::vector<char> buffer(previewSize);
+    EXPECT_EQ(0, create_preview(imageId, request.c_str(), buffer.data(), previewSize - 1));
+    EXPECT_EQ(previewSize, create_preview(imageId, request.c_str(), buffer.data(), previewSize));
+}
+
+TEST_F(PublicPppEngineTests, LandMarksOfAllFacesThatDoNotFitTheBufferFail)
+{
+    std::string configString;
+    readConfigFromFile("", configString);
+    ASSERT_TRUE(configure(configString.c_str()));
+
+    char imageId[64];
+    std::ifstream imageFile(resolvePath("research/sample_test_images/000.jpg"), std::ios::binary);
+    const std::string imageData((std::istreambuf_iterator<char>(imageFile)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(set_image(imageData.data(), static_cast<int>(imageData.size()), imageId));
+
+    std::vector<char> buffer(1024 * 1024);
+    ASSERT_TRUE(detect_all_landmarks(imageId, buffer.data(), static_cast<int>(buffer.size())));
+    rapidjson::Document d;
+    ASSERT_FALSE(d.Parse(buffer.data()).HasParseError());
+    ASSERT_TRUE(d.IsArray());
+    EXPECT_FALSE(d.Empty());
+
+    // The terminating null must fit too
+    const auto landMarksSize = static_cast<int>(strlen(buffer.data()) + 1);
+    EXPECT_FALSE(detect_all_landmarks(imageId, buffer.data(), landMarksSize - 1));
+    EXPECT_TRUE(detect_all_landmarks(imageId, buffer.data(), landMarksSize));
+}
+
+TEST_F(PublicPppEngineTests, EstimatesTheCrownAndChinFromJsonLandMarks)
+{
+    // Fractional coordinates, e.g. from a drag in the UI, are rounded
+    const auto response = m_pppEngine.estimateCrownChin(R"({
+        "landmarks": {
+            "eyeLeftPupil": { "x": 400.4, "y": 300 },
+            "eyeRightPupil": { "x": 600, "y": 300.6 },
+            "lipLeftCorner": { "x": 420, "y": 550 },
+            "lipRightCorner": { "x": 580, "y": 550 }
+        },
+        "standard": { "pictureWidth": 35, "pictureHeight": 45, "faceHeight": 34, "units": "mm" }
+    })");
+
+    rapidjson::Document d;
+    ASSERT_FALSE(d.Parse(response.c_str()).HasParseError());
+    EXPECT_EQ(400, d["eyeLeftPupil"]["x"].GetInt());
+    EXPECT_EQ(301, d["eyeRightPupil"]["y"].GetInt());
+    const cv::Point crownPoint(d["crownPoint"]["x"].GetInt(), d["crownPoint"]["y"].GetInt());
+    const cv::Point chinPoint(d["chinPoint"]["x"].GetInt(), d["chinPoint"]["y"].GetInt());
+    EXPECT_LT(crownPoint.y, 300);
+    EXPECT_GT(chinPoint.y, 550);
+
+    // The crop keeps the aspect ratio of the photo, and the face takes 34 of its 45 mm
+    ASSERT_TRUE(d.HasMember("cropRect"));
+    const auto & cropRect = d["cropRect"];
+    EXPECT_NEAR(35.0 / 45.0, cropRect["width"].GetDouble() / cropRect["height"].GetDouble(), 1e-3);
+    EXPECT_NEAR(45.0 / 34.0 * cv::norm(chinPoint - crownPoint), cropRect["height"].GetDouble(), 2.0);
+    EXPECT_NEAR(500.0, cropRect["center"]["x"].GetDouble(), 5.0);
+}
+
+TEST_F(PublicPppEngineTests, InvalidCrownChinRequestsAreRejected)
+{
+    const std::string pupils = R"("eyeLeftPupil": { "x": 400, "y": 300 }, "eyeRightPupil": { "x": 600, "y": 300 })";
+    for (const auto & request : {
+             std::string("{ not json"),
+             std::string(R"({ "standard": {} })"),
+             std::string(R"({ "landmarks": [] })"),
+             R"({ "landmarks": { )" + pupils + R"(, "lipLeftCorner": { "x": 420, "y": 550 } } })",
+             R"({ "landmarks": { )" + pupils
+                 + R"(, "lipLeftCorner": { "x": 420, "y": 550 }, "lipRightCorner": { "x": "580", "y": 550 } } })",
+             R"({ "landmarks": { )" + pupils
+                 + R"(, "lipLeftCorner": { "x": 420, "y": 550 }, "lipRightCorner": { "y": 550 } } })",
+         })
+    {
+        EXPECT_THROW(m_pppEngine.estimateCrownChin(request), std::runtime_error) << request;
+    }
+
+    char landmarks[1024];
+    EXPECT_FALSE(estimate_crown_chin(R"({ "landmarks": {} })", landmarks));
+}
@@ -0,0 +1,335 @@
+#include <gtest/gtest.h>
+
+#include "PppEngine.h"
+#include "ShapePredictor.h"
+#include "TestHelpers.h"
+#include "Utilities.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+#include <dlib/image_processing/shape_predictor.h>
+#include <dlib/opencv/cv_image.h>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+class ShapePredictorTests : public testing::Test
+{
+protected:
+    std::string m_modelData;
+    cv::Mat m_image;
+    std::vector<dlib::rectangle> m_faceRects;
+
+    void SetUp() override
+    {
+        std::string configString;
+        readConfigFromFile("", configString);
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        const auto modelBase64 = config["shapePredictor"]["data"].GetString();
+        const auto modelData = Utilities::base64Decode(modelBase64, strlen(modelBase64));
+        m_modelData.assign(modelData.begin(), modelData.end());
+
+        m_image = cv::imread(resolvePath("research/sample_test_images/000.jpg"));
+        const auto w = m_image.cols;
+        const auto h = m_image.rows;
+        // Faces in the middle, off center and partially outside of the image
+        m_faceRects = { dlib::rectangle(w / 4, h / 4, 3 * w / 4, 3 * h / 4),
+                        dlib::rectangle(w / 3, h / 5, 2 * w / 3, h / 2),
+                        dlib::rectangle(-w / 4, h / 2, w / 4, h + h / 4) };
+    }
+
+    std::shared_ptr<dlib::shape_predictor> loadDlibShapePredictor() const
+    {
+        auto pShapePredictor = std::make_shared<dlib::shape_predictor>();
+        std::istringstream stream(m_modelData);
+        dlib::deserialize(*pShapePredictor, stream);
+        return pShapePredictor;
+    }
+
+    ShapePredictorSPtr loadShapePredictor() const
+    {
+        std::istringstream stream(m_modelData);
+        return std::make_shared<ShapePredictor>(stream);
+    }
+
+    /*!@brief Loads the model quantized by build.py !*/
+    static ShapePredictorSPtr loadQuantizedShapePredictor()
+    {
+        std::ifstream stream(quantizedModelFile(), std::ios::binary);
+        return std::make_shared<ShapePredictor>(stream);
+    }
+
+    static std::string quantizedModelFile()
+    {
+        return resolvePath("libppp/share/sp_model.q8.bin");
+    }
+
+    /*!@brief Gets the configuration using the shape predictor, with its quantized model or not !*/
+    static std::string shapePredictorConfigString(bool quantized)
+    {
+        std::string configString;
+        readConfigFromFile("", configString);
+        rapidjson::Document config;
+        config.Parse(configString.c_str());
+        config["useDlibLandmarkDetection"].SetBool(true);
+        auto & quantizedCfg = config["shapePredictor"]["quantized"];
+        quantizedCfg["enabled"].SetBool(quantized);
+        quantizedCfg["file"].SetString(quantizedModelFile().c_str(), config.GetAllocator());
+
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        config.Accept(writer);
+        return buffer.GetString();
+    }
+
+    static void expectSameShape(const dlib::full_object_detection & expected,
+                                const dlib::full_object_detection & actual)
+    {
+        EXPECT_EQ(expected.get_rect(), actual.get_rect());
+        ASSERT_EQ(expected.num_parts(), actual.num_parts());
+        for (unsigned long i = 0; i < expected.num_parts(); ++i)
+        {
+            EXPECT_EQ(expected.part(i), actual.part(i)) << "Part " << i;
+        }
+    }
+};
+
+TEST_F(ShapePredictorTests, MatchesTheDlibShapePredictor)
+{
+    const auto pDlibShapePredictor = loadDlibShapePredictor();
+    const auto pShapePredictor = loadShapePredictor();
+    EXPECT_EQ(pDlibShapePredictor->num_parts(), pShapePredictor->numParts());
+
+    cv::Mat grayImage;
+    cv::cvtColor(m_image, grayImage, cv::COLOR_BGR2GRAY);
+    for (const auto & faceRect : m_faceRects)
+    {
+        expectSameShape((*pDlibShapePredictor)(dlib::cv_image<dlib::bgr_pixel>(m_image), faceRect),
+                        (*pShapePredictor)(m_image, faceRect));
+        expectSameShape((*pDlibShapePredictor)(dlib::cv_image<unsigned char>(grayImage), faceRect),
+                        (*pShapePredictor)(grayImage, faceRect));
+    }
+}
+
+TEST_F(ShapePredictorTests, PredictsSeveralFacesAtOnce)
+{
+    const auto pShapePredictor = loadShapePredictor();
+
+    const auto shapes = (*pShapePredictor)(m_image, m_faceRects);
+    ASSERT_EQ(m_faceRects.size(), shapes.size());
+    for (size_t i = 0; i < m_faceRects.size(); ++i)
+    {
+        expectSameShape((*pShapePredictor)(m_image, m_faceRects[i]), shapes[i]);
+    }
+    EXPECT_TRUE((*pShapePredictor)(m_image, std::vector<dlib::rectangle>()).empty());
+}
+
+TEST_F(ShapePredictorTests, RejectsInvalidInputs)
+{
+    const auto pShapePredictor = loadShapePredictor();
+    cv::Mat floatImage;
+    m_image.convertTo(floatImage, CV_32FC3);
+    EXPECT_THROW((*pShapePredictor)(floatImage, m_faceRects.front()), std::invalid_argument);
+
+    std::istringstream truncatedModel(m_modelData.substr(0, m_modelData.size() / 2));
+    EXPECT_ANY_THROW(ShapePredictor shapePredictor(truncatedModel));
+
+    std::ifstream quantizedModelStream(quantizedModelFile(), std::ios::binary);
+    const std::string quantizedModel((std::istreambuf_iterator<char>(quantizedModelStream)),
+                                     std::istreambuf_iterator<char>());
+    std::istringstream truncatedQuantizedModel(quantizedModel.substr(0, quantizedModel.size() / 2));
+    EXPECT_THROW(ShapePredictor shapePredictor(truncatedQuantizedModel), std::runtime_error);
+}
+
+TEST_F(ShapePredictorTests, QuantizedModelPredictsCloseShapes)
+{
+    const auto pShapePredictor = loadShapePredictor();
+    const auto pQuantizedShapePredictor = loadQuantizedShapePredictor();
+    EXPECT_FALSE(pShapePredictor->isQuantized());
+    ASSERT_TRUE(pQuantizedShapePredictor->isQuantized());
+    ASSERT_EQ(pShapePredictor->numParts(), pQuantizedShapePredictor->numParts());
+    ASSERT_EQ(pShapePredictor->numLevels(), pQuantizedShapePredictor->numLevels());
+
+    for (const auto & faceRect : m_faceRects)
+    {
+        const auto shape = (*pShapePredictor)(m_image, faceRect);
+        const auto quantizedShape = (*pQuantizedShapePredictor)(m_image, faceRect);
+        ASSERT_EQ(shape.num_parts(), quantizedShape.num_parts());
+        double totalDistance = 0;
+        for (unsigned long i = 0; i < shape.num_parts(); ++i)
+        {
+            totalDistance += std::sqrt(static_cast<double>((shape.part(i) - quantizedShape.part(i)).length_squared()));
+        }
+        // Parts move by a small fraction of the face size on average
+        EXPECT_LT(totalDistance / shape.num_parts(), 0.02 * faceRect.width());
+    }
+}
+
+TEST_F(ShapePredictorTests, EarlyExitSkipsTheLevelsThatBarelyMoveTheParts)
+{
+    const auto pShapePredictor = loadShapePredictor();
+    const auto numLevels = pShapePredictor->numLevels();
+    ASSERT_GT(numLevels, 1u);
+
+    std::vector<size_t> numLevelsRun;
+    const auto shapes = (*pShapePredictor)(m_image, m_faceRects, 0.0f, numLevelsRun);
+    ASSERT_EQ(m_faceRects.size(), numLevelsRun.size());
+    for (size_t i = 0; i < m_faceRects.size(); ++i)
+    {
+        EXPECT_EQ(numLevels, numLevelsRun[i]);
+        expectSameShape((*pShapePredictor)(m_image, m_faceRects[i]), shapes[i]);
+    }
+
+    // No level moves the parts by the size of the face
+    size_t numLevelsRunForOneFace;
+    (*pShapePredictor)(m_image, m_faceRects.front(), 1.0f, numLevelsRunForOneFace);
+    EXPECT_EQ(1u, numLevelsRunForOneFace);
+
+    const auto earlyExitShapes = (*pShapePredictor)(m_image, m_faceRects, 0.002f, numLevelsRun);
+    for (size_t i = 0; i < m_faceRects.size(); ++i)
+    {
+        EXPECT_GE(numLevelsRun[i], 1u);
+        EXPECT_LE(numLevelsRun[i], numLevels);
+        double totalDistance = 0;
+        for (unsigned long k = 0; k < shapes[i].num_parts(); ++k)
+        {
+            totalDistance
+                += std::sqrt(static_cast<double>((shapes[i].part(k) - earlyExitShapes[i].part(k)).length_squared()));
+        }
+        EXPECT_LT(totalDistance / shapes[i].num_parts(), 0.02 * m_faceRects[i].width());
+    }
+}
+
+TEST_F(ShapePredictorTests, DISABLED_Benchmark)
+{
+    const auto pDlibShapePredictor = loadDlibShapePredictor();
+    const auto pShapePredictor = loadShapePredictor();
+    const auto numIterations = 200;
+    const dlib::cv_image<dlib::bgr_pixel> dlibImage(m_image);
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < numIterations; ++i)
+    {
+        for (const auto & faceRect : m_faceRects)
+        {
+            (*pDlibShapePredictor)(dlibImage, faceRect);
+        }
+    }
+    const std::chrono::duration<double, std::micro> dlibTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < numIterations; ++i)
+    {
+        for (const auto & faceRect : m_faceRects)
+        {
+            (*pShapePredictor)(m_image, faceRect);
+        }
+    }
+    const std::chrono::duration<double, std::micro> flattenedTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < numIterations; ++i)
+    {
+        (*pShapePredictor)(m_image, m_faceRects);
+    }
+    const std::chrono::duration<double, std::micro> batchedTime = std::chrono::steady_clock::now() - start;
+
+    const auto numFaces = static_cast<double>(numIterations * m_faceRects.size());
+    std::cout << "Shape prediction per face: dlib " << dlibTime.count() / numFaces << " us, flattened "
+              << flattenedTime.count() / numFaces << " us, flattened with " << m_faceRects.size()
+              << " faces at once " << batchedTime.count() / numFaces << " us" << std::endl;
+}
+
+TEST_F(ShapePredictorTests, DISABLED_QuantizedModelAccuracy)
+{
+    std::ifstream quantizedModelStream(quantizedModelFile(), std::ios::binary | std::ios::ate);
+    std::cout << "Shape predictor model size: " << m_modelData.size() << " bytes, quantized "
+              << quantizedModelStream.tellg() << " bytes" << std::endl;
+
+    for (const auto quantized : { false, true })
+    {
+        const auto pPppEngine = std::make_shared<PppEngine>();
+        ASSERT_TRUE(pPppEngine->configure(shapePredictorConfigString(quantized)));
+        std::chrono::duration<double, std::milli> elapsedTime(0);
+        std::vector<double> eyeErrors, lipsErrors, chinErrors;
+
+        const auto process = [&](const std::string & imagePrefix,
+                                 cv::Mat & rgbImage,
+                                 cv::Mat & grayImage,
+                                 const LandMarks & annotations,
+                                 LandMarks & detectedLandMarks) -> bool {
+            const auto imageKey = pPppEngine->setInputImage(rgbImage);
+            const auto start = std::chrono::steady_clock::now();
+            const auto success = pPppEngine->detectLandMarks(imageKey, detectedLandMarks);
+            elapsedTime += std::chrono::steady_clock::now() - start;
+            if (!success)
+            {
+                return false;
+            }
+
+            // Errors relative to the annotated distance between the crown and the chin
+            const auto faceHeight = cv::norm(annotations.chinPoint - annotations.crownPoint);
+            eyeErrors.push_back(cv::norm(detectedLandMarks.eyeLeftPupil - annotations.eyeLeftPupil) / faceHeight);
+            eyeErrors.push_back(cv::norm(detectedLandMarks.eyeRightPupil - annotations.eyeRightPupil) / faceHeight);
+            lipsErrors.push_back(cv::norm(detectedLandMarks.lipLeftCorner - annotations.lipLeftCorner) / faceHeight);
+            lipsErrors.push_back(cv::norm(detectedLandMarks.lipRightCorner - annotations.lipRightCorner) / faceHeight);
+            chinErrors.push_back(cv::norm(detectedLandMarks.chinPoint - annotations.chinPoint) / faceHeight);
+            return true;
+        };
+
+        std::vector<ResultData> rd;
+        processDatabase(process,
+                        std::vector<std::string>(),
+                        "research/mugshot_frontal_original_all/via_region_data_dpd.csv",
+                        rd);
+
+        ASSERT_FALSE(chinErrors.empty());
+        const auto mean = [](const std::vector<double> & values) {
+            return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+        };
+        std::cout << (quantized ? "Quantized" : "Full precision") << " model: " << elapsedTime.count() / rd.size()
+                  << " ms per image, mean errors of the pupils " << mean(eyeErrors) * 100 << "%, lip corners "
+                  << mean(lipsErrors) * 100 << "%, chin " << mean(chinErrors) * 100
+                  << "% of the crown to chin distance" << std::endl;
+    }
+}
+
+TEST_F(ShapePredictorTests, DISABLED_EarlyExitBenchmark)
+{
+    const auto pShapePredictor = loadShapePredictor();
+    const auto numIterations = 200;
+    const auto & faceRect = m_faceRects.front();
+    const auto shape = (*pShapePredictor)(m_image, faceRect);
+
+    for (const auto minShapeUpdate : { 0.0f, 0.001f, 0.002f, 0.005f, 0.01f })
+    {
+        size_t numLevelsRun = 0;
+        dlib::full_object_detection earlyExitShape;
+        const auto start = std::chrono::steady_clock::now();
+        for (auto i = 0; i < numIterations; ++i)
+        {
+            earlyExitShape = (*pShapePredictor)(m_image, faceRect, minShapeUpdate, numLevelsRun);
+        }
+        const std::chrono::duration<double, std::micro> elapsedTime = std::chrono::steady_clock::now() - start;
+
+        double maxDistance = 0;
+        for (unsigned long k = 0; k < shape.num_parts(); ++k)
+        {
+            maxDistance = std::max(
+                maxDistance, std::sqrt(static_cast<double>((shape.part(k) - earlyExitShape.part(k)).length_squared())));
+        }
+        std::cout << "Minimum shape update " << minShapeUpdate << ": " << numLevelsRun << " of "
+                  << pShapePredictor->numLevels() << " levels, " << elapsedTime.count() / numIterations
+                  << " us per face, parts moved up to " << maxDistance * 100 / faceRect.width()
+                  << "% of the face width" << std::endl;
+    }
+}
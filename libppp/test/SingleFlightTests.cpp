@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "SingleFlight.h"
+
+class SingleFlightTests : public testing::Test
+{
+protected:
+    SingleFlight<int> m_singleFlight;
+};
+
+TEST_F(SingleFlightTests, ConcurrentCallersShareTheResult)
+{
+    const std::string key = "a1b2c3d4";
+    std::atomic<int> numComputations(0);
+
+    const auto compute = [&]() {
+        ++numComputations;
+        // Hold the computation until the second caller is waiting on it
+        while (m_singleFlight.numCallers(key) < 2)
+        {
+            std::this_thread::yield();
+        }
+        return 42;
+    };
+
+    int result1 = 0, result2 = 0;
+    std::thread leader([&]() { result1 = m_singleFlight.run(key, compute); });
+    while (m_singleFlight.numCallers(key) < 1)
+    {
+        std::this_thread::yield();
+    }
+    std::thread follower([&]() { result2 = m_singleFlight.run(key, compute); });
+    leader.join();
+    follower.join();
+
+    EXPECT_EQ(1, numComputations.load()) << "Only the first caller should run the computation";
+    EXPECT_EQ(42, result1);
+    EXPECT_EQ(42, result2);
+    EXPECT_EQ(0, m_singleFlight.numCallers(key));
+}
+
+TEST_F(SingleFlightTests, SequentialCallsAreNotCached)
+{
+    auto numComputations = 0;
+    const auto compute = [&]() { return ++numComputations; };
+
+    EXPECT_EQ(1, m_singleFlight.run("key", compute));
+    EXPECT_EQ(2, m_singleFlight.run("key", compute));
+    EXPECT_EQ(3, m_singleFlight.run("other", compute));
+}
+
+TEST_F(SingleFlightTests, ExceptionsArePropagatedToCallers)
+{
+    EXPECT_THROW(m_singleFlight.run("key", []() -> int { throw std::runtime_error("Failure"); }), std::runtime_error);
+    EXPECT_EQ(0, m_singleFlight.numCallers("key"));
+}
@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "StageGraph.h"
+#include "ThreadPool.h"
+
+class StageGraphTests : public testing::Test
+{
+protected:
+    ThreadPoolSPtr m_pThreadPool = std::make_shared<ThreadPool>(2);
+};
+
+TEST_F(StageGraphTests, StagesRunAfterTheirDependencies)
+{
+    StageGraph stageGraph(m_pThreadPool);
+    std::atomic<int> step(0);
+    int leftStep = -1, rightStep = -1, mergeStep = -1;
+    const auto left = stageGraph.addStage([&]() {
+        leftStep = step++;
+        return true;
+    });
+    const auto right = stageGraph.addStage([&]() {
+        rightStep = step++;
+        return true;
+    });
+    stageGraph.addStage(
+        [&]() {
+            mergeStep = step++;
+            return true;
+        },
+        { left, right });
+
+    EXPECT_TRUE(stageGraph.run());
+    EXPECT_EQ(2, mergeStep);
+    EXPECT_NE(leftStep, rightStep);
+    EXPECT_LT(leftStep, 2);
+    EXPECT_LT(rightStep, 2);
+}
+
+TEST_F(StageGraphTests, IndependentStagesRunConcurrently)
+{
+    // Each stage waits for the other one to start, which would never happen if they ran one after the other
+    StageGraph stageGraph(m_pThreadPool);
+    std::atomic<int> numStarted(0);
+    const auto waitForTheOther = [&numStarted]() {
+        ++numStarted;
+        const auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (numStarted < 2 && std::chrono::steady_clock::now() < timeout)
+        {
+            std::this_thread::yield();
+        }
+        return numStarted == 2;
+    };
+    stageGraph.addStage(waitForTheOther);
+    stageGraph.addStage(waitForTheOther);
+
+    EXPECT_TRUE(stageGraph.run());
+}
+
+TEST_F(StageGraphTests, StagesAfterAFailedStageAreSkipped)
+{
+    for (const auto & pThreadPool : { m_pThreadPool, ThreadPoolSPtr() })
+    {
+        StageGraph stageGraph(pThreadPool);
+        std::atomic<bool> skippedStageRun(false);
+        const auto failed = stageGraph.addStage([]() { return false; });
+        const auto independent = stageGraph.addStage([]() { return true; });
+        const auto skipped = stageGraph.addStage(
+            [&skippedStageRun]() {
+                skippedStageRun = true;
+                return true;
+            },
+            { failed, independent });
+
+        EXPECT_FALSE(stageGraph.run());
+        EXPECT_FALSE(stageGraph.succeeded(failed));
+        EXPECT_TRUE(stageGraph.succeeded(independent));
+        EXPECT_FALSE(stageGraph.succeeded(skipped));
+        EXPECT_FALSE(skippedStageRun.load());
+    }
+}
+
+TEST_F(StageGraphTests, ExceptionsArePropagatedOnceAllStagesCompleted)
+{
+    StageGraph stageGraph(m_pThreadPool);
+    std::atomic<bool> otherStageRun(false);
+    stageGraph.addStage([]() -> bool { throw std::runtime_error("Failure"); });
+    const auto other = stageGraph.addStage([&otherStageRun]() {
+        otherStageRun = true;
+        return true;
+    });
+
+    EXPECT_THROW(stageGraph.run(), std::runtime_error);
+    EXPECT_TRUE(otherStageRun.load());
+    EXPECT_TRUE(stageGraph.succeeded(other));
+}
+
+TEST_F(StageGraphTests, StagesCanOnlyDependOnPreviousStages)
+{
+    StageGraph stageGraph;
+    EXPECT_THROW(stageGraph.addStage([]() { return true; }, { 0 }), std::invalid_argument);
+}
+
+TEST_F(StageGraphTests, GraphsCanRunFromTheWorkersOfThePool)
+{
+    // The stages run inline in the worker, in the order they become ready
+    auto result = m_pThreadPool->submit([this]() {
+        StageGraph stageGraph(m_pThreadPool);
+        const auto first = stageGraph.addStage([]() { return true; });
+        stageGraph.addStage([]() { return true; }, { first });
+        return stageGraph.run();
+    });
+    EXPECT_TRUE(result.get());
+}
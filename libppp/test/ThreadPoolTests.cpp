@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "ThreadPool.h"
+
+class ThreadPoolTests : public testing::Test
+{
+protected:
+    ThreadPool m_threadPool { 2 };
+};
+
+TEST_F(ThreadPoolTests, TasksRunInWorkerThreads)
+{
+    auto result = m_threadPool.submit([this]() { return m_threadPool.isWorkerThread() ? 42 : 0; });
+    EXPECT_EQ(42, result.get());
+    EXPECT_FALSE(m_threadPool.isWorkerThread());
+}
+
+TEST_F(ThreadPoolTests, NestedTasksRunInline)
+{
+    // Every worker waits for a nested task, that would never run if it was queued
+    std::vector<std::future<int>> results;
+    for (auto i = 0; i < 4; ++i)
+    {
+        results.push_back(m_threadPool.submit([this, i]() { return m_threadPool.submit([i]() { return i; }).get(); }));
+    }
+    for (auto i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(i, results[i].get());
+    }
+}
+
+TEST_F(ThreadPoolTests, ExceptionsArePropagated)
+{
+    auto result = m_threadPool.submit([]() -> int { throw std::runtime_error("Failure"); });
+    EXPECT_THROW(result.get(), std::runtime_error);
+}
+
+TEST_F(ThreadPoolTests, PoolWithoutWorkersRunsInline)
+{
+    ThreadPool threadPool(0);
+    std::atomic<bool> hasRun(false);
+    auto result = threadPool.submit([&hasRun]() { hasRun = true; });
+    EXPECT_TRUE(hasRun.load());
+    result.get();
+}
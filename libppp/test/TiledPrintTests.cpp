@@ -56,3 +56,24 @@ TEST_F(PhotoPrintMakerTests, TestCroppingWorks)
     verifyEqualImage(expectedPrintPath, printPhoto);
 #endif
 }
+
+TEST_F(PhotoPrintMakerTests, CropGeometryMatchesTheCroppedPicture)
+{
+    const PhotoStandard passportStandard(35.0, 45.0, 34.0);
+    const cv::Point crownPos(941, 999);
+    const cv::Point chinPos(927, 1675);
+
+    const auto cropRect = m_pPhotoPrintMaker->cropGeometry(crownPos, chinPos, passportStandard);
+
+    const cv::Mat image(2000, 2000, CV_8UC3, cv::Scalar(0, 0, 0));
+    const auto croppedImage = m_pPhotoPrintMaker->cropPicture(image, crownPos, chinPos, passportStandard);
+    EXPECT_NEAR(croppedImage.cols, cropRect.size.width, 1.0);
+    EXPECT_NEAR(croppedImage.rows, cropRect.size.height, 1.0);
+
+    // Crown is to the right of the chin, the crop is rotated clockwise
+    EXPECT_NEAR(atan2(14.0, 676.0) * 180.0 / CV_PI, cropRect.angle, 1e-3);
+
+    // Without eyes height the crop is centered between crown and chin
+    EXPECT_NEAR(934.0, cropRect.center.x, 1e-3);
+    EXPECT_NEAR(1337.0, cropRect.center.y, 1e-3);
+}
@@ -4,6 +4,7 @@
 #include "TestHelpers.h"
 #include <gtest/gtest.h>
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 #include <utility>
 
 using namespace std;
@@ -53,6 +54,60 @@ TEST(UtilitiesTests, TestBase64EncodeDecode)
     }
 }
 
+TEST(UtilitiesTests, PerceptualHashIsRobustToReencodingAndResizing)
+{
+    const auto image = imread(resolvePath("research/sample_test_images/000.jpg"));
+    const auto otherImage = imread(resolvePath("research/sample_test_images/001.jpg"));
+
+    vector<uint8_t> jpegData;
+    imencode(".jpg", image, jpegData, { IMWRITE_JPEG_QUALITY, 60 });
+    const auto reencodedImage = imdecode(jpegData, IMREAD_COLOR);
+
+    Mat resizedImage;
+    resize(image, resizedImage, Size(), 0.37, 0.37, INTER_AREA);
+
+    const auto hash = Utilities::perceptualHash(image);
+    EXPECT_LE(Utilities::hammingDistance(hash, Utilities::perceptualHash(reencodedImage)), 2);
+    EXPECT_LE(Utilities::hammingDistance(hash, Utilities::perceptualHash(resizedImage)), 2);
+    EXPECT_GT(Utilities::hammingDistance(hash, Utilities::perceptualHash(otherImage)), 10);
+}
+
+TEST(UtilitiesTests, HammingDistanceCountsDifferentBits)
+{
+    EXPECT_EQ(0, Utilities::hammingDistance(0x0123456789abcdefULL, 0x0123456789abcdefULL));
+    EXPECT_EQ(1, Utilities::hammingDistance(0x8000000000000000ULL, 0));
+    EXPECT_EQ(64, Utilities::hammingDistance(0xffffffffffffffffULL, 0));
+}
+
+TEST(UtilitiesTests, RotationsAreExactAndPointsMapToTheRotatedImage)
+{
+    cv::Mat image(3, 4, CV_8UC1);
+    for (auto i = 0; i < image.rows * image.cols; ++i)
+    {
+        image.at<uint8_t>(i / image.cols, i % image.cols) = static_cast<uint8_t>(i);
+    }
+
+    for (const auto angle : { 0, 90, -90, 180, 270, -270 })
+    {
+        const auto rotatedImage = Utilities::rotateImage(image, angle);
+        ASSERT_EQ(std::abs(angle) % 180 == 90 ? cv::Size(3, 4) : cv::Size(4, 3), rotatedImage.size());
+        for (auto y = 0; y < image.rows; ++y)
+        {
+            for (auto x = 0; x < image.cols; ++x)
+            {
+                const auto rotatedPoint = Utilities::rotatePoint(cv::Point(x, y), image.size(), angle);
+                EXPECT_EQ(image.at<uint8_t>(y, x), rotatedImage.at<uint8_t>(rotatedPoint)) << "Angle " << angle;
+                EXPECT_EQ(cv::Point(x, y), Utilities::rotatePoint(rotatedPoint, rotatedImage.size(), -angle));
+            }
+        }
+    }
+
+    // Counter clockwise: the top right corner goes to the top left corner
+    EXPECT_EQ(cv::Point(0, 0), Utilities::rotatePoint(cv::Point(3, 0), image.size(), 90));
+    EXPECT_EQ(cv::Rect(1, 0, 2, 3), Utilities::rotateRect(cv::Rect(1, 1, 3, 2), image.size(), 90));
+    EXPECT_THROW(Utilities::rotateImage(image, 45), std::logic_error);
+}
+
 TEST(UtilitiesTests, SelfCoefficientImageTests1)
 {
     const auto imageBear = resolvePath("research/mugshot_frontal_original_all/071_frontal.jpg");
@@ -0,0 +1,98 @@
+"""
+Trains a shape predictor for only the landmarks libppp reads (pupils, lip corners and chin) on the
+ibug_300W_large_face_landmark_dataset, and writes the shapePredictor configuration node that goes with it.
+The training is deterministic for a given dataset, options and random seed
+"""
+import os
+import json
+import time
+import argparse
+import xml.etree.ElementTree as ET
+
+import dlib
+
+# Landmarks averaged by PppEngine::getLandMark, numbered from 1 as in the 68 points markup
+KEPT_POINTS = [9, 38, 39, 41, 42, 44, 45, 47, 48, 49, 55]
+
+ROOT_DIR = os.path.abspath(os.path.join(os.path.dirname(__file__), '..', '..'))
+
+
+def keep_landmarks(orig_data_xml, mod_data_xml):
+    """
+    Removes all the parts but the kept ones from a dataset in the 68 points markup (parts named '00' to '67')
+    """
+    tree = ET.parse(orig_data_xml)
+    root = tree.getroot()
+    for box in root.findall('./images/image/box'):
+        remove_parts = [part for part in box.iter('part') if int(part.get('name')) + 1 not in KEPT_POINTS]
+        for part in remove_parts:
+            box.remove(part)
+    tree.write(mod_data_xml)
+
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description='Trains the minimal landmark shape predictor')
+    parser.add_argument('dataset_dir', help='Directory of the ibug_300W_large_face_landmark_dataset')
+    parser.add_argument('--train-xml', default='labels_ibug_300W_train.orig.xml',
+                        help='Training annotations with the 68 points, relative to the dataset directory')
+    parser.add_argument('--test-xml', default='labels_ibug_300W_test.orig.xml',
+                        help='Testing annotations with the 68 points, relative to the dataset directory')
+    parser.add_argument('--output', default=os.path.join(ROOT_DIR, 'libppp/share/sp_model_minimal.dat'),
+                        help='Trained model, the configuration node is written next to it with a .json extension')
+    parser.add_argument('--cascade-depth', type=int, default=10, help='Number of cascade levels')
+    parser.add_argument('--trees-per-level', type=int, default=500, help='Number of trees in each cascade level')
+    parser.add_argument('--tree-depth', type=int, default=4, help='Depth of the trees')
+    parser.add_argument('--nu', type=float, default=0.1, help='Regularization (learning rate) of the trees')
+    parser.add_argument('--oversampling', type=int, default=20, help='Initial shapes sampled for each face')
+    parser.add_argument('--feature-pool-size', type=int, default=400, help='Feature pixels sampled at each level')
+    parser.add_argument('--seed', default='ppp', help='Seed of the random number generator')
+    parser.add_argument('--threads', type=int, default=0, help='Training threads, all the cores when 0')
+    return parser.parse_args()
+
+
+def main():
+    """
+    Main
+    """
+    args = parse_arguments()
+
+    # The reduced datasets go next to the original ones, the paths of their images are relative to their directory
+    datasets = {}
+    for name, xml_file in (('train', args.train_xml), ('test', args.test_xml)):
+        datasets[name] = os.path.join(args.dataset_dir, 'labels_ibug_300W_%s_minimal.xml' % name)
+        print('Keeping landmarks %s of the %s data ...' % (KEPT_POINTS, name))
+        keep_landmarks(os.path.join(args.dataset_dir, xml_file), datasets[name])
+
+    options = dlib.shape_predictor_training_options()
+    options.cascade_depth = args.cascade_depth
+    options.num_trees_per_cascade_level = args.trees_per_level
+    options.tree_depth = args.tree_depth
+    options.nu = args.nu
+    options.oversampling_amount = args.oversampling
+    options.feature_pool_size = args.feature_pool_size
+    options.random_seed = args.seed
+    if hasattr(options, 'num_threads'):
+        options.num_threads = args.threads if args.threads > 0 else os.cpu_count()
+    options.be_verbose = True
+
+    start = time.time()
+    dlib.train_shape_predictor(datasets['train'], args.output, options)
+    print('Training completed in %.0f s, model size %d bytes' % (time.time() - start, os.path.getsize(args.output)))
+    for name in ('train', 'test'):
+        print('Mean %s error: %.3f pixels' % (name, dlib.test_shape_predictor(datasets[name], args.output)))
+
+    # PppEngine maps the landmarks it reads to the parts of the model through the missing points
+    config_node = {
+        'missingPoints': [i for i in range(1, 69) if i not in KEPT_POINTS],
+        'file': os.path.basename(args.output),
+        'data': ''
+    }
+    config_file = os.path.splitext(args.output)[0] + '.json'
+    with open(config_file, 'w') as fp:
+        json.dump(config_node, fp, indent=4)
+    print('Configuration of the model written to "%s", it replaces the shapePredictor node of config.json'
+          % config_file)
+
+
+if __name__ == "__main__":
+    main()
@@ -3,6 +3,9 @@ import {Component, ElementRef, OnInit} from '@angular/core';
 import {Canvas, CrownChinPointPair, PhotoStandard, TiledPhotoRequest, UnitType} from './model/datatypes';
 import {BackEndService, ImageLoadResult} from './services/back-end.service';
 
+const kPreviewMaxWidth = 640;
+const kPreviewMaxHeight = 480;
+
 @Component({
     selector: 'app-root',
     template: `
@@ -31,6 +34,7 @@ import {BackEndService, ImageLoadResult} from './services/back-end.service';
                                     style="margin: 0 auto;"
                                     [inputPhoto]="imageLoadResult"
                                     [crownChinPointPair]="crownChinPointPair"
+                                    (editing)="onLandmarksEditing($event)"
                                     (edited)="onLandmarksEdited($event)"
                                 >
                                 </app-landmark-editor>
@@ -84,6 +88,9 @@ import {BackEndService, ImageLoadResult} from './services/back-end.service';
                     </app-print-definition-selector>
                 </div>
             </div>
+            <div class="row" *ngIf="previewImgSrc != '#'">
+                <img [src]="previewImgSrc" class="col-lg-8 col-sm-12 fit" />
+            </div>
             <div class="row">
                 <a *ngIf="outImgSrc != '#'" [href]="outImgSrc" download="print.png" class="col-lg-8 col-sm-12">
                     <img [src]="outImgSrc" *ngIf="outImgSrc != '#'" class="fit" />
@@ -108,6 +115,7 @@ export class AppComponent implements OnInit {
 
     imageLoadResult: ImageLoadResult;
     outImgSrc: any = '#';
+    previewImgSrc: any = '#';
 
     // Model data
     crownChinPointPair: CrownChinPointPair;
@@ -167,6 +175,28 @@ export class AppComponent implements OnInit {
     }
 
 
+    onLandmarksEditing(crownChinPointPair: CrownChinPointPair) {
+        if (!this.imageLoadResult || !this.photoStandard || !this.canvas) {
+            return;
+        }
+        // A low resolution preview follows the drag, the full print is only created on demand
+        const req = new TiledPhotoRequest(
+            this.imageLoadResult.imgKey,
+            this.photoStandard.dimensions,
+            this.canvas,
+            crownChinPointPair
+        );
+        this.beService
+            .getPreview(req, kPreviewMaxWidth, kPreviewMaxHeight, true)
+            .then(previewDataUrl => {
+                this.previewImgSrc = previewDataUrl;
+            })
+            .catch(error => {
+                // Superseded requests are expected while dragging
+                console.log(error.message);
+            });
+    }
+
     onLandmarksEdited(crownChinPointPair: CrownChinPointPair) {
         this.crownChinPointPair = crownChinPointPair;
     }
@@ -183,6 +213,7 @@ export class AppComponent implements OnInit {
 
         this.beService.getTiledPrint(req).then(outputDataUrl => {
             this.outImgSrc = outputDataUrl;
+            this.previewImgSrc = '#';
         });
     }
 }
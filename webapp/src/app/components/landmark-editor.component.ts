@@ -112,6 +112,10 @@ export class LandmarkEditorComponent implements OnInit {
     @Output()
     edited: EventEmitter<any> = new EventEmitter<any>();
 
+    // Emitted on every move of a landmark while it is dragged, edited is emitted when the drag ends
+    @Output()
+    editing: EventEmitter<any> = new EventEmitter<any>();
+
     constructor(private el: ElementRef) {
         this.crownPoint = new Point(0, 0);
         this.chinPoint = new Point(0, 0);
@@ -144,6 +148,9 @@ export class LandmarkEditorComponent implements OnInit {
                 const y = (parseFloat(target.getAttribute('y')) || 0) + event.dy;
                 // translate the element
                 that.translateElement(target, new Point(x, y));
+                const crownPoint = that.screenToPixel(that._crownMarkElmt);
+                const chinPoint = that.screenToPixel(that._chinMarkElmt);
+                that.editing.emit(new CrownChinPointPair(crownPoint, chinPoint));
             },
             // call this function on every dragend event
             onend: function(event) {
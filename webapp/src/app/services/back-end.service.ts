@@ -2,6 +2,11 @@ import {Injectable, EventEmitter} from '@angular/core';
 import {DomSanitizer, SafeResourceUrl} from '@angular/platform-browser';
 import {TiledPhotoRequest} from '../model/datatypes';
 
+interface PreviewCallbacks {
+    resolve: (jpegDataUrl: SafeResourceUrl) => void;
+    reject: (reason: Error) => void;
+}
+
 export class ImageLoadResult {
     constructor(public imgKey: string, public imgRotation: string, public imgDataUrl: string) {}
 }
@@ -25,6 +30,13 @@ export class BackEndService {
     private _onLandmarksDetected: (landmarks: object) => void;
     private _onCreateTiledPrint: (pngDataUrl: SafeResourceUrl) => void;
 
+    // The worker renders one preview at a time: while a preview is rendered, only the latest request waits
+    // for its turn and the requests it replaces are rejected
+    private _previewRequestId = 0;
+    private _pendingPreviews = new Map<number, PreviewCallbacks>();
+    private _queuedPreview: {requestId: number; request: object} = null;
+    private _previewUrl: string = null;
+
     constructor(private sanitizer: DomSanitizer) {
         // this.plt.ready().then((readySource) => {
         //     this._isMobilePlatform = this.plt.is('ios') || this.plt.is('android');
@@ -57,6 +69,9 @@ export class BackEndService {
                         const pngDataUrl = this.sanitizer.bypassSecurityTrustResourceUrl(imageUrl);
                         this._onCreateTiledPrint(pngDataUrl);
                         break;
+                    case 'onCreatePreview':
+                        this._onPreviewCreated(e.data.requestId, e.data.imageData);
+                        break;
                     case 'onAppDataLoadingProgress':
                         this.appLoadingProgressReported.emit(e.data.progressPct);
                         break;
@@ -203,6 +218,55 @@ export class BackEndService {
         // });
     }
 
+    getPreview(
+        req: TiledPhotoRequest,
+        maxWidth: number,
+        maxHeight: number,
+        tiled: boolean
+    ): Promise<SafeResourceUrl> {
+        return new Promise((resolve, reject) => {
+            const requestId = ++this._previewRequestId;
+            this._pendingPreviews.set(requestId, {resolve, reject});
+            const request = {...req, preview: {maxWidth, maxHeight, tiled, format: 'jpeg'}};
+            if (this._queuedPreview) {
+                this._rejectPreview(this._queuedPreview.requestId, new Error('Preview request superseded'));
+            }
+            this._queuedPreview = {requestId, request};
+            if (this._pendingPreviews.size === 1) {
+                this._postQueuedPreview();
+            }
+        });
+    }
+
+    private _postQueuedPreview() {
+        const {requestId, request} = this._queuedPreview;
+        this._queuedPreview = null;
+        this.worker.postMessage({cmd: 'createPreview', requestId, request});
+    }
+
+    private _rejectPreview(requestId: number, reason: Error) {
+        this._pendingPreviews.get(requestId).reject(reason);
+        this._pendingPreviews.delete(requestId);
+    }
+
+    private _onPreviewCreated(requestId: number, imageData: Uint8Array) {
+        if (imageData.length === 0) {
+            this._rejectPreview(requestId, new Error('The preview could not be created'));
+        } else {
+            // Only the latest preview is displayed, release the previous one
+            if (this._previewUrl) {
+                URL.revokeObjectURL(this._previewUrl);
+            }
+            this._previewUrl = URL.createObjectURL(new Blob([imageData], {type: 'image/jpeg'}));
+            const previewUrl = this.sanitizer.bypassSecurityTrustResourceUrl(this._previewUrl);
+            this._pendingPreviews.get(requestId).resolve(previewUrl);
+            this._pendingPreviews.delete(requestId);
+        }
+        if (this._queuedPreview) {
+            this._postQueuedPreview();
+        }
+    }
+
     getTiledPrint(req: TiledPhotoRequest): Promise<SafeResourceUrl> {
         return new Promise((resolve, reject) => {
             this._onCreateTiledPrint = resolve;
@@ -13,6 +13,9 @@ if ('function' === typeof importScripts) {
             case 'createTiledPrint':
                 createTilePrint(e.data.request);
                 break;
+            case 'createPreview':
+                createPreview(e.data.requestId, e.data.request);
+                break;
         }
     });
 
@@ -125,4 +128,22 @@ if ('function' === typeof importScripts) {
         postMessage({cmd: 'onCreateTilePrint', pngData: heapBytes});
         Module._free(outImageDataPtr);
     }
+
+    function createPreview(requestId, requestObject) {
+        const imgKeyPtr = _stringToPtr(requestObject.imgKey);
+        const requestObjPtr = _stringToPtr(JSON.stringify(requestObject));
+
+        // Large enough for a raw RGBA preview of up to 1600x1200 pixels, the largest libppp renders
+        const outImageDataSize = 8000000;
+        const outImageDataPtr = Module._malloc(outImageDataSize);
+        const imageDataSize = Module._create_preview(imgKeyPtr, requestObjPtr, outImageDataPtr, outImageDataSize);
+
+        const imageData = Module.HEAPU8.slice(outImageDataPtr, outImageDataPtr + imageDataSize);
+
+        Module._free(imgKeyPtr);
+        Module._free(requestObjPtr);
+        Module._free(outImageDataPtr);
+        // An empty imageData tells the caller that the preview could not be created
+        postMessage({cmd: 'onCreatePreview', requestId: requestId, imageData: imageData}, [imageData.buffer]);
+    }
 }